@@ -0,0 +1,170 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "xfsmgr.h"
+#include "xfssp.h"
+#include "sync.h"
+#include "benchutil.h"
+
+/*
+ * Admission throughput of WFPExecute: one session holds the lock while every other
+ * session submits from a thread of its own, so each call is refused at the lock check
+ * and the whole entry path, up to and including admission, is measured. The same
+ * threads then run the bare check both ways: one load of an atomic lock word, and the
+ * lock state and owner read under a mutex, as the execute path used to.
+ *
+ * Usage: admission_bench [threads] [calls per thread]
+ */
+
+#define BENCH_SPI_VERSIONS 0x00030203
+
+static std::atomic<ULONGLONG> g_completions(0);
+
+static LRESULT CALLBACK BenchWndProc(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+{
+	(void)hWnd;
+	(void)uMessage;
+	(void)wParam;
+	WFMFreeBuffer((LPWFSRESULT)lParam);
+	g_completions++;
+	return 0;
+}
+
+static void BenchWait(ULONGLONG ullCompletions)
+{
+	while (g_completions.load() < ullCompletions)
+		std::this_thread::yield();
+}
+
+/*
+ * @brief 
+ * Runs a loop on every thread at once.
+ * @param dwThreads - Number of threads.
+ * @param body - Loop of one thread, given its index; returns how many calls it refused.
+ * @param lpdwRefused - Receives the calls refused by every thread.
+ * @return double elapsed seconds.
+ */
+template <typename BODY>
+static double BenchRun(DWORD dwThreads, BODY body, DWORD* lpdwRefused)
+{
+	std::atomic<DWORD> dwReady(0);
+	std::atomic<DWORD> dwRefused(0);
+	std::vector<std::thread> threads;
+	double dStart = 0;
+	for (DWORD t = 0; t < dwThreads; t++)
+	{
+		threads.push_back(std::thread([&, t]() {
+			dwReady++;
+			while (dwReady.load() < dwThreads + 1)
+				std::this_thread::yield();
+			dwRefused += body(t);
+		}));
+	}
+	while (dwReady.load() < dwThreads)
+		std::this_thread::yield();
+	dStart = BenchSeconds();
+	dwReady++;
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	*lpdwRefused = dwRefused.load();
+	return BenchSeconds() - dStart;
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwThreads = BenchArgument(argc, argv, 1, 16);
+	DWORD dwCalls = BenchArgument(argc, argv, 2, 200000);
+
+	// Session 1 holds the lock; sessions 2.. submit.
+	HWND hWnd = g_xfs_manager.CreateWindowObject(BenchWndProc, NULL);
+	WFSVERSION spiVersion, srvcVersion;
+	for (DWORD s = 0; s <= dwThreads; s++)
+	{
+		if (WFPOpen(s + 1, (LPSTR)"ALM1", NULL, NULL, 0, 0, hWnd, 1, NULL,
+			BENCH_SPI_VERSIONS, &spiVersion, BENCH_SPI_VERSIONS, &srvcVersion) != WFS_SUCCESS)
+			return 1;
+		BenchWait(s + 1);
+	}
+	if (WFPLock(1, WFS_INDEFINITE_WAIT, hWnd, 2) != WFS_SUCCESS)
+		return 1;
+	BenchWait(dwThreads + 2);
+
+	DWORD dwRefused;
+	double dExecute = BenchRun(dwThreads, [&](DWORD t) {
+		DWORD dwLocked = 0;
+		for (DWORD i = 0; i < dwCalls; i++)
+		{
+			if (WFPExecute(t + 2, WFS_CMD_ALM_RESET_ALARM, NULL, 0, hWnd, i + 2) == WFS_ERR_LOCKED)
+				dwLocked++;
+		}
+		return dwLocked;
+	}, &dwRefused);
+	BOOL bAllLocked = dwRefused == dwThreads * dwCalls;
+
+	// The bare check, with an owner that is never the caller.
+	static int owner;
+	std::atomic<void*> lpOwner(&owner);
+	double dAtomic = BenchRun(dwThreads, [&](DWORD t) {
+		DWORD dwLocked = 0;
+		for (DWORD i = 0; i < dwCalls; i++)
+		{
+			void* lpCurrent = lpOwner.load(std::memory_order_acquire);
+			if (lpCurrent != NULL && lpCurrent != (void*)&t)
+				dwLocked++;
+		}
+		return dwLocked;
+	}, &dwRefused);
+	bAllLocked = bAllLocked && dwRefused == dwThreads * dwCalls;
+
+	SpMutex mutex("admission_bench");
+	BOOL bLocked = TRUE;
+	void* lpMutexOwner = &owner;
+	double dMutex = BenchRun(dwThreads, [&](DWORD t) {
+		DWORD dwLocked = 0;
+		for (DWORD i = 0; i < dwCalls; i++)
+		{
+			std::lock_guard<SpMutex> lock(mutex);
+			if (bLocked && lpMutexOwner != (void*)&t)
+				dwLocked++;
+		}
+		return dwLocked;
+	}, &dwRefused);
+	bAllLocked = bAllLocked && dwRefused == dwThreads * dwCalls;
+
+	ULONGLONG ullCompletions = g_completions.load();
+	if (WFPUnlock(1, hWnd, 3) != WFS_SUCCESS)
+		return 1;
+	BenchWait(++ullCompletions);
+	for (DWORD s = 0; s <= dwThreads; s++)
+	{
+		WFPClose(s + 1, hWnd, 1);
+		BenchWait(++ullCompletions);
+	}
+	WFPUnloadService();
+	g_xfs_manager.DestroyWindowObject(hWnd);
+
+	double dTotal = (double)dwThreads * dwCalls;
+	printf("admission_bench: threads=%u calls=%u execute=%.0f/s atomic_check=%.0f/s mutex_check=%.0f/s refused_all=%s\n",
+		dwThreads, dwThreads * dwCalls, dTotal / dExecute, dTotal / dAtomic, dTotal / dMutex, bAllLocked ? "yes" : "no");
+	return bAllLocked ? 0 : 1;
+}
@@ -0,0 +1,55 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+/*
+ * Helpers shared by the benchmarks. Every benchmark takes its sizes from the command
+ * line so ctest can run it with small ones as a smoke test, and prints one line of
+ * results.
+ */
+
+/*
+ * @brief 
+ * Reads a positive numeric command-line argument.
+ * @param argc - Argument count of main().
+ * @param argv - Arguments of main().
+ * @param nIndex - Index of the argument.
+ * @param dwDefault - Value used when the argument is missing or invalid.
+ * @return DWORD the value.
+ */
+static inline DWORD BenchArgument(int argc, char** argv, int nIndex, DWORD dwDefault)
+{
+	if (nIndex >= argc)
+		return dwDefault;
+	unsigned long ulValue = strtoul(argv[nIndex], NULL, 0);
+	return ulValue ? (DWORD)ulValue : dwDefault;
+}
+
+/*
+ * @brief 
+ * Wall clock of the benchmarks.
+ * @return double seconds from an arbitrary origin.
+ */
+static inline double BenchSeconds(void)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,100 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "xfssp.h"
+#include "executelane.h"
+#include "benchutil.h"
+
+/*
+ * Cost of cancelling execute requests while many are queued in one lane: each request
+ * cancelled by its identifier in random order, then a cancel-all over a full lane.
+ *
+ * Usage: cancel_bench [queued requests] [rounds]
+ */
+
+static DWORD g_dwCancelled;
+
+static void BenchOnCancelled(WFS_MSG* msg)
+{
+	(void)msg;
+	g_dwCancelled++;
+}
+
+static void BenchFill(WFS_LANE* lane, std::vector<WFSRESULT>& results)
+{
+	for (size_t i = 0; i < results.size(); i++)
+		LaneTryPush(lane, NULL, &results[i], 0, WFS_INDEFINITE_WAIT, NULL);
+}
+
+static void BenchDrain(WFS_LANE* lane)
+{
+	WFS_MSG* msg;
+	while ((msg = LanePeek(lane)) != NULL)
+	{
+		LaneBegin(lane, msg);
+		LanePop(lane);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwQueued = BenchArgument(argc, argv, 1, 10000);
+	DWORD dwRounds = BenchArgument(argc, argv, 2, 10);
+
+	WFS_LANE* lane = LaneCreate(NULL, dwQueued);
+	if (lane == NULL)
+		return 1;
+
+	std::vector<WFSRESULT> results(dwQueued);
+	std::vector<REQUESTID> order(dwQueued);
+	memset(&results[0], 0, results.size() * sizeof(WFSRESULT));
+	for (DWORD i = 0; i < dwQueued; i++)
+	{
+		results[i].RequestID = i + 1;
+		order[i] = i + 1;
+	}
+	std::minstd_rand rng(1);
+
+	double dSingle = 0, dAll = 0;
+	for (DWORD round = 0; round < dwRounds; round++)
+	{
+		std::shuffle(order.begin(), order.end(), rng);
+		BenchFill(lane, results);
+		double dStart = BenchSeconds();
+		for (DWORD i = 0; i < dwQueued; i++)
+			LaneCancel(lane, order[i], BenchOnCancelled);
+		dSingle += BenchSeconds() - dStart;
+		BenchDrain(lane);
+
+		BenchFill(lane, results);
+		dStart = BenchSeconds();
+		LaneCancel(lane, 0, BenchOnCancelled);
+		dAll += BenchSeconds() - dStart;
+		BenchDrain(lane);
+	}
+	LaneDestroy(lane);
+
+	printf("cancel_bench: queued=%u rounds=%u ns/cancel=%.1f us/cancel-all=%.1f cancelled=%u\n",
+		dwQueued, dwRounds, dSingle * 1e9 / ((double)dwQueued * dwRounds), dAll * 1e6 / dwRounds,
+		g_dwCancelled);
+	return g_dwCancelled == 2 * dwQueued * dwRounds ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <xfsalm.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "xfsmgr.h"
+#include "xfssp.h"
+#include "capabilities.h"
+#include "resultreserve.h"
+#include "benchutil.h"
+
+/*
+ * GetInfo(CAPABILITIES): first the preparation of the reply alone, copied from the
+ * capabilities image into a reserved block, against building it field by field in
+ * WFMAllocateMore buffers as before the image; then the WFPGetInfo throughput through
+ * the stand-in manager with every session keeping one request outstanding.
+ *
+ * Usage: caps_bench [replies] [sessions] [requests per session]
+ */
+
+#define BENCH_SPI_VERSIONS 0x00030203
+
+static const char g_bench_extra[] = "VendorName=MOCKDEVICE\0SPVersion=3.30\0";
+
+static std::atomic<ULONGLONG> g_completions(0);
+static std::atomic<ULONGLONG> g_failures(0);
+
+static LRESULT CALLBACK BenchWndProc(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+{
+	(void)uMessage;
+	(void)wParam;
+	LPWFSRESULT lpWFSResult = (LPWFSRESULT)lParam;
+	if (lpWFSResult->hResult != WFS_SUCCESS)
+		g_failures++;
+	WFMFreeBuffer(lpWFSResult);
+	((std::atomic<ULONGLONG>*)g_xfs_manager.GetWindowData(hWnd))->fetch_add(1);
+	g_completions++;
+	return 0;
+}
+
+static void BenchWait(ULONGLONG ullCompletions)
+{
+	while (g_completions.load() < ullCompletions)
+		std::this_thread::yield();
+}
+
+/*
+ * @brief 
+ * Builds the reply field by field, with the same list and string as the image.
+ * @param lpResult - The result block.
+ * @return HRESULT - WFS_SUCCESS on success, the WFMAllocateMore error on failure.
+ */
+static HRESULT BenchBuildFields(LPWFSRESULT lpResult)
+{
+	LPWFSALMCAPS lpCaps;
+	HRESULT hResult = WFMAllocateMore(sizeof(WFSALMCAPS), lpResult, (LPVOID*)&lpCaps);
+	if (hResult != WFS_SUCCESS)
+		return hResult;
+
+	lpCaps->wClass = WFS_SERVICE_CLASS_ALM;
+	lpCaps->bProgrammaticallyDeactivate = TRUE;
+	lpCaps->bAntiFraudModule = TRUE;
+
+	hResult = WFMAllocateMore(sizeof(DWORD) * CAPS_SYNC_COMMANDS, lpResult, (LPVOID*)&lpCaps->lpdwSynchronizableCommands);
+	if (hResult != WFS_SUCCESS)
+		return hResult;
+	lpCaps->lpdwSynchronizableCommands[0] = 0;
+
+	hResult = WFMAllocateMore(sizeof(g_bench_extra), lpResult, (LPVOID*)&lpCaps->lpszExtra);
+	if (hResult != WFS_SUCCESS)
+		return hResult;
+	memcpy(lpCaps->lpszExtra, g_bench_extra, sizeof(g_bench_extra));
+
+	lpResult->lpBuffer = lpCaps;
+	return WFS_SUCCESS;
+}
+
+/*
+ * @brief 
+ * Prepares and frees replies one way.
+ * @param bImage - TRUE to copy the image into a reserved block.
+ * @param dwReplies - Number of replies.
+ * @return double nanoseconds per reply, a negative value on failure.
+ */
+static double BenchPrepare(BOOL bImage, DWORD dwReplies)
+{
+	double dStart = BenchSeconds();
+	for (DWORD i = 0; i < dwReplies; i++)
+	{
+		LPWFSRESULT lpResult;
+		HRESULT hResult;
+		if (bImage)
+		{
+			hResult = g_result_reserve.Allocate(&lpResult, RESULT_CLASS_CAPS);
+			if (hResult == WFS_SUCCESS)
+				hResult = CapsCopyImage(lpResult);
+		}
+		else
+		{
+			hResult = WFMAllocateBuffer(sizeof(WFSRESULT), WFS_MEM_SHARE | WFS_MEM_ZEROINIT, (LPVOID*)&lpResult);
+			if (hResult == WFS_SUCCESS)
+				hResult = BenchBuildFields(lpResult);
+		}
+		if (hResult != WFS_SUCCESS)
+			return -1;
+		WFMFreeBuffer(lpResult);
+	}
+	return (BenchSeconds() - dStart) * 1e9 / dwReplies;
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwReplies = BenchArgument(argc, argv, 1, 200000);
+	DWORD dwSessions = BenchArgument(argc, argv, 2, 4);
+	DWORD dwRequests = BenchArgument(argc, argv, 3, 20000);
+
+	std::vector<HWND> windows;
+	std::vector<std::atomic<ULONGLONG>> answers(dwSessions);
+	for (DWORD s = 0; s < dwSessions; s++)
+	{
+		answers[s] = 0;
+		HWND hWnd = g_xfs_manager.CreateWindowObject(BenchWndProc, &answers[s]);
+		windows.push_back(hWnd);
+
+		WFSVERSION spiVersion, srvcVersion;
+		if (WFPOpen(s + 1, (LPSTR)"ALM1", NULL, NULL, 0, 0, hWnd, 1, NULL,
+			BENCH_SPI_VERSIONS, &spiVersion, BENCH_SPI_VERSIONS, &srvcVersion) != WFS_SUCCESS)
+			return 1;
+	}
+	BenchWait(dwSessions);
+
+	// The open built the image and started the reserve.
+	double dFields = BenchPrepare(FALSE, dwReplies);
+	double dImage = BenchPrepare(TRUE, dwReplies);
+
+	double dStart = BenchSeconds();
+	std::vector<std::thread> threads;
+	for (DWORD s = 0; s < dwSessions; s++)
+	{
+		threads.push_back(std::thread([&, s]() {
+			for (DWORD i = 0; i < dwRequests; i++)
+			{
+				ULONGLONG ullBefore = answers[s].load();
+				if (WFPGetInfo(s + 1, WFS_INF_ALM_CAPABILITIES, NULL, 0, windows[s], i + 2) != WFS_SUCCESS)
+				{
+					g_failures++;
+					continue;
+				}
+				while (answers[s].load() == ullBefore)
+					std::this_thread::yield();
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	double dElapsed = BenchSeconds() - dStart;
+	ULONGLONG ullTotal = (ULONGLONG)dwSessions * dwRequests;
+
+	ULONGLONG ullCompletions = g_completions.load();
+	for (DWORD s = 0; s < dwSessions; s++)
+		WFPClose(s + 1, windows[s], 1);
+	BenchWait(ullCompletions + dwSessions);
+	WFPUnloadService();
+	for (DWORD s = 0; s < dwSessions; s++)
+		g_xfs_manager.DestroyWindowObject(windows[s]);
+
+	if (dFields < 0 || dImage < 0)
+		return 1;
+	printf("caps_bench: replies=%u fields ns/reply=%.1f image ns/reply=%.1f\n", dwReplies, dFields, dImage);
+	printf("caps_bench: sessions=%u requests=%llu getinfo/s=%.0f failures=%llu\n",
+		dwSessions, ullTotal, ullTotal / dElapsed, g_failures.load());
+	return g_failures.load() == 0 ? 0 : 1;
+}
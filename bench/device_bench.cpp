@@ -0,0 +1,116 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <ctime>
+#include <thread>
+#include <vector>
+#include "xfsmgr.h"
+#include "mockdevice.h"
+#include "benchutil.h"
+
+/*
+ * Cost of each simulated device: opens a hundredth, a tenth and all of the given number
+ * of mock devices, each raising alarm events at the given rate on the shared scheduler
+ * thread, and lets them run for the given time. Reports the process CPU time and the
+ * resident memory each device added, next to the size of the device object itself. The
+ * first round also pays for starting the scheduler thread, so its memory figure is high.
+ *
+ * Usage: device_bench [devices] [run time in ms] [events per second per device]
+ */
+
+static int BenchOnEvent(LPVOID lpContext, int evt, int data)
+{
+	(void)evt;
+	(void)data;
+	((std::atomic<ULONGLONG>*)lpContext)->fetch_add(1, std::memory_order_relaxed);
+	return 0;
+}
+
+/*
+ * @brief 
+ * Resident set size of the process.
+ * @return LONGLONG bytes, 0 if it cannot be read.
+ */
+static LONGLONG BenchResidentBytes(void)
+{
+	long lPages = 0, lResident = 0;
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (file == NULL)
+		return 0;
+	if (fscanf(file, "%ld %ld", &lPages, &lResident) != 2)
+		lResident = 0;
+	fclose(file);
+	return (LONGLONG)lResident * sysconf(_SC_PAGESIZE);
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwDevices = BenchArgument(argc, argv, 1, 1000);
+	DWORD dwRunMs = BenchArgument(argc, argv, 2, 2000);
+	DWORD dwRate = BenchArgument(argc, argv, 3, 10);
+
+	char szRate[16];
+	snprintf(szRate, sizeof(szRate), "%u", dwRate);
+	g_xfs_manager.SetConfig("EventRate", szRate);
+
+	BOOL bDelivered = TRUE;
+	DWORD counts[3] = { dwDevices / 100, dwDevices / 10, dwDevices };
+	for (int i = 0; i < 3; i++)
+	{
+		DWORD dwCount = counts[i] ? counts[i] : 1;
+		std::atomic<ULONGLONG> ullEvents(0);
+
+		LONGLONG llResident = BenchResidentBytes();
+		std::vector<MockDevice*> devices;
+		for (DWORD d = 0; d < dwCount; d++)
+		{
+			devices.push_back(new MockDevice());
+			if (devices.back()->Open(BenchOnEvent, &ullEvents) != 0)
+				return 1;
+		}
+		LONGLONG llAdded = BenchResidentBytes() - llResident;
+
+		ullEvents = 0;
+		std::clock_t cpuStart = std::clock();
+		double dStart = BenchSeconds();
+		std::this_thread::sleep_for(std::chrono::milliseconds(dwRunMs));
+		double dCpu = (double)(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+		double dElapsed = BenchSeconds() - dStart;
+		ULONGLONG ullRaised = ullEvents.load();
+
+		for (DWORD d = 0; d < dwCount; d++)
+		{
+			devices[d]->Close();
+			delete devices[d];
+		}
+
+		// Every device raises dwRate events a second; allow for start-up and scheduling.
+		if (i == 2 && ullRaised < (ULONGLONG)(dwCount * dwRate * dElapsed / 2))
+			bDelivered = FALSE;
+
+		printf("device_bench: devices=%u events=%llu/s cpu=%.2f%% cpu/device=%.4f%% rss/device=%lldB sizeof=%uB\n",
+			dwCount, (unsigned long long)(ullRaised / dElapsed), dCpu / dElapsed * 100.0,
+			dCpu / dElapsed * 100.0 / dwCount, llAdded / (LONGLONG)dwCount, (DWORD)sizeof(MockDevice));
+	}
+
+	g_mock_scheduler.Stop();
+	return bDelivered ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <xfsalm.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "xfsmgr.h"
+#include "xfssp.h"
+#include "benchutil.h"
+
+/*
+ * Execute latency under bursts: a session submits bursts of WFS_CMD_ALM_RESET back to
+ * back and waits for the burst to complete before sending the next. The time from each
+ * WFPExecute call to its WFS_EXECUTE_COMPLETE is taken. Reports the median, 99th
+ * percentile and worst latency, and the time a burst takes to drain. The execute thread
+ * used to poll its queue once a second, which made each command of a burst wait up to
+ * that long.
+ *
+ * Usage: execute_bench [requests per burst] [bursts]
+ */
+
+#define BENCH_SPI_VERSIONS 0x00030203
+
+/*
+ * @brief 
+ * Issue and completion times of the requests of one burst, indexed by request
+ * identifier.
+ */
+struct BENCH_BURST {
+	std::vector<double> issued;
+	std::vector<double> completed;
+	std::atomic<DWORD> dwCompleted;
+	std::atomic<DWORD> dwFailures;
+};
+
+static LRESULT CALLBACK BenchWndProc(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+{
+	(void)wParam;
+	BENCH_BURST* burst = (BENCH_BURST*)g_xfs_manager.GetWindowData(hWnd);
+	LPWFSRESULT lpWFSResult = (LPWFSRESULT)lParam;
+	if (uMessage == WFS_EXECUTE_COMPLETE && lpWFSResult->RequestID < burst->completed.size())
+		burst->completed[lpWFSResult->RequestID] = BenchSeconds();
+	if (lpWFSResult->hResult != WFS_SUCCESS)
+		burst->dwFailures++;
+	WFMFreeBuffer(lpWFSResult);
+	burst->dwCompleted++;
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwBurst = BenchArgument(argc, argv, 1, 100);
+	DWORD dwBursts = BenchArgument(argc, argv, 2, 50);
+	if (dwBurst > WFS_LANE_DEFAULT_DEPTH)
+		dwBurst = WFS_LANE_DEFAULT_DEPTH;
+
+	// Request identifier 0 is the open and the close; the burst uses 1..dwBurst.
+	BENCH_BURST burst;
+	burst.issued.resize(dwBurst + 1);
+	burst.completed.resize(dwBurst + 1);
+	burst.dwCompleted = 0;
+	burst.dwFailures = 0;
+	HWND hWnd = g_xfs_manager.CreateWindowObject(BenchWndProc, &burst);
+
+	WFSVERSION spiVersion, srvcVersion;
+	if (WFPOpen(1, (LPSTR)"ALM1", NULL, NULL, 0, 0, hWnd, 0, NULL,
+		BENCH_SPI_VERSIONS, &spiVersion, BENCH_SPI_VERSIONS, &srvcVersion) != WFS_SUCCESS)
+		return 1;
+	while (burst.dwCompleted.load() < 1)
+		std::this_thread::yield();
+
+	std::vector<double> latencies;
+	std::vector<double> drains;
+	for (DWORD b = 0; b < dwBursts; b++)
+	{
+		DWORD dwBefore = burst.dwCompleted.load();
+		double dStart = BenchSeconds();
+		for (REQUESTID i = 1; i <= dwBurst; i++)
+		{
+			burst.issued[i] = BenchSeconds();
+			if (WFPExecute(1, WFS_CMD_ALM_RESET, NULL, 0, hWnd, i) != WFS_SUCCESS)
+			{
+				burst.dwFailures++;
+				burst.dwCompleted++;
+				burst.completed[i] = burst.issued[i];
+			}
+		}
+		while (burst.dwCompleted.load() < dwBefore + dwBurst)
+			std::this_thread::yield();
+		drains.push_back((BenchSeconds() - dStart) * 1000.0);
+
+		for (REQUESTID i = 1; i <= dwBurst; i++)
+			latencies.push_back((burst.completed[i] - burst.issued[i]) * 1000000.0);
+	}
+
+	DWORD dwBefore = burst.dwCompleted.load();
+	WFPClose(1, hWnd, 0);
+	while (burst.dwCompleted.load() < dwBefore + 1)
+		std::this_thread::yield();
+	WFPUnloadService();
+	g_xfs_manager.DestroyWindowObject(hWnd);
+
+	std::sort(latencies.begin(), latencies.end());
+	std::sort(drains.begin(), drains.end());
+	printf("execute_bench: burst=%u bursts=%u p50=%.1fus p99=%.1fus max=%.1fus drain p50=%.3fms max=%.3fms failures=%u\n",
+		dwBurst, dwBursts, latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100],
+		latencies.back(), drains[drains.size() / 2], drains.back(), burst.dwFailures.load());
+	return burst.dwFailures.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "xfsmgr.h"
+#include "eventdispatcher.h"
+#include "benchutil.h"
+
+/*
+ * Event fan-out: for 1, 2, 5, 10, 20, 50 and 100 subscribers, up to the given maximum,
+ * every event is published to all subscribers and to the given number of stalled ones,
+ * whose procedure does not return until the round ends. The time until the last healthy
+ * subscriber has processed the event is taken. Reports the median and worst fan-out
+ * latency per subscriber count; without the send timeout a stalled window keeps its
+ * delivery thread for good, so as many stalled windows as delivery threads stop every
+ * delivery.
+ *
+ * Usage: fanout_bench [max subscribers] [events per round] [stalled subscribers] [send timeout in ms]
+ */
+
+static std::atomic<ULONGLONG> g_received(0);
+static std::atomic<bool> g_released(false);
+
+static LRESULT CALLBACK BenchWndProc(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+{
+	(void)uMessage;
+	(void)wParam;
+	WFMFreeBuffer((LPWFSRESULT)lParam);
+
+	// A stalled window waits for the flag it was created with.
+	std::atomic<bool>* lpbReleased = (std::atomic<bool>*)g_xfs_manager.GetWindowData(hWnd);
+	if (lpbReleased != NULL)
+	{
+		while (!lpbReleased->load())
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return 0;
+	}
+	g_received++;
+	return 0;
+}
+
+/*
+ * @brief 
+ * Publishes the events of one round to healthy and stalled subscribers.
+ * @param dwSubscribers - Number of healthy subscribers.
+ * @param dwEvents - Number of events.
+ * @param dwStalled - Number of stalled subscribers.
+ * @param dwSendTimeout - Send timeout of the dispatcher.
+ * @param lpdMedian - Receives the median fan-out latency in milliseconds.
+ * @param lpdWorst - Receives the worst fan-out latency in milliseconds.
+ * @return BOOL TRUE if every healthy subscriber got every event.
+ */
+static BOOL BenchRound(DWORD dwSubscribers, DWORD dwEvents, DWORD dwStalled, DWORD dwSendTimeout,
+	double* lpdMedian, double* lpdWorst)
+{
+	*lpdMedian = 0;
+	*lpdWorst = 0;
+	if (g_event_dispatcher.Start(EVENT_DEFAULT_THREADS, EVENT_DEFAULT_DEPTH, EVENT_POLICY_DROP_OLDEST, dwSendTimeout) != 0)
+		return FALSE;
+
+	// The stalled windows come first, so each event reaches them first.
+	std::vector<HWND> windows;
+	for (DWORD s = 0; s < dwStalled + dwSubscribers; s++)
+	{
+		HWND hWnd = g_xfs_manager.CreateWindowObject(BenchWndProc, s < dwStalled ? &g_released : NULL);
+		windows.push_back(hWnd);
+		g_event_dispatcher.Add(hWnd);
+	}
+
+	g_received = 0;
+	g_released = false;
+	BOOL bSucceeded = TRUE;
+	std::vector<double> latencies;
+	for (DWORD e = 0; e < dwEvents; e++)
+	{
+		double dStart = BenchSeconds();
+		for (size_t s = 0; s < windows.size(); s++)
+			g_event_dispatcher.Publish(windows[s], 1, WFS_SERVICE_EVENT, 1, e);
+
+		ULONGLONG ullExpected = (ULONGLONG)dwSubscribers * (e + 1);
+		while (g_received.load() < ullExpected && BenchSeconds() - dStart < 10.0)
+			std::this_thread::yield();
+		if (g_received.load() < ullExpected)
+		{
+			bSucceeded = FALSE;
+			break;
+		}
+		latencies.push_back((BenchSeconds() - dStart) * 1000.0);
+	}
+
+	g_released = true;
+	g_event_dispatcher.Stop();
+	for (size_t s = 0; s < windows.size(); s++)
+		g_xfs_manager.DestroyWindowObject(windows[s]);
+
+	if (!latencies.empty())
+	{
+		std::sort(latencies.begin(), latencies.end());
+		*lpdMedian = latencies[latencies.size() / 2];
+		*lpdWorst = latencies.back();
+	}
+	return bSucceeded;
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwMaxSubscribers = BenchArgument(argc, argv, 1, 100);
+	DWORD dwEvents = BenchArgument(argc, argv, 2, 200);
+	DWORD dwStalled = BenchArgument(argc, argv, 3, 1);
+	DWORD dwSendTimeout = BenchArgument(argc, argv, 4, EVENT_DEFAULT_SEND_TIMEOUT);
+
+	const DWORD counts[] = { 1, 2, 5, 10, 20, 50, 100 };
+	BOOL bSucceeded = TRUE;
+	for (DWORD i = 0; i < sizeof(counts) / sizeof(counts[0]) && counts[i] <= dwMaxSubscribers; i++)
+	{
+		double dMedian, dWorst;
+		if (!BenchRound(counts[i], dwEvents, dwStalled, dwSendTimeout, &dMedian, &dWorst))
+			bSucceeded = FALSE;
+		printf("fanout_bench: subscribers=%u stalled=%u timeout=%ums p50=%.3fms max=%.3fms%s\n",
+			counts[i], dwStalled, dwSendTimeout, dMedian, dWorst, bSucceeded ? "" : " (events lost)");
+	}
+	return bSucceeded ? 0 : 1;
+}
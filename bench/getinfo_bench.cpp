@@ -0,0 +1,159 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <xfsalm.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "xfsmgr.h"
+#include "xfssp.h"
+#include "benchutil.h"
+
+/*
+ * GetInfo latency: every session keeps one GetInfo outstanding at a time and takes the
+ * time from the call until its completion has been delivered, first with the answers
+ * served inline from memory, then with InlineGetInfo set to 0 so that every request
+ * takes the asynchronous path through a worker thread. Reports the median, 99th
+ * percentile and worst latency of each path for status and capabilities.
+ *
+ * Usage: getinfo_bench [sessions] [requests per session]
+ */
+
+#define BENCH_SPI_VERSIONS 0x00030203
+
+static std::atomic<ULONGLONG> g_completions(0);
+static std::atomic<ULONGLONG> g_failures(0);
+
+static LRESULT CALLBACK BenchWndProc(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+{
+	(void)uMessage;
+	(void)wParam;
+	LPWFSRESULT lpWFSResult = (LPWFSRESULT)lParam;
+	if (lpWFSResult->hResult != WFS_SUCCESS)
+		g_failures++;
+	WFMFreeBuffer(lpWFSResult);
+	((std::atomic<ULONGLONG>*)g_xfs_manager.GetWindowData(hWnd))->fetch_add(1);
+	g_completions++;
+	return 0;
+}
+
+static void BenchWait(ULONGLONG ullCompletions)
+{
+	while (g_completions.load() < ullCompletions)
+		std::this_thread::yield();
+}
+
+/*
+ * @brief 
+ * Opens the sessions, runs the requests of one category on every session and closes
+ * the sessions again.
+ * @param dwSessions - Number of sessions.
+ * @param dwRequests - Requests per session.
+ * @param dwCategory - The GetInfo category.
+ * @param latencies - Receives the latency of every request in microseconds.
+ * @return BOOL TRUE if every session opened.
+ */
+static BOOL BenchRun(DWORD dwSessions, DWORD dwRequests, DWORD dwCategory, std::vector<double>& latencies)
+{
+	std::vector<std::atomic<ULONGLONG>> answers(dwSessions);
+	std::vector<HWND> windows;
+	ULONGLONG ullStart = g_completions.load();
+	for (DWORD s = 0; s < dwSessions; s++)
+	{
+		answers[s] = 0;
+		HWND hWnd = g_xfs_manager.CreateWindowObject(BenchWndProc, &answers[s]);
+		windows.push_back(hWnd);
+
+		WFSVERSION spiVersion, srvcVersion;
+		if (WFPOpen(s + 1, (LPSTR)"ALM1", NULL, NULL, 0, 0, hWnd, 1, NULL,
+			BENCH_SPI_VERSIONS, &spiVersion, BENCH_SPI_VERSIONS, &srvcVersion) != WFS_SUCCESS)
+			return FALSE;
+	}
+	BenchWait(ullStart + dwSessions);
+
+	std::vector<std::vector<double>> samples(dwSessions);
+	std::vector<std::thread> threads;
+	for (DWORD s = 0; s < dwSessions; s++)
+	{
+		threads.push_back(std::thread([&, s]() {
+			for (DWORD i = 0; i < dwRequests; i++)
+			{
+				ULONGLONG ullBefore = answers[s].load();
+				double dIssued = BenchSeconds();
+				if (WFPGetInfo(s + 1, dwCategory, NULL, 0, windows[s], i + 2) != WFS_SUCCESS)
+				{
+					g_failures++;
+					continue;
+				}
+				while (answers[s].load() == ullBefore)
+					std::this_thread::yield();
+				samples[s].push_back((BenchSeconds() - dIssued) * 1000000.0);
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	for (DWORD s = 0; s < dwSessions; s++)
+		latencies.insert(latencies.end(), samples[s].begin(), samples[s].end());
+
+	ULONGLONG ullCompletions = g_completions.load();
+	for (DWORD s = 0; s < dwSessions; s++)
+		WFPClose(s + 1, windows[s], 1);
+	BenchWait(ullCompletions + dwSessions);
+	for (DWORD s = 0; s < dwSessions; s++)
+		g_xfs_manager.DestroyWindowObject(windows[s]);
+	return TRUE;
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwSessions = BenchArgument(argc, argv, 1, 4);
+	DWORD dwRequests = BenchArgument(argc, argv, 2, 20000);
+
+	const char* modes[] = { "1", "0" };
+	const char* paths[] = { "inline", "async" };
+	const DWORD categories[] = { WFS_INF_ALM_STATUS, WFS_INF_ALM_CAPABILITIES };
+	const char* names[] = { "status", "capabilities" };
+
+	BOOL bSucceeded = TRUE;
+	for (int m = 0; m < 2; m++)
+	{
+		// The setting is read once per load of the SP.
+		g_xfs_manager.SetConfig("InlineGetInfo", modes[m]);
+		for (int c = 0; c < 2; c++)
+		{
+			std::vector<double> latencies;
+			if (!BenchRun(dwSessions, dwRequests, categories[c], latencies) || latencies.empty())
+			{
+				bSucceeded = FALSE;
+				continue;
+			}
+			std::sort(latencies.begin(), latencies.end());
+			printf("getinfo_bench: %-6s %-12s sessions=%u requests=%u p50=%.1fus p99=%.1fus max=%.1fus\n",
+				paths[m], names[c], dwSessions, (DWORD)latencies.size(), latencies[latencies.size() / 2],
+				latencies[latencies.size() * 99 / 100], latencies.back());
+		}
+		WFPUnloadService();
+	}
+	g_xfs_manager.SetConfig("InlineGetInfo", "1");
+
+	printf("getinfo_bench: failures=%llu\n", g_failures.load());
+	return bSucceeded && g_failures.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "xfssp.h"
+#include "executelane.h"
+#include "sync.h"
+#include "benchutil.h"
+
+/*
+ * Push throughput of the execute lane with several producers and one consumer, the way
+ * application threads feed the lane of a shared session, for 1, 4 and 16 producers up
+ * to the given maximum. Each count is also run against the queue the lane replaced, a
+ * std::deque behind a mutex, bounded to the same depth.
+ *
+ * Usage: lane_bench [max producers] [pushes per producer] [lane depth]
+ */
+
+/*
+ * @brief 
+ * Pushes from every producer into the lane and pops on the calling thread.
+ * @param dwProducers - Number of producer threads.
+ * @param dwPushes - Pushes per producer.
+ * @param dwDepth - Lane depth.
+ * @param lpullFull - Receives the number of pushes that found the lane full.
+ * @return double the seconds taken, a negative value on failure.
+ */
+static double BenchLane(DWORD dwProducers, DWORD dwPushes, DWORD dwDepth, ULONGLONG* lpullFull)
+{
+	WFS_LANE* lane = LaneCreate(NULL, dwDepth);
+	if (lane == NULL)
+		return -1;
+
+	// One result block per producer: the lane only carries the pointer.
+	std::vector<WFSRESULT> results(dwProducers);
+	memset(&results[0], 0, results.size() * sizeof(WFSRESULT));
+	std::atomic<ULONGLONG> ullFull(0);
+
+	double dStart = BenchSeconds();
+	std::vector<std::thread> threads;
+	for (DWORD p = 0; p < dwProducers; p++)
+	{
+		threads.push_back(std::thread([&, p]() {
+			for (DWORD i = 0; i < dwPushes; i++)
+			{
+				results[p].RequestID = i + 1;
+				while (!LaneTryPush(lane, NULL, &results[p], 0, WFS_INDEFINITE_WAIT, NULL))
+				{
+					ullFull++;
+					std::this_thread::yield();
+				}
+			}
+		}));
+	}
+
+	ULONGLONG ullTotal = (ULONGLONG)dwProducers * dwPushes;
+	for (ULONGLONG ullPopped = 0; ullPopped < ullTotal;)
+	{
+		WFS_MSG* msg = LanePeek(lane);
+		if (msg == NULL)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		LaneBegin(lane, msg);
+		LanePop(lane);
+		ullPopped++;
+	}
+	double dSeconds = BenchSeconds() - dStart;
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	LaneDestroy(lane);
+
+	*lpullFull = ullFull.load();
+	return dSeconds;
+}
+
+/*
+ * @brief 
+ * The same exchange through a bounded std::deque of allocated requests behind a mutex,
+ * as WFPExecute and the execute thread used before the lane.
+ * @param dwProducers - Number of producer threads.
+ * @param dwPushes - Pushes per producer.
+ * @param dwDepth - Queue bound.
+ * @param lpullFull - Receives the number of pushes that found the queue full.
+ * @return double the seconds taken.
+ */
+static double BenchDeque(DWORD dwProducers, DWORD dwPushes, DWORD dwDepth, ULONGLONG* lpullFull)
+{
+	SpMutex mutex("lane_bench");
+	std::deque<WFSRESULT*> queue;
+	std::atomic<ULONGLONG> ullFull(0);
+
+	double dStart = BenchSeconds();
+	std::vector<std::thread> threads;
+	for (DWORD p = 0; p < dwProducers; p++)
+	{
+		threads.push_back(std::thread([&]() {
+			for (DWORD i = 0; i < dwPushes; i++)
+			{
+				WFSRESULT* result = new WFSRESULT();
+				result->RequestID = i + 1;
+				while (true)
+				{
+					{
+						std::lock_guard<SpMutex> lock(mutex);
+						if (queue.size() < dwDepth)
+						{
+							queue.push_back(result);
+							break;
+						}
+					}
+					ullFull++;
+					std::this_thread::yield();
+				}
+			}
+		}));
+	}
+
+	ULONGLONG ullTotal = (ULONGLONG)dwProducers * dwPushes;
+	for (ULONGLONG ullPopped = 0; ullPopped < ullTotal;)
+	{
+		WFSRESULT* result = NULL;
+		{
+			std::lock_guard<SpMutex> lock(mutex);
+			if (!queue.empty())
+			{
+				result = queue.front();
+				queue.pop_front();
+			}
+		}
+		if (result == NULL)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		delete result;
+		ullPopped++;
+	}
+	double dSeconds = BenchSeconds() - dStart;
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	*lpullFull = ullFull.load();
+	return dSeconds;
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwMaxProducers = BenchArgument(argc, argv, 1, 16);
+	DWORD dwPushes = BenchArgument(argc, argv, 2, 1000000);
+	DWORD dwDepth = BenchArgument(argc, argv, 3, WFS_LANE_DEFAULT_DEPTH);
+
+	const DWORD counts[] = { 1, 4, 16 };
+	const char* queues[] = { "lane", "deque" };
+	for (DWORD i = 0; i < sizeof(counts) / sizeof(counts[0]) && counts[i] <= dwMaxProducers; i++)
+	{
+		for (int q = 0; q < 2; q++)
+		{
+			ULONGLONG ullFull = 0;
+			double dSeconds = q == 0 ?
+				BenchLane(counts[i], dwPushes, dwDepth, &ullFull) :
+				BenchDeque(counts[i], dwPushes, dwDepth, &ullFull);
+			if (dSeconds < 0)
+				return 1;
+
+			ULONGLONG ullTotal = (ULONGLONG)counts[i] * dwPushes;
+			printf("lane_bench: %-5s producers=%u pushes=%llu depth=%u seconds=%.3f pushes/s=%.0f ns/push=%.1f full=%llu\n",
+				queues[q], counts[i], ullTotal, dwDepth, dSeconds, ullTotal / dSeconds, dSeconds * 1e9 / ullTotal,
+				ullFull);
+		}
+	}
+	return 0;
+}
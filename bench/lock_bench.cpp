@@ -0,0 +1,177 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "xfsmgr.h"
+#include "xfssp.h"
+#include "benchutil.h"
+
+/*
+ * Lock contention: every session runs on a thread of its own and repeatedly locks the
+ * service, holds the lock for the given time and unlocks it. The time from WFPLock to
+ * its completion is taken. Reports the median, 99th percentile and worst acquire
+ * latency, and how evenly the waiting was shared: Jain's index over the mean wait of
+ * each session, 1.0 when every session waited as long as the others, and the ratio of
+ * the longest to the shortest mean wait.
+ *
+ * Usage: lock_bench [sessions] [locks per session] [hold time in us]
+ */
+
+#define BENCH_SPI_VERSIONS 0x00030203
+
+/*
+ * @brief 
+ * One session: its completions and when its last lock was granted.
+ */
+struct BENCH_SESSION {
+	std::atomic<ULONGLONG> ullCompletions;
+	std::atomic<double> dGranted;
+	std::atomic<DWORD> dwFailures;
+};
+
+static LRESULT CALLBACK BenchWndProc(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+{
+	(void)wParam;
+	BENCH_SESSION* session = (BENCH_SESSION*)g_xfs_manager.GetWindowData(hWnd);
+	LPWFSRESULT lpWFSResult = (LPWFSRESULT)lParam;
+	if (uMessage == WFS_LOCK_COMPLETE)
+		session->dGranted.store(BenchSeconds());
+	if (lpWFSResult->hResult != WFS_SUCCESS)
+		session->dwFailures++;
+	WFMFreeBuffer(lpWFSResult);
+	session->ullCompletions++;
+	return 0;
+}
+
+/*
+ * @brief 
+ * Counts a request the SP refused as a failure.
+ */
+static BOOL BenchCall(BENCH_SESSION* session, HRESULT hResult)
+{
+	if (hResult != WFS_SUCCESS)
+	{
+		session->dwFailures++;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void BenchWait(BENCH_SESSION* session, ULONGLONG ullCompletions)
+{
+	while (session->ullCompletions.load() < ullCompletions)
+		std::this_thread::yield();
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwSessions = BenchArgument(argc, argv, 1, 16);
+	DWORD dwLocks = BenchArgument(argc, argv, 2, 200);
+	DWORD dwHoldUs = BenchArgument(argc, argv, 3, 100);
+
+	std::vector<BENCH_SESSION> sessions(dwSessions);
+	std::vector<HWND> windows;
+	for (DWORD s = 0; s < dwSessions; s++)
+	{
+		sessions[s].ullCompletions = 0;
+		sessions[s].dGranted = 0;
+		sessions[s].dwFailures = 0;
+		HWND hWnd = g_xfs_manager.CreateWindowObject(BenchWndProc, &sessions[s]);
+		windows.push_back(hWnd);
+
+		WFSVERSION spiVersion, srvcVersion;
+		if (WFPOpen(s + 1, (LPSTR)"ALM1", NULL, NULL, 0, 0, hWnd, 1, NULL,
+			BENCH_SPI_VERSIONS, &spiVersion, BENCH_SPI_VERSIONS, &srvcVersion) != WFS_SUCCESS)
+			return 1;
+		BenchWait(&sessions[s], 1);
+	}
+
+	std::vector<std::vector<double> > waits(dwSessions);
+	std::atomic<DWORD> dwReady(0);
+	std::vector<std::thread> threads;
+	for (DWORD s = 0; s < dwSessions; s++)
+	{
+		threads.push_back(std::thread([&, s]() {
+			BENCH_SESSION* session = &sessions[s];
+			dwReady++;
+			while (dwReady.load() < dwSessions)
+				std::this_thread::yield();
+
+			for (DWORD i = 0; i < dwLocks; i++)
+			{
+				ULONGLONG ullCompletions = session->ullCompletions.load();
+				double dIssued = BenchSeconds();
+				if (!BenchCall(session, WFPLock(s + 1, WFS_INDEFINITE_WAIT, windows[s], 2 * i + 2)))
+					break;
+				BenchWait(session, ullCompletions + 1);
+				waits[s].push_back((session->dGranted.load() - dIssued) * 1000000.0);
+
+				double dHold = BenchSeconds();
+				while ((BenchSeconds() - dHold) * 1000000.0 < dwHoldUs)
+					std::this_thread::yield();
+
+				if (!BenchCall(session, WFPUnlock(s + 1, windows[s], 2 * i + 3)))
+					break;
+				BenchWait(session, ullCompletions + 2);
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	DWORD dwFailures = 0;
+	std::vector<double> latencies;
+	double dSum = 0, dSquares = 0, dLongest = 0, dShortest = 0;
+	for (DWORD s = 0; s < dwSessions; s++)
+	{
+		dwFailures += sessions[s].dwFailures.load();
+		double dMean = 0;
+		for (size_t i = 0; i < waits[s].size(); i++)
+			dMean += waits[s][i];
+		dMean = waits[s].empty() ? 0 : dMean / waits[s].size();
+		dSum += dMean;
+		dSquares += dMean * dMean;
+		dLongest = s == 0 ? dMean : std::max(dLongest, dMean);
+		dShortest = s == 0 ? dMean : std::min(dShortest, dMean);
+		latencies.insert(latencies.end(), waits[s].begin(), waits[s].end());
+	}
+
+	for (DWORD s = 0; s < dwSessions; s++)
+	{
+		ULONGLONG ullCompletions = sessions[s].ullCompletions.load();
+		WFPClose(s + 1, windows[s], 1);
+		BenchWait(&sessions[s], ullCompletions + 1);
+	}
+	WFPUnloadService();
+	for (DWORD s = 0; s < dwSessions; s++)
+		g_xfs_manager.DestroyWindowObject(windows[s]);
+
+	if (latencies.empty())
+		return 1;
+	std::sort(latencies.begin(), latencies.end());
+	printf("lock_bench: sessions=%u locks=%u hold=%uus p50=%.1fus p99=%.1fus max=%.1fus fairness=%.3f longest/shortest=%.2f failures=%u\n",
+		dwSessions, (DWORD)latencies.size(), dwHoldUs, latencies[latencies.size() / 2],
+		latencies[latencies.size() * 99 / 100], latencies.back(),
+		dSquares > 0 ? dSum * dSum / (dwSessions * dSquares) : 1.0,
+		dShortest > 0 ? dLongest / dShortest : 0.0, dwFailures);
+	return dwFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "sync.h"
+#include "benchutil.h"
+
+/*
+ * Cost of the SpMutex lock statistics. Times lock/unlock pairs of std::mutex, of
+ * SpMutex with statistics disabled and of SpMutex with them enabled, first on one
+ * thread, where no acquire is contended, then with several threads sharing the lock.
+ * Reports nanoseconds per pair; the disabled SpMutex should match std::mutex.
+ *
+ * Usage: mutex_bench [threads] [pairs per thread]
+ */
+
+/*
+ * @brief 
+ * Times lock/unlock pairs of one mutex, every thread starting at once.
+ * @param mutex - The mutex.
+ * @param dwThreads - Number of threads.
+ * @param dwPairs - Pairs per thread.
+ * @return double nanoseconds per pair, over every thread.
+ */
+template <typename MUTEX>
+static double BenchPairs(MUTEX& mutex, DWORD dwThreads, DWORD dwPairs)
+{
+	static volatile ULONGLONG ullShared;
+	std::atomic<DWORD> dwReady(0);
+	std::vector<std::thread> threads;
+	for (DWORD t = 0; t < dwThreads; t++)
+	{
+		threads.push_back(std::thread([&]() {
+			dwReady++;
+			while (dwReady.load() < dwThreads + 1)
+				std::this_thread::yield();
+			for (DWORD i = 0; i < dwPairs; i++)
+			{
+				std::lock_guard<MUTEX> lock(mutex);
+				ullShared = ullShared + 1;
+			}
+		}));
+	}
+	while (dwReady.load() < dwThreads)
+		std::this_thread::yield();
+	double dStart = BenchSeconds();
+	dwReady++;
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	return (BenchSeconds() - dStart) * 1e9 / ((double)dwThreads * dwPairs);
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwThreads = BenchArgument(argc, argv, 1, 8);
+	DWORD dwPairs = BenchArgument(argc, argv, 2, 2000000);
+
+	std::mutex baseline;
+	SpMutex mutex("mutex_bench");
+	DWORD counts[2] = { 1, dwThreads };
+	for (int i = 0; i < 2; i++)
+	{
+		double dStd = BenchPairs(baseline, counts[i], dwPairs);
+		SpLockStatsEnable(FALSE);
+		double dDisabled = BenchPairs(mutex, counts[i], dwPairs);
+		SpLockStatsEnable(TRUE);
+		double dEnabled = BenchPairs(mutex, counts[i], dwPairs);
+		SpLockStatsEnable(FALSE);
+		printf("mutex_bench: threads=%u pairs=%u std=%.1fns disabled=%.1fns enabled=%.1fns\n",
+			counts[i], counts[i] * dwPairs, dStd, dDisabled, dEnabled);
+	}
+
+	std::vector<SP_LOCK_STATS> stats;
+	SpLockStatsQuery(stats);
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		if (strcmp(stats[i].szName, "mutex_bench") == 0)
+			return stats[i].ullAcquires == (ULONGLONG)(1 + dwThreads) * dwPairs ? 0 : 1;
+	}
+	return 1;
+}
@@ -0,0 +1,154 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <windows.h>
+#include <xfsspi.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "xfsmgr.h"
+#include "xfssp.h"
+#include "benchutil.h"
+
+/*
+ * Open latency: for 1, 2, 5, 10, 20, 50 and 100 sessions, up to the given maximum,
+ * every session calls WFPOpen at the same moment on a device that is closed, and the
+ * time until its open completes is taken. The device comes up after the given start-up
+ * time. Reports the median and worst latency per session count.
+ *
+ * Usage: open_bench [max sessions] [device start-up time in ms]
+ */
+
+#define BENCH_SPI_VERSIONS 0x00030203
+
+/*
+ * @brief 
+ * One session of a round: when its open was issued and when it completed.
+ */
+struct BENCH_SESSION {
+	double dIssued;
+	std::atomic<double> dCompleted;
+	std::atomic<LONG> lResult;
+};
+
+static LRESULT CALLBACK BenchWndProc(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+{
+	(void)wParam;
+	LPWFSRESULT lpWFSResult = (LPWFSRESULT)lParam;
+	BENCH_SESSION* session = (BENCH_SESSION*)g_xfs_manager.GetWindowData(hWnd);
+	if (uMessage == WFS_OPEN_COMPLETE)
+	{
+		session->lResult.store(lpWFSResult->hResult);
+		session->dCompleted.store(BenchSeconds());
+	}
+	WFMFreeBuffer(lpWFSResult);
+	return 0;
+}
+
+/*
+ * @brief 
+ * Opens a number of sessions at once on a closed device and closes them again.
+ * @param dwSessions - Number of sessions.
+ * @param dwRound - Round number, selects a logical name of its own.
+ * @param lpdMedian - Receives the median open latency in milliseconds.
+ * @param lpdWorst - Receives the worst open latency in milliseconds.
+ * @return BOOL TRUE if every open succeeded.
+ */
+static BOOL BenchRound(DWORD dwSessions, DWORD dwRound, double* lpdMedian, double* lpdWorst)
+{
+	char szName[16];
+	snprintf(szName, sizeof(szName), "OPEN%u", dwRound);
+
+	std::vector<BENCH_SESSION> sessions(dwSessions);
+	std::vector<HWND> windows;
+	for (DWORD s = 0; s < dwSessions; s++)
+	{
+		sessions[s].dCompleted.store(0);
+		sessions[s].lResult.store(WFS_SUCCESS);
+		windows.push_back(g_xfs_manager.CreateWindowObject(BenchWndProc, &sessions[s]));
+	}
+
+	std::atomic<DWORD> dwReady(0);
+	std::vector<std::thread> threads;
+	for (DWORD s = 0; s < dwSessions; s++)
+	{
+		threads.push_back(std::thread([&, s]() {
+			dwReady++;
+			while (dwReady.load() < dwSessions)
+				std::this_thread::yield();
+
+			WFSVERSION spiVersion, srvcVersion;
+			sessions[s].dIssued = BenchSeconds();
+			HRESULT hResult = WFPOpen(s + 1, szName, NULL, NULL, 0, 0, windows[s], 1, NULL,
+				BENCH_SPI_VERSIONS, &spiVersion, BENCH_SPI_VERSIONS, &srvcVersion);
+			if (hResult != WFS_SUCCESS)
+			{
+				sessions[s].lResult.store(hResult);
+				sessions[s].dCompleted.store(BenchSeconds());
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	BOOL bSucceeded = TRUE;
+	std::vector<double> latencies;
+	for (DWORD s = 0; s < dwSessions; s++)
+	{
+		while (sessions[s].dCompleted.load() == 0)
+			std::this_thread::yield();
+		latencies.push_back((sessions[s].dCompleted.load() - sessions[s].dIssued) * 1000.0);
+		if (sessions[s].lResult.load() != WFS_SUCCESS)
+			bSucceeded = FALSE;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	*lpdMedian = latencies[latencies.size() / 2];
+	*lpdWorst = latencies.back();
+
+	for (DWORD s = 0; s < dwSessions; s++)
+		WFPClose(s + 1, windows[s], 2);
+	WFS_DEVICE_COUNTERS counters;
+	while (WFPQueryDeviceCounters(szName, &counters) && counters.dwCloses == 0)
+		std::this_thread::yield();
+	for (DWORD s = 0; s < dwSessions; s++)
+		g_xfs_manager.DestroyWindowObject(windows[s]);
+	return bSucceeded;
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwMaxSessions = BenchArgument(argc, argv, 1, 100);
+	DWORD dwReadyDelay = BenchArgument(argc, argv, 2, 20);
+
+	char szReadyDelay[16];
+	snprintf(szReadyDelay, sizeof(szReadyDelay), "%u", dwReadyDelay);
+	g_xfs_manager.SetConfig("DeviceReadyDelay", szReadyDelay);
+
+	const DWORD counts[] = { 1, 2, 5, 10, 20, 50, 100 };
+	BOOL bSucceeded = TRUE;
+	for (DWORD i = 0; i < sizeof(counts) / sizeof(counts[0]) && counts[i] <= dwMaxSessions; i++)
+	{
+		double dMedian, dWorst;
+		if (!BenchRound(counts[i], i, &dMedian, &dWorst))
+			bSucceeded = FALSE;
+		printf("open_bench: sessions=%u startup=%ums p50=%.2fms max=%.2fms\n",
+			counts[i], dwReadyDelay, dMedian, dWorst);
+	}
+
+	WFPUnloadService();
+	return bSucceeded ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "workerpool.h"
+#include "benchutil.h"
+
+/*
+ * Cost of running asynchronous requests on the shared worker pool against starting a
+ * thread per request, as the WFP* entry points did before the pool. Every submitter
+ * keeps one request outstanding and takes the time from the submission until the
+ * routine has run. Reports the median and 99th percentile latency, the threads started
+ * and the most threads alive at once; on Win32 every thread started per request was
+ * also a handle that was never closed.
+ *
+ * Usage: pool_bench [requests per submitter] [submitters]
+ */
+
+struct BENCH_REQUEST {
+	double dIssued;
+	double dLatency;
+	std::atomic<bool> bDone;
+};
+
+static std::atomic<LONG> g_lAlive(0);
+static std::atomic<LONG> g_lPeak(0);
+
+static DWORD WINAPI BenchRoutine(LPVOID lpParam)
+{
+	BENCH_REQUEST* request = (BENCH_REQUEST*)lpParam;
+	request->dLatency = (BenchSeconds() - request->dIssued) * 1000000.0;
+	request->bDone.store(true);
+	return 0;
+}
+
+static void BenchThreadRoutine(BENCH_REQUEST* request)
+{
+	LONG lAlive = ++g_lAlive;
+	LONG lPeak = g_lPeak.load();
+	while (lAlive > lPeak && !g_lPeak.compare_exchange_weak(lPeak, lAlive))
+		;
+	BenchRoutine(request);
+	g_lAlive--;
+}
+
+/*
+ * @brief 
+ * Runs the requests of every submitter on the pool or on a thread each.
+ * @param bPool - TRUE to submit to the worker pool.
+ * @param dwRequests - Requests per submitter.
+ * @param dwSubmitters - Number of submitting threads.
+ * @param latencies - Receives the latency of every request in microseconds.
+ * @return ULONGLONG the number of threads started.
+ */
+static ULONGLONG BenchRun(BOOL bPool, DWORD dwRequests, DWORD dwSubmitters, std::vector<double>& latencies)
+{
+	WorkerPool pool;
+	if (bPool && pool.Start(WORKER_POOL_DEFAULT_THREADS) != 0)
+		return 0;
+
+	std::atomic<ULONGLONG> ullStarted(bPool ? WORKER_POOL_DEFAULT_THREADS : 0);
+	std::vector<std::vector<double> > samples(dwSubmitters);
+	std::vector<std::thread> submitters;
+	for (DWORD s = 0; s < dwSubmitters; s++)
+	{
+		submitters.push_back(std::thread([&, s]() {
+			BENCH_REQUEST request;
+			for (DWORD i = 0; i < dwRequests; i++)
+			{
+				request.bDone.store(false);
+				request.dIssued = BenchSeconds();
+				if (bPool)
+				{
+					if (pool.Submit(BenchRoutine, &request) != 0)
+						continue;
+				}
+				else
+				{
+					std::thread(BenchThreadRoutine, &request).detach();
+					ullStarted++;
+				}
+				while (!request.bDone.load())
+					std::this_thread::yield();
+				samples[s].push_back(request.dLatency);
+			}
+			// A thread started per request may still be on its way out.
+			while (g_lAlive.load() != 0)
+				std::this_thread::yield();
+		}));
+	}
+	for (size_t i = 0; i < submitters.size(); i++)
+		submitters[i].join();
+	pool.Stop();
+
+	for (DWORD s = 0; s < dwSubmitters; s++)
+		latencies.insert(latencies.end(), samples[s].begin(), samples[s].end());
+	return ullStarted.load();
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwRequests = BenchArgument(argc, argv, 1, 10000);
+	DWORD dwSubmitters = BenchArgument(argc, argv, 2, 4);
+
+	const char* modes[] = { "thread", "pool" };
+	BOOL bSucceeded = TRUE;
+	for (int m = 0; m < 2; m++)
+	{
+		std::vector<double> latencies;
+		g_lPeak = m == 1 ? WORKER_POOL_DEFAULT_THREADS : 0;
+		ULONGLONG ullStarted = BenchRun(m == 1, dwRequests, dwSubmitters, latencies);
+		if (latencies.size() != (size_t)dwRequests * dwSubmitters)
+		{
+			bSucceeded = FALSE;
+			continue;
+		}
+		std::sort(latencies.begin(), latencies.end());
+		printf("pool_bench: %-6s submitters=%u requests=%u p50=%.1fus p99=%.1fus threads=%llu peak=%d\n",
+			modes[m], dwSubmitters, (DWORD)latencies.size(), latencies[latencies.size() / 2],
+			latencies[latencies.size() * 99 / 100], ullStarted, (int)g_lPeak.load());
+	}
+	return bSucceeded ? 0 : 1;
+}
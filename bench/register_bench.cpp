@@ -0,0 +1,197 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <xfsalm.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "xfsmgr.h"
+#include "xfssp.h"
+#include "benchutil.h"
+
+/*
+ * Event fan-out to many registered windows: one session registers the given number of
+ * windows for service events while the device raises events at the given rate, and
+ * every window records what it receives. Reports the cost of WFPRegister and
+ * WFPDeregister, which rebuild the subscriber snapshot, for the first and the last
+ * hundred windows, and for the events that reached every window, the spread between
+ * the first and the last window receiving it.
+ *
+ * Usage: register_bench [windows] [events] [event rate]
+ */
+
+#define BENCH_SPI_VERSIONS 0x00030203
+
+/*
+ * @brief 
+ * When the first and the last window received one event, and how many did.
+ */
+struct BENCH_EVENT {
+	double dFirst;
+	double dLast;
+	DWORD dwWindows;
+};
+
+static std::mutex g_mutex;
+static std::map<WORD, BENCH_EVENT> g_events;
+static std::atomic<ULONGLONG> g_completions(0);
+static std::atomic<ULONGLONG> g_failures(0);
+
+static LRESULT CALLBACK BenchWndProc(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+{
+	(void)hWnd;
+	(void)wParam;
+	LPWFSRESULT lpWFSResult = (LPWFSRESULT)lParam;
+	if (uMessage == WFS_SERVICE_EVENT)
+	{
+		double dNow = BenchSeconds();
+		WORD wData = *(LPWORD)lpWFSResult->lpBuffer;
+		std::lock_guard<std::mutex> lock(g_mutex);
+		std::map<WORD, BENCH_EVENT>::iterator it = g_events.find(wData);
+		if (it == g_events.end())
+		{
+			BENCH_EVENT event = { dNow, dNow, 1 };
+			g_events[wData] = event;
+		}
+		else
+		{
+			it->second.dLast = dNow;
+			it->second.dwWindows++;
+		}
+	}
+	else
+	{
+		if (lpWFSResult->hResult != WFS_SUCCESS)
+			g_failures++;
+		g_completions++;
+	}
+	WFMFreeBuffer(lpWFSResult);
+	return 0;
+}
+
+static void BenchWait(ULONGLONG ullCompletions)
+{
+	while (g_completions.load() < ullCompletions)
+		std::this_thread::yield();
+}
+
+/*
+ * @brief 
+ * Counts the events every window received and collects their spread.
+ * @param dwWindows - Number of registered windows.
+ * @param spreads - Receives the spread of each such event in milliseconds.
+ */
+static void BenchComplete(DWORD dwWindows, std::vector<double>& spreads)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	spreads.clear();
+	std::map<WORD, BENCH_EVENT>::iterator it;
+	for (it = g_events.begin(); it != g_events.end(); ++it)
+		if (it->second.dwWindows == dwWindows)
+			spreads.push_back((it->second.dLast - it->second.dFirst) * 1000.0);
+}
+
+/*
+ * @brief 
+ * Average time of the calls in a range, in microseconds.
+ */
+static double BenchAverage(const std::vector<double>& calls, size_t nFirst, size_t nLast)
+{
+	double dSum = 0;
+	for (size_t i = nFirst; i < nLast; i++)
+		dSum += calls[i];
+	return nLast > nFirst ? dSum * 1000000.0 / (nLast - nFirst) : 0;
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwWindows = BenchArgument(argc, argv, 1, 1000);
+	DWORD dwEvents = BenchArgument(argc, argv, 2, 20);
+	DWORD dwRate = BenchArgument(argc, argv, 3, 20);
+
+	char szRate[16];
+	snprintf(szRate, sizeof(szRate), "%u", dwRate);
+	g_xfs_manager.SetConfig("EventRate", szRate);
+
+	HWND hWndControl = g_xfs_manager.CreateWindowObject(BenchWndProc, NULL);
+	WFSVERSION spiVersion, srvcVersion;
+	if (WFPOpen(1, (LPSTR)"ALM1", NULL, NULL, 0, 0, hWndControl, 1, NULL,
+		BENCH_SPI_VERSIONS, &spiVersion, BENCH_SPI_VERSIONS, &srvcVersion) != WFS_SUCCESS)
+		return 1;
+	BenchWait(1);
+
+	std::vector<HWND> windows;
+	std::vector<double> calls;
+	for (DWORD w = 0; w < dwWindows; w++)
+	{
+		HWND hWnd = g_xfs_manager.CreateWindowObject(BenchWndProc, NULL);
+		windows.push_back(hWnd);
+
+		double dStart = BenchSeconds();
+		if (WFPRegister(1, SERVICE_EVENTS, hWnd, hWndControl, w + 2) != WFS_SUCCESS)
+			g_failures++;
+		calls.push_back(BenchSeconds() - dStart);
+	}
+	BenchWait(1 + dwWindows);
+	size_t nHead = std::min<size_t>(100, calls.size());
+	double dRegisterFirst = BenchAverage(calls, 0, nHead);
+	double dRegisterLast = BenchAverage(calls, calls.size() - nHead, calls.size());
+
+	// Only the events raised once every window was registered reach them all.
+	std::vector<double> spreads;
+	double dStart = BenchSeconds();
+	while (BenchSeconds() - dStart < 10.0 + 2.0 * dwEvents / dwRate)
+	{
+		BenchComplete(dwWindows, spreads);
+		if (spreads.size() >= dwEvents)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	calls.clear();
+	for (DWORD w = 0; w < dwWindows; w++)
+	{
+		double dCall = BenchSeconds();
+		if (WFPDeregister(1, SERVICE_EVENTS, windows[w], hWndControl, dwWindows + w + 2) != WFS_SUCCESS)
+			g_failures++;
+		calls.push_back(BenchSeconds() - dCall);
+	}
+	BenchWait(1 + 2 * dwWindows);
+	double dDeregisterFirst = BenchAverage(calls, 0, nHead);
+	double dDeregisterLast = BenchAverage(calls, calls.size() - nHead, calls.size());
+
+	WFPClose(1, hWndControl, 2 * dwWindows + 2);
+	BenchWait(2 + 2 * dwWindows);
+	WFPUnloadService();
+	for (DWORD w = 0; w < dwWindows; w++)
+		g_xfs_manager.DestroyWindowObject(windows[w]);
+	g_xfs_manager.DestroyWindowObject(hWndControl);
+	g_xfs_manager.SetConfig("EventRate", "0");
+
+	std::sort(spreads.begin(), spreads.end());
+	printf("register_bench: windows=%u register first=%.1fus last=%.1fus deregister first=%.1fus last=%.1fus\n",
+		dwWindows, dRegisterFirst, dRegisterLast, dDeregisterFirst, dDeregisterLast);
+	printf("register_bench: windows=%u events=%u spread p50=%.3fms max=%.3fms failures=%llu\n",
+		dwWindows, (DWORD)spreads.size(), spreads.empty() ? 0 : spreads[spreads.size() / 2],
+		spreads.empty() ? 0 : spreads.back(), g_failures.load());
+	return spreads.size() >= dwEvents && g_failures.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <xfsalm.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "xfsmgr.h"
+#include "benchutil.h"
+
+/*
+ * End-to-end request throughput of the SP: every session issues its requests from a
+ * thread of its own and the clock stops when the last completion has been delivered.
+ * GetInfo(STATUS) is answered inline from the status snapshot, Execute(RESET) goes
+ * through the execute lane of the session.
+ *
+ * Usage: request_bench [sessions] [requests per session]
+ */
+
+#define BENCH_SPI_VERSIONS 0x00030203
+
+static std::atomic<ULONGLONG> g_completions(0);
+static std::atomic<ULONGLONG> g_failures(0);
+
+static LRESULT CALLBACK BenchWndProc(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+{
+	(void)hWnd;
+	(void)uMessage;
+	(void)wParam;
+	LPWFSRESULT lpWFSResult = (LPWFSRESULT)lParam;
+	if (lpWFSResult->hResult != WFS_SUCCESS)
+		g_failures++;
+	WFMFreeBuffer(lpWFSResult);
+	g_completions++;
+	return 0;
+}
+
+static void BenchWait(ULONGLONG ullCompletions)
+{
+	while (g_completions.load() < ullCompletions)
+		std::this_thread::yield();
+}
+
+static double BenchRun(const std::vector<HWND>& windows, DWORD dwRequests, DWORD dwCommand, BOOL bExecute)
+{
+	ULONGLONG ullTarget = g_completions.load() + (ULONGLONG)windows.size() * dwRequests;
+	double dStart = BenchSeconds();
+
+	std::vector<std::thread> threads;
+	for (size_t s = 0; s < windows.size(); s++)
+	{
+		threads.push_back(std::thread([&, s]() {
+			HSERVICE hService = (HSERVICE)(s + 1);
+			for (DWORD i = 0; i < dwRequests; i++)
+			{
+				HRESULT hResult;
+				while (TRUE)
+				{
+					hResult = bExecute
+						? WFPExecute(hService, dwCommand, NULL, 0, windows[s], i + 1)
+						: WFPGetInfo(hService, dwCommand, NULL, 0, windows[s], i + 1);
+					if (hResult != WFS_ERR_OUT_OF_MEMORY)
+						break;
+					// The execute lane is full: wait for the session to catch up.
+					std::this_thread::yield();
+				}
+				if (hResult != WFS_SUCCESS)
+				{
+					g_failures++;
+					g_completions++;
+				}
+			}
+		}));
+	}
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	BenchWait(ullTarget);
+	return BenchSeconds() - dStart;
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwSessions = BenchArgument(argc, argv, 1, 8);
+	DWORD dwRequests = BenchArgument(argc, argv, 2, 20000);
+
+	std::vector<HWND> windows;
+	for (DWORD s = 0; s < dwSessions; s++)
+	{
+		HWND hWnd = g_xfs_manager.CreateWindowObject(BenchWndProc, NULL);
+		windows.push_back(hWnd);
+
+		WFSVERSION spiVersion, srvcVersion;
+		if (WFPOpen(s + 1, (LPSTR)"ALM1", NULL, NULL, 0, 0, hWnd, 1, NULL,
+			BENCH_SPI_VERSIONS, &spiVersion, BENCH_SPI_VERSIONS, &srvcVersion) != WFS_SUCCESS)
+			return 1;
+	}
+	BenchWait(dwSessions);
+
+	double dStatus = BenchRun(windows, dwRequests, WFS_INF_ALM_STATUS, FALSE);
+	double dExecute = BenchRun(windows, dwRequests, WFS_CMD_ALM_RESET, TRUE);
+	ULONGLONG ullTotal = (ULONGLONG)dwSessions * dwRequests;
+
+	for (DWORD s = 0; s < dwSessions; s++)
+		WFPClose(s + 1, windows[s], 2);
+	BenchWait(dwSessions + 2 * ullTotal + dwSessions);
+	WFPUnloadService();
+	for (DWORD s = 0; s < dwSessions; s++)
+		g_xfs_manager.DestroyWindowObject(windows[s]);
+
+	printf("request_bench: sessions=%u requests=%llu getinfo/s=%.0f execute/s=%.0f failures=%llu\n",
+		dwSessions, ullTotal, ullTotal / dStatus, ullTotal / dExecute, g_failures.load());
+	return g_failures.load() == 0 ? 0 : 1;
+}
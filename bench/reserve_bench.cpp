@@ -0,0 +1,136 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <xfsalm.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "resultreserve.h"
+#include "workerpool.h"
+#include "benchutil.h"
+
+/*
+ * Cost of preparing the result of a GetInfo(STATUS): a block with its WFSALMSTATUS
+ * payload taken from the result reserve, against WFMAllocateBuffer followed by
+ * WFMAllocateMore as every request did before the reserve. Every thread frees its
+ * results the way the application does, and pauses for a millisecond after each burst
+ * of results, as pollers do; only the preparation is timed. The reserve is topped up
+ * during the pauses, so bursts that fit it are served from stock, while longer ones
+ * fall back to the allocator. The WFM functions are those of the XFS manager stand-in,
+ * which allocates from the heap; the shared memory of the real manager costs more per
+ * call. Reports the time per result and the reserve counters.
+ *
+ * Usage: reserve_bench [results per thread] [threads] [burst per thread] [reserve size]
+ */
+
+/*
+ * @brief 
+ * Prepares and frees results on every thread.
+ * @param bReserve - TRUE to take the blocks from the reserve.
+ * @param dwResults - Results per thread.
+ * @param dwThreads - Number of threads.
+ * @param dwBurst - Results per thread between pauses.
+ * @return double the seconds spent preparing results, summed over the threads, a
+ *	negative value on failure.
+ */
+static double BenchRun(BOOL bReserve, DWORD dwResults, DWORD dwThreads, DWORD dwBurst)
+{
+	std::atomic<ULONGLONG> ullFailures(0);
+	std::vector<double> seconds(dwThreads);
+	std::vector<std::thread> threads;
+	for (DWORD t = 0; t < dwThreads; t++)
+	{
+		threads.push_back(std::thread([&, t]() {
+			double dStart = BenchSeconds();
+			for (DWORD i = 0; i < dwResults; i++)
+			{
+				if (i != 0 && i % dwBurst == 0)
+				{
+					seconds[t] += BenchSeconds() - dStart;
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					dStart = BenchSeconds();
+				}
+
+				LPWFSRESULT lpWFSResult;
+				LPVOID lpStatus;
+				if (bReserve)
+				{
+					if (g_result_reserve.Allocate(&lpWFSResult, RESULT_CLASS_STATUS) != WFS_SUCCESS)
+					{
+						ullFailures++;
+						continue;
+					}
+					if (g_result_reserve.AllocatePayload(lpWFSResult, sizeof(WFSALMSTATUS), &lpStatus) != WFS_SUCCESS)
+						ullFailures++;
+				}
+				else
+				{
+					if (WFMAllocateBuffer(sizeof(WFSRESULT), WFS_MEM_SHARE | WFS_MEM_ZEROINIT, (LPVOID*)&lpWFSResult) != WFS_SUCCESS)
+					{
+						ullFailures++;
+						continue;
+					}
+					if (WFMAllocateMore(sizeof(WFSALMSTATUS), lpWFSResult, &lpStatus) != WFS_SUCCESS)
+						ullFailures++;
+				}
+				((LPWFSALMSTATUS)lpStatus)->fwDevice = WFS_ALM_DEVONLINE;
+				lpWFSResult->lpBuffer = lpStatus;
+				WFMFreeBuffer(lpWFSResult);
+			}
+			seconds[t] += BenchSeconds() - dStart;
+		}));
+	}
+	double dSeconds = 0;
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+		dSeconds += seconds[i];
+	}
+	return ullFailures.load() == 0 ? dSeconds : -1;
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwResults = BenchArgument(argc, argv, 1, 20000);
+	DWORD dwThreads = BenchArgument(argc, argv, 2, 4);
+	DWORD dwBurst = BenchArgument(argc, argv, 3, 8);
+	DWORD dwSize = BenchArgument(argc, argv, 4, RESULT_RESERVE_DEFAULT_SIZE);
+
+	// The reserve is topped up from the worker pool.
+	if (g_worker_pool.Start(0) != 0 || g_result_reserve.Start(dwSize) != 0)
+		return 1;
+
+	ULONGLONG ullTotal = (ULONGLONG)dwResults * dwThreads;
+	double dDirect = BenchRun(FALSE, dwResults, dwThreads, dwBurst);
+	double dReserve = BenchRun(TRUE, dwResults, dwThreads, dwBurst);
+
+	RESULT_RESERVE_COUNTERS counters;
+	g_result_reserve.GetCounters(&counters);
+	g_result_reserve.Stop();
+	g_worker_pool.Stop();
+	if (dDirect < 0 || dReserve < 0)
+		return 1;
+
+	printf("reserve_bench: direct  threads=%u burst=%u results=%llu ns/result=%.1f\n",
+		dwThreads, dwBurst, ullTotal, dDirect * 1e9 / ullTotal);
+	printf("reserve_bench: reserve threads=%u burst=%u results=%llu ns/result=%.1f size=%u hits=%u misses=%u refills=%u\n",
+		dwThreads, dwBurst, ullTotal, dReserve * 1e9 / ullTotal, dwSize,
+		counters.dwHits, counters.dwMisses, counters.dwRefills);
+	return 0;
+}
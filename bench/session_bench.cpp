@@ -0,0 +1,172 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <xfsalm.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "xfsmgr.h"
+#include "xfssp.h"
+#include "sessiontable.h"
+#include "sync.h"
+#include "benchutil.h"
+
+/*
+ * Per-call overhead of finding the state of a session. First the lookup alone: a
+ * session table slot fetched once per call, against the lookups WFPExecute made before
+ * the table, a find in the map of open services and the lock state read under its
+ * mutex. Then the time WFPGetInfo(CAPABILITIES) and WFPExecute(RESET) take to return
+ * through the stand-in manager, one request outstanding at a time.
+ *
+ * Usage: session_bench [lookups] [open sessions] [calls]
+ */
+
+#define BENCH_SPI_VERSIONS 0x00030203
+
+static std::atomic<ULONGLONG> g_completions(0);
+static std::atomic<ULONGLONG> g_failures(0);
+
+static LRESULT CALLBACK BenchWndProc(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+{
+	(void)hWnd;
+	(void)uMessage;
+	(void)wParam;
+	LPWFSRESULT lpWFSResult = (LPWFSRESULT)lParam;
+	if (lpWFSResult->hResult != WFS_SUCCESS)
+		g_failures++;
+	WFMFreeBuffer(lpWFSResult);
+	g_completions++;
+	return 0;
+}
+
+/*
+ * @brief 
+ * Times the session lookups of both kinds.
+ * @param dwLookups - Number of lookups.
+ * @param dwSessions - Number of open sessions to look up among.
+ * @param lpdTable - Receives the nanoseconds per session table lookup.
+ * @param lpdMaps - Receives the nanoseconds per lookup through the maps.
+ * @return BOOL TRUE if every lookup found its session.
+ */
+static BOOL BenchLookups(DWORD dwLookups, DWORD dwSessions, double* lpdTable, double* lpdMaps)
+{
+	SessionTable table;
+	std::map<HSERVICE, bool> services;
+	SpMutex lockMutex("session_bench");
+	HSERVICE hLockOwner = 0;
+	for (DWORD s = 0; s < dwSessions; s++)
+	{
+		SESSION* session;
+		if (table.Insert(s + 1, &session) != WFS_SUCCESS)
+			return FALSE;
+		services[s + 1] = true;
+	}
+
+	DWORD dwFound = 0;
+	double dStart = BenchSeconds();
+	for (DWORD i = 0; i < dwLookups; i++)
+	{
+		DWORD dwGeneration;
+		SESSION* session = table.Find(i % dwSessions + 1, &dwGeneration);
+		if (session != NULL && table.IsCurrent(session, dwGeneration))
+			dwFound++;
+	}
+	*lpdTable = (BenchSeconds() - dStart) * 1e9 / dwLookups;
+
+	dStart = BenchSeconds();
+	for (DWORD i = 0; i < dwLookups; i++)
+	{
+		HSERVICE hService = i % dwSessions + 1;
+		if (services.find(hService) == services.end())
+			continue;
+		std::lock_guard<SpMutex> lock(lockMutex);
+		if (hLockOwner == 0 || hLockOwner == hService)
+			dwFound++;
+	}
+	*lpdMaps = (BenchSeconds() - dStart) * 1e9 / dwLookups;
+
+	return dwFound == 2 * dwLookups;
+}
+
+/*
+ * @brief 
+ * Times the return of one kind of call on an open session.
+ * @param hWnd - The window of the session.
+ * @param dwCalls - Number of calls.
+ * @param bExecute - TRUE for WFPExecute(RESET), FALSE for WFPGetInfo(CAPABILITIES).
+ * @return double nanoseconds per call.
+ */
+static double BenchCalls(HWND hWnd, DWORD dwCalls, BOOL bExecute)
+{
+	double dSeconds = 0;
+	for (DWORD i = 0; i < dwCalls; i++)
+	{
+		ULONGLONG ullBefore = g_completions.load();
+		double dStart = BenchSeconds();
+		HRESULT hResult = bExecute ?
+			WFPExecute(1, WFS_CMD_ALM_RESET, NULL, 0, hWnd, i + 2) :
+			WFPGetInfo(1, WFS_INF_ALM_CAPABILITIES, NULL, 0, hWnd, i + 2);
+		dSeconds += BenchSeconds() - dStart;
+		if (hResult != WFS_SUCCESS)
+		{
+			g_failures++;
+			continue;
+		}
+		while (g_completions.load() == ullBefore)
+			std::this_thread::yield();
+	}
+	return dSeconds * 1e9 / dwCalls;
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwLookups = BenchArgument(argc, argv, 1, 10000000);
+	DWORD dwSessions = BenchArgument(argc, argv, 2, 64);
+	DWORD dwCalls = BenchArgument(argc, argv, 3, 50000);
+
+	double dTable, dMaps;
+	if (!BenchLookups(dwLookups, dwSessions, &dTable, &dMaps))
+		return 1;
+
+	HWND hWnd = g_xfs_manager.CreateWindowObject(BenchWndProc, NULL);
+	WFSVERSION spiVersion, srvcVersion;
+	if (WFPOpen(1, (LPSTR)"ALM1", NULL, NULL, 0, 0, hWnd, 1, NULL,
+		BENCH_SPI_VERSIONS, &spiVersion, BENCH_SPI_VERSIONS, &srvcVersion) != WFS_SUCCESS)
+		return 1;
+	while (g_completions.load() < 1)
+		std::this_thread::yield();
+
+	double dGetInfo = BenchCalls(hWnd, dwCalls, FALSE);
+	double dExecute = BenchCalls(hWnd, dwCalls, TRUE);
+
+	ULONGLONG ullCompletions = g_completions.load();
+	WFPClose(1, hWnd, 1);
+	while (g_completions.load() < ullCompletions + 1)
+		std::this_thread::yield();
+	WFPUnloadService();
+	g_xfs_manager.DestroyWindowObject(hWnd);
+
+	printf("session_bench: sessions=%u lookups=%u table ns/lookup=%.1f maps ns/lookup=%.1f\n",
+		dwSessions, dwLookups, dTable, dMaps);
+	printf("session_bench: calls=%u getinfo ns/call=%.0f execute ns/call=%.0f failures=%llu\n",
+		dwCalls, dGetInfo, dExecute, g_failures.load());
+	return g_failures.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <xfsalm.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "xfsmgr.h"
+#include "xfssp.h"
+#include "benchutil.h"
+
+/*
+ * Concurrent status polling: every poller is an application with a session of its own
+ * on the same device, and keeps one GetInfo(STATUS) outstanding at a time. The first
+ * phase polls an online device, which answers from its status snapshot. The second phase
+ * polls while another session resets the device over and over; a reset takes the given
+ * time without a snapshot, so the requests arriving meanwhile read the device, which
+ * takes the given read time, or attach to a read already in flight. Reports the request
+ * rate and how the requests were answered in each phase.
+ *
+ * Usage: status_bench [pollers] [requests per poller] [read time in ms] [reset time in ms]
+ */
+
+#define BENCH_SPI_VERSIONS 0x00030203
+
+static std::atomic<ULONGLONG> g_completions(0);
+static std::atomic<ULONGLONG> g_failures(0);
+
+static LRESULT CALLBACK BenchWndProc(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+{
+	(void)uMessage;
+	(void)wParam;
+	LPWFSRESULT lpWFSResult = (LPWFSRESULT)lParam;
+	if (lpWFSResult->hResult != WFS_SUCCESS)
+		g_failures++;
+	WFMFreeBuffer(lpWFSResult);
+	((std::atomic<ULONGLONG>*)g_xfs_manager.GetWindowData(hWnd))->fetch_add(1);
+	g_completions++;
+	return 0;
+}
+
+static void BenchWait(ULONGLONG ullCompletions)
+{
+	while (g_completions.load() < ullCompletions)
+		std::this_thread::yield();
+}
+
+/*
+ * Sends one request on a session and waits for its answer.
+ */
+static void BenchRequest(HSERVICE hService, HWND hWnd, DWORD dwCommand, BOOL bExecute, REQUESTID reqId)
+{
+	std::atomic<ULONGLONG>* answers = (std::atomic<ULONGLONG>*)g_xfs_manager.GetWindowData(hWnd);
+	ULONGLONG ullBefore = answers->load();
+	HRESULT hResult = bExecute ?
+		WFPExecute(hService, dwCommand, NULL, 0, hWnd, reqId) :
+		WFPGetInfo(hService, dwCommand, NULL, 0, hWnd, reqId);
+	if (hResult != WFS_SUCCESS)
+	{
+		g_failures++;
+		g_completions++;
+		return;
+	}
+	while (answers->load() == ullBefore)
+		std::this_thread::yield();
+}
+
+/*
+ * Runs one polling phase, with the reset session resetting the device throughout when
+ * hReset is not NULL. Returns FALSE when a request was lost.
+ */
+static BOOL BenchPhase(const char* lpszPhase, const std::vector<HWND>& windows, DWORD dwRequests, HWND hReset)
+{
+	DWORD dwPollers = (DWORD)windows.size();
+	ULONGLONG ullStart = g_completions.load();
+
+	WFS_STATUS_COUNTERS before, after;
+	WFPQueryStatusCounters("ALM1", &before);
+
+	std::atomic<bool> bStop(false);
+	std::atomic<ULONGLONG> ullResets(0);
+	std::thread resetter;
+	if (hReset != NULL)
+	{
+		resetter = std::thread([&]() {
+			for (REQUESTID i = 0; !bStop.load(); i++, ullResets++)
+				BenchRequest(dwPollers + 1, hReset, WFS_CMD_ALM_RESET, TRUE, i + 2);
+		});
+	}
+
+	double dStart = BenchSeconds();
+	std::vector<std::thread> threads;
+	for (DWORD p = 0; p < dwPollers; p++)
+	{
+		threads.push_back(std::thread([&, p]() {
+			for (DWORD i = 0; i < dwRequests; i++)
+				BenchRequest(p + 1, windows[p], WFS_INF_ALM_STATUS, FALSE, i + 2);
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	ULONGLONG ullTotal = (ULONGLONG)dwPollers * dwRequests;
+	double dElapsed = BenchSeconds() - dStart;
+
+	bStop = true;
+	if (resetter.joinable())
+		resetter.join();
+	BenchWait(ullStart + ullTotal + ullResets.load());
+
+	WFPQueryStatusCounters("ALM1", &after);
+	DWORD dwSnapshot = after.dwSnapshot - before.dwSnapshot;
+	DWORD dwIssued = after.dwIssued - before.dwIssued;
+	DWORD dwCoalesced = after.dwCoalesced - before.dwCoalesced;
+
+	printf("status_bench: %-9s pollers=%u requests=%llu getinfo/s=%.0f resets=%llu snapshot=%u reads=%u coalesced=%u (%.1f%% of reads avoided)\n",
+		lpszPhase, dwPollers, ullTotal, ullTotal / dElapsed, ullResets.load(), dwSnapshot, dwIssued, dwCoalesced,
+		ullTotal ? 100.0 * (dwSnapshot + dwCoalesced) / ullTotal : 0.0);
+	return dwSnapshot + dwIssued + dwCoalesced == ullTotal;
+}
+
+int main(int argc, char** argv)
+{
+	DWORD dwPollers = BenchArgument(argc, argv, 1, 64);
+	DWORD dwRequests = BenchArgument(argc, argv, 2, 2000);
+	DWORD dwReadDelay = BenchArgument(argc, argv, 3, 1);
+	DWORD dwResetDelay = BenchArgument(argc, argv, 4, 5);
+
+	char szDelay[16];
+	snprintf(szDelay, sizeof(szDelay), "%u", dwReadDelay);
+	g_xfs_manager.SetConfig("StatusReadDelay", szDelay);
+	snprintf(szDelay, sizeof(szDelay), "%u", dwResetDelay);
+	g_xfs_manager.SetConfig("ResetDelay", szDelay);
+
+	// The pollers, then the session that resets the device.
+	std::vector<HWND> windows;
+	std::vector<std::atomic<ULONGLONG>> answers(dwPollers + 1);
+	for (DWORD p = 0; p <= dwPollers; p++)
+	{
+		answers[p] = 0;
+		HWND hWnd = g_xfs_manager.CreateWindowObject(BenchWndProc, &answers[p]);
+		windows.push_back(hWnd);
+
+		WFSVERSION spiVersion, srvcVersion;
+		if (WFPOpen(p + 1, (LPSTR)"ALM1", NULL, NULL, 0, 0, hWnd, 1, NULL,
+			BENCH_SPI_VERSIONS, &spiVersion, BENCH_SPI_VERSIONS, &srvcVersion) != WFS_SUCCESS)
+			return 1;
+	}
+	BenchWait(dwPollers + 1);
+	HWND hReset = windows.back();
+	windows.pop_back();
+
+	BOOL bCounted = BenchPhase("online", windows, dwRequests, NULL);
+	bCounted = BenchPhase("resetting", windows, dwRequests, hReset) && bCounted;
+
+	ULONGLONG ullCompletions = g_completions.load();
+	for (DWORD p = 0; p < dwPollers; p++)
+		WFPClose(p + 1, windows[p], 1);
+	WFPClose(dwPollers + 1, hReset, 1);
+	BenchWait(ullCompletions + dwPollers + 1);
+	WFPUnloadService();
+	for (DWORD p = 0; p < dwPollers; p++)
+		g_xfs_manager.DestroyWindowObject(windows[p]);
+	g_xfs_manager.DestroyWindowObject(hReset);
+
+	printf("status_bench: read=%ums reset=%ums failures=%llu\n", dwReadDelay, dwResetDelay, g_failures.load());
+	return g_failures.load() == 0 && bCounted ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "pch.h"
+#include "capabilities.h"
+#include "resultreserve.h"
+#include <mutex>
+
+static CAPS_IMAGE g_caps_image;
+static std::once_flag g_caps_once;
+
+static const char g_caps_extra[] = "VendorName=MOCKDEVICE\0SPVersion=3.30\0";
+
+/*
+ * @brief 
+ * Fills the capabilities image. The capabilities never change for the life of the SP,
+ * so only the first call does any work.
+ */
+void CapsBuildImage()
+{
+	std::call_once(g_caps_once, []()
+	{
+		memset(&g_caps_image, 0, sizeof(g_caps_image));
+
+		g_caps_image.caps.wClass = WFS_SERVICE_CLASS_ALM;
+		g_caps_image.caps.bProgrammaticallyDeactivate = TRUE;
+		g_caps_image.caps.bAntiFraudModule = TRUE;
+
+		// No command can be synchronized; the list is just its 0 terminator.
+		g_caps_image.dwSynchronizableCommands[0] = 0;
+
+		// Double null-terminated "key=value" list.
+		memcpy(g_caps_image.szExtra, g_caps_extra, sizeof(g_caps_extra));
+	});
+}
+
+/*
+ * @brief 
+ * Copies the capabilities image into the payload of a result and points the copied
+ * structure at its own list and string.
+ * @param lpResult - Result taken from the result reserve; receives the payload in lpBuffer.
+ * @return HRESULT - WFS_SUCCESS on success, an error code on failure.
+ */
+HRESULT CapsCopyImage(LPWFSRESULT lpResult)
+{
+	CAPS_IMAGE* lpImage;
+	HRESULT hResult = g_result_reserve.AllocatePayload(lpResult, sizeof(CAPS_IMAGE), (LPVOID*)&lpImage);
+	if (hResult != WFS_SUCCESS)
+		return hResult;
+
+	memcpy(lpImage, &g_caps_image, sizeof(CAPS_IMAGE));
+	lpImage->caps.lpdwSynchronizableCommands = lpImage->dwSynchronizableCommands;
+	lpImage->caps.lpszExtra = lpImage->szExtra;
+
+	lpResult->lpBuffer = &lpImage->caps;
+	return WFS_SUCCESS;
+}
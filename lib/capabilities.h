@@ -0,0 +1,38 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#include <xfsalm.h>
+#include <xfsspi.h>
+
+#define CAPS_SYNC_COMMANDS 1
+#define CAPS_EXTRA_SIZE 64
+
+/*
+ * @brief 
+ * Contiguous WFS_INF_ALM_CAPABILITIES reply. The list and string the WFSALMCAPS
+ * points to follow the structure, so one copy moves the whole reply and only the two
+ * pointers have to be fixed up afterwards.
+ */
+struct CAPS_IMAGE {
+	WFSALMCAPS caps;
+	DWORD dwSynchronizableCommands[CAPS_SYNC_COMMANDS];
+	CHAR szExtra[CAPS_EXTRA_SIZE];
+};
+
+void CapsBuildImage();
+HRESULT CapsCopyImage(LPWFSRESULT lpResult);
@@ -0,0 +1,54 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "pch.h"
+#include "config.h"
+#include "platform.h"
+
+/*
+ * @brief 
+ * Reads a DWORD setting of the service provider, kept under SP_CONFIG_KEY on Windows.
+ * @param lpszValueName - Name of the setting.
+ * @param dwDefault - Value returned when the entry is missing or has another type.
+ * @return DWORD the configured value, or dwDefault.
+ */
+DWORD SPConfigGetDword(LPCSTR lpszValueName, DWORD dwDefault)
+{
+	DWORD dwValue = 0;
+
+	if (!PlatformConfigGetDword(lpszValueName, &dwValue))
+		return dwDefault;
+
+	return dwValue;
+}
+
+/*
+ * @brief 
+ * Reads a string setting of the service provider, kept under SP_CONFIG_KEY on Windows.
+ * @param lpszValueName - Name of the setting.
+ * @param lpszBuffer - Receives the null-terminated value.
+ * @param dwSize - Size of lpszBuffer in bytes.
+ * @return BOOL TRUE if a non-empty value was read, FALSE if it is missing, has another
+ *         type or does not fit.
+ */
+BOOL SPConfigGetString(LPCSTR lpszValueName, LPSTR lpszBuffer, DWORD dwSize)
+{
+	if (!PlatformConfigGetString(lpszValueName, lpszBuffer, dwSize))
+		return FALSE;
+
+	return lpszBuffer[0] != '\0';
+}
@@ -0,0 +1,298 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "pch.h"
+#include "xfssp.h"
+#include "eventdispatcher.h"
+#include "resultreserve.h"
+#include "platform.h"
+#include <new>
+
+EventDispatcher g_event_dispatcher;
+
+EventDispatcher::EventDispatcher() : m_mutex("EventDispatcher")
+{
+	m_nDepth = EVENT_DEFAULT_DEPTH;
+	m_dwPolicy = EVENT_POLICY_DROP_OLDEST;
+	m_dwSendTimeout = EVENT_DEFAULT_SEND_TIMEOUT;
+}
+
+EventDispatcher::~EventDispatcher()
+{
+	Stop();
+}
+
+/*
+ * @brief 
+ * Starts the delivery threads. Calling it on a running dispatcher does nothing.
+ * @param dwThreads - Number of delivery threads.
+ * @param dwDepth - Number of events each window may have waiting.
+ * @param dwPolicy - EVENT_POLICY_* applied when a window queue is full.
+ * @param dwSendTimeout - Milliseconds a window may take to process one event before it
+ *	is disconnected.
+ * @return int 0 on success, a negative value on failure.
+ */
+int EventDispatcher::Start(DWORD dwThreads, DWORD dwDepth, DWORD dwPolicy, DWORD dwSendTimeout)
+{
+	{
+		std::lock_guard<SpMutex> lock(m_mutex);
+		m_nDepth = dwDepth ? dwDepth : EVENT_DEFAULT_DEPTH;
+		m_dwPolicy = dwPolicy <= EVENT_POLICY_DISCONNECT ? dwPolicy : EVENT_POLICY_DROP_OLDEST;
+		m_dwSendTimeout = dwSendTimeout ? dwSendTimeout : EVENT_DEFAULT_SEND_TIMEOUT;
+	}
+	return m_pool.Start(dwThreads);
+}
+
+/*
+ * @brief 
+ * Delivers the events still queued, stops the delivery threads and forgets every window.
+ */
+void EventDispatcher::Stop()
+{
+	m_pool.Stop();
+
+	std::lock_guard<SpMutex> lock(m_mutex);
+	std::map<HWND, EVENT_SUBSCRIBER*>::iterator it;
+	for (it = m_subscribers.begin(); it != m_subscribers.end(); ++it)
+		delete it->second;
+	m_subscribers.clear();
+}
+
+/*
+ * @brief 
+ * Queues an event for a window and returns without waiting for its delivery. Events for
+ * windows that were never added, or were removed, are ignored.
+ * @param hWnd - The registered window.
+ * @param hService - The session the window registered with.
+ * @param uMessage - The event message sent to the window.
+ * @param dwEventID - The event identifier.
+ * @param dwData - Data associated with the event.
+ */
+void EventDispatcher::Publish(HWND hWnd, HSERVICE hService, UINT uMessage, DWORD dwEventID, DWORD dwData)
+{
+	EVENT_ITEM item;
+	item.hService = hService;
+	item.uMessage = uMessage;
+	item.dwEventID = dwEventID;
+	item.dwData = dwData;
+
+	EVENT_SUBSCRIBER* subscriber;
+	bool bSchedule = false;
+	{
+		std::lock_guard<SpMutex> lock(m_mutex);
+		std::map<HWND, EVENT_SUBSCRIBER*>::iterator it = m_subscribers.find(hWnd);
+		if (it == m_subscribers.end())
+			return;
+		subscriber = it->second;
+
+		if (subscriber->bDisconnected)
+			return;
+
+		Enqueue(subscriber, item);
+
+		if (!subscriber->bScheduled && !subscriber->queue.empty())
+		{
+			subscriber->bScheduled = true;
+			bSchedule = true;
+		}
+	}
+
+	if (bSchedule && m_pool.Submit(DeliverProcess, subscriber) != 0)
+	{
+		std::lock_guard<SpMutex> lock(m_mutex);
+		subscriber->bScheduled = false;
+		subscriber->queue.clear();
+		if (subscriber->bRemoved)
+			delete subscriber;
+	}
+}
+
+/*
+ * @brief 
+ * Starts accepting events for a window. A window that was disconnected by
+ * EVENT_POLICY_DISCONNECT or the send timeout receives events again.
+ * @param hWnd - The registered window.
+ */
+void EventDispatcher::Add(HWND hWnd)
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+	EVENT_SUBSCRIBER*& entry = m_subscribers[hWnd];
+	if (entry == NULL)
+	{
+		entry = new (std::nothrow) EVENT_SUBSCRIBER();
+		if (entry == NULL)
+		{
+			m_subscribers.erase(hWnd);
+			return;
+		}
+		entry->hWnd = hWnd;
+		entry->bScheduled = false;
+		entry->bRemoved = false;
+		entry->dwDropped = 0;
+	}
+	entry->bDisconnected = false;
+}
+
+/*
+ * @brief 
+ * Forgets a window and drops the events still queued for it. A delivery already in
+ * progress is allowed to finish.
+ * @param hWnd - The window to forget.
+ */
+void EventDispatcher::Remove(HWND hWnd)
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+	std::map<HWND, EVENT_SUBSCRIBER*>::iterator it = m_subscribers.find(hWnd);
+	if (it == m_subscribers.end())
+		return;
+
+	EVENT_SUBSCRIBER* subscriber = it->second;
+	m_subscribers.erase(it);
+
+	subscriber->queue.clear();
+	if (subscriber->bScheduled)
+		subscriber->bRemoved = true;
+	else
+		delete subscriber;
+}
+
+/*
+ * @brief 
+ * Forgets every window.
+ */
+void EventDispatcher::RemoveAll()
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+	std::map<HWND, EVENT_SUBSCRIBER*>::iterator it;
+	for (it = m_subscribers.begin(); it != m_subscribers.end(); ++it)
+	{
+		it->second->queue.clear();
+		if (it->second->bScheduled)
+			it->second->bRemoved = true;
+		else
+			delete it->second;
+	}
+	m_subscribers.clear();
+}
+
+/*
+ * @brief 
+ * Appends an event to a window queue, applying the overflow policy when it is full.
+ * Called with the dispatcher locked.
+ * @param subscriber - The destination window.
+ * @param item - The event.
+ */
+void EventDispatcher::Enqueue(EVENT_SUBSCRIBER* subscriber, const EVENT_ITEM& item)
+{
+	if (subscriber->queue.size() < m_nDepth)
+	{
+		subscriber->queue.push_back(item);
+		return;
+	}
+
+	subscriber->dwDropped++;
+
+	if (m_dwPolicy == EVENT_POLICY_DISCONNECT)
+	{
+		subscriber->bDisconnected = true;
+		subscriber->queue.clear();
+		return;
+	}
+
+	if (m_dwPolicy == EVENT_POLICY_COALESCE)
+	{
+		std::deque<EVENT_ITEM>::reverse_iterator it;
+		for (it = subscriber->queue.rbegin(); it != subscriber->queue.rend(); ++it)
+		{
+			if (it->dwEventID == item.dwEventID && it->hService == item.hService)
+			{
+				*it = item;
+				return;
+			}
+		}
+	}
+
+	subscriber->queue.pop_front();
+	subscriber->queue.push_back(item);
+}
+
+/*
+ * @brief 
+ * Dispatcher pool task that drains the queue of one window.
+ * @param lpParam - The EVENT_SUBSCRIBER to drain.
+ * @return int 0 on success, a negative value on failure.
+ */
+DWORD WINAPI EventDispatcher::DeliverProcess(LPVOID lpParam)
+{
+	g_event_dispatcher.Deliver((EVENT_SUBSCRIBER*)lpParam);
+	return 0;
+}
+
+/*
+ * @brief 
+ * Sends the queued events of a window one by one. The result blocks are taken here
+ * so that events dropped by the overflow policy never consume a pooled block. A window
+ * that lets a send time out keeps that event but loses the rest, and gets no more until
+ * it is added again.
+ * @param subscriber - The window to serve.
+ */
+void EventDispatcher::Deliver(EVENT_SUBSCRIBER* subscriber)
+{
+	std::unique_lock<SpMutex> lock(m_mutex);
+	while (!subscriber->queue.empty())
+	{
+		EVENT_ITEM item = subscriber->queue.front();
+		subscriber->queue.pop_front();
+		DWORD dwSendTimeout = m_dwSendTimeout;
+		lock.unlock();
+
+		bool bStalled = false;
+		LPWFSRESULT lpWFSResult;
+		if (g_result_reserve.Allocate(&lpWFSResult) == WFS_SUCCESS)
+		{
+			lpWFSResult->hResult = WFS_SERVICE_EVENT;
+			lpWFSResult->hService = item.hService;
+			lpWFSResult->RequestID = 0;
+			lpWFSResult->lpBuffer = NULL;
+			lpWFSResult->u.dwEventID = item.dwEventID;
+
+			if (g_result_reserve.AllocatePayload(lpWFSResult, sizeof(DWORD), &lpWFSResult->lpBuffer) == WFS_SUCCESS)
+			{
+				LPWORD lpwLampThreshold = (LPWORD)lpWFSResult->lpBuffer;
+				*lpwLampThreshold = (WORD)item.dwData;
+
+				bStalled = !PlatformSendMessageTimeout(subscriber->hWnd, item.uMessage, lpWFSResult, dwSendTimeout);
+			}
+			else
+			{
+				WFMFreeBuffer(lpWFSResult);
+			}
+		}
+
+		lock.lock();
+		if (bStalled)
+		{
+			subscriber->dwDropped += (DWORD)subscriber->queue.size();
+			subscriber->bDisconnected = true;
+			subscriber->queue.clear();
+		}
+	}
+
+	subscriber->bScheduled = false;
+	if (subscriber->bRemoved)
+		delete subscriber;
+}
@@ -0,0 +1,84 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#include <map>
+#include <deque>
+#include <mutex>
+#include "sync.h"
+#include "workerpool.h"
+
+#define EVENT_POLICY_DROP_OLDEST 0
+#define EVENT_POLICY_COALESCE 1
+#define EVENT_POLICY_DISCONNECT 2
+
+#define EVENT_DEFAULT_THREADS 4
+#define EVENT_DEFAULT_DEPTH 64
+#define EVENT_DEFAULT_SEND_TIMEOUT 1000
+
+struct EVENT_ITEM {
+	HSERVICE hService;
+	UINT uMessage;
+	DWORD dwEventID;
+	DWORD dwData;
+};
+
+struct EVENT_SUBSCRIBER {
+	HWND hWnd;
+	std::deque<EVENT_ITEM> queue;
+	bool bScheduled;
+	bool bRemoved;
+	bool bDisconnected;
+	DWORD dwDropped;
+};
+
+/*
+ * @brief 
+ * Delivers events to registered windows off the producer thread. Every window has its
+ * own bounded queue drained by a task on the dispatcher pool, so a window with a slow
+ * message pump only delays itself. A full queue is handled by the overflow policy. A
+ * window that does not take an event within the send timeout is disconnected, so a
+ * stalled window holds a delivery thread once, for that long, rather than for good.
+ */
+class EventDispatcher
+{
+public:
+	EventDispatcher();
+	~EventDispatcher();
+
+	int Start(DWORD dwThreads, DWORD dwDepth, DWORD dwPolicy, DWORD dwSendTimeout = EVENT_DEFAULT_SEND_TIMEOUT);
+	void Stop();
+
+	void Publish(HWND hWnd, HSERVICE hService, UINT uMessage, DWORD dwEventID, DWORD dwData);
+	void Add(HWND hWnd);
+	void Remove(HWND hWnd);
+	void RemoveAll();
+
+private:
+	static DWORD WINAPI DeliverProcess(LPVOID lpParam);
+	void Deliver(EVENT_SUBSCRIBER* subscriber);
+	void Enqueue(EVENT_SUBSCRIBER* subscriber, const EVENT_ITEM& item);
+
+	SpMutex m_mutex;
+	std::map<HWND, EVENT_SUBSCRIBER*> m_subscribers;
+	WorkerPool m_pool;
+	size_t m_nDepth;
+	DWORD m_dwPolicy;
+	DWORD m_dwSendTimeout;
+};
+
+extern EventDispatcher g_event_dispatcher;
@@ -0,0 +1,260 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "pch.h"
+#include "xfssp.h"
+#include "executelane.h"
+#include <new>
+
+/*
+ * @brief 
+ * Creates the execute lane of a session: a bounded multi-producer/single-consumer ring
+ * of pre-allocated WFS_MSG slots.
+ * @param session - The session slot owning the lane.
+ * @param dwDepth - Number of slots, rounded up to a power of two.
+ * @return WFS_LANE* the new lane, NULL on failure.
+ */
+WFS_LANE* LaneCreate(SESSION* session, DWORD dwDepth)
+{
+	size_t nCapacity = 2;
+	while (nCapacity < dwDepth)
+		nCapacity <<= 1;
+
+	WFS_LANE* lane = new (std::nothrow) WFS_LANE();
+	if (lane == NULL)
+		return NULL;
+
+	lane->lpSlots = new (std::nothrow) WFS_SLOT[nCapacity];
+	lane->lpHints = new (std::nothrow) std::atomic<size_t>[nCapacity];
+	if (lane->lpSlots == NULL || lane->lpHints == NULL)
+	{
+		delete[] lane->lpSlots;
+		delete[] lane->lpHints;
+		delete lane;
+		return NULL;
+	}
+
+	for (size_t i = 0; i < nCapacity; i++)
+	{
+		lane->lpSlots[i].nSequence.store(i, std::memory_order_relaxed);
+		lane->lpHints[i].store(0, std::memory_order_relaxed);
+	}
+
+	lane->lpSession = session;
+	lane->nMask = nCapacity - 1;
+	lane->nEnqueuePos.store(0, std::memory_order_relaxed);
+	lane->nDequeuePos = 0;
+	lane->bScheduled.store(false);
+	return lane;
+}
+
+/*
+ * @brief 
+ * Releases a lane and its slots. The lane must not be in use.
+ * @param lane - The lane to release.
+ */
+void LaneDestroy(WFS_LANE* lane)
+{
+	delete[] lane->lpHints;
+	delete[] lane->lpSlots;
+	delete lane;
+}
+
+/*
+ * @brief 
+ * Claims a free slot and publishes a request in it. Safe to call from any number of
+ * threads at once; it never blocks.
+ * @param lane - The destination lane.
+ * @param hWnd - The window handle which is to receive the completion message.
+ * @param lpWFSResult - The result block of the request.
+ * @param dwGeneration - Generation of the session of the lane the request was issued on.
+ * @param dwTimeOut - Number of milliseconds to wait for completion, WFS_INDEFINITE_WAIT for none.
+ * @param lpfnTimeout - Called by the timer wheel with the WFS_MSG when dwTimeOut expires.
+ * @return BOOL TRUE on success, FALSE if every slot is in use.
+ */
+BOOL LaneTryPush(WFS_LANE* lane, HWND hWnd, LPWFSRESULT lpWFSResult, DWORD dwGeneration, DWORD dwTimeOut, timercb lpfnTimeout)
+{
+	WFS_SLOT* slot;
+	size_t pos = lane->nEnqueuePos.load(std::memory_order_relaxed);
+
+	while (TRUE)
+	{
+		slot = &lane->lpSlots[pos & lane->nMask];
+		size_t seq = slot->nSequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+		if (diff == 0)
+		{
+			if (lane->nEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			return FALSE;
+		}
+		else
+		{
+			pos = lane->nEnqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->msg.hWnd = hWnd;
+	slot->msg.uMessage = WFS_EXECUTE_COMPLETE;
+	slot->msg.lpWFSResult = lpWFSResult;
+	slot->msg.RequestID = lpWFSResult->RequestID;
+	slot->msg.dwCommand = lpWFSResult->u.dwCommandCode;
+	slot->msg.lpDataReceived = NULL;
+	slot->msg.lState.store(WFS_MSG_QUEUED, std::memory_order_relaxed);
+	slot->msg.lpLane = lane;
+	slot->msg.lpSession = lane->lpSession;
+	slot->msg.dwGeneration = dwGeneration;
+	slot->msg.lpDevice = lane->lpSession ? lane->lpSession->lpDevice : NULL;
+	TimerNodeInit(&slot->msg.timer);
+	lane->lpHints[slot->msg.RequestID & lane->nMask].store(pos + 1, std::memory_order_relaxed);
+
+	if (dwTimeOut != WFS_INDEFINITE_WAIT)
+		g_timer_wheel.Schedule(&slot->msg.timer, dwTimeOut, lpfnTimeout, &slot->msg);
+
+	slot->nSequence.store(pos + 1, std::memory_order_release);
+	return TRUE;
+}
+
+/*
+ * @brief 
+ * Returns the oldest published request without removing it, so the consumer can
+ * process it in place. Only the thread draining the lane may call it.
+ * @param lane - The lane to read.
+ * @return WFS_MSG* the oldest request, NULL if the lane is empty.
+ */
+WFS_MSG* LanePeek(WFS_LANE* lane)
+{
+	WFS_SLOT* slot = &lane->lpSlots[lane->nDequeuePos & lane->nMask];
+	if (slot->nSequence.load(std::memory_order_acquire) != lane->nDequeuePos + 1)
+		return NULL;
+
+	return &slot->msg;
+}
+
+/*
+ * @brief 
+ * Marks a request returned by LanePeek as started.
+ * @param lane - The lane holding the request.
+ * @param msg - The request returned by LanePeek.
+ * @return BOOL TRUE if the request must be executed, FALSE if it was cancelled or timed out.
+ */
+BOOL LaneBegin(WFS_LANE* lane, WFS_MSG* msg)
+{
+	UNREFERENCED_PARAMETER(lane);
+
+	LONG lExpected = WFS_MSG_QUEUED;
+	return msg->lState.compare_exchange_strong(lExpected, WFS_MSG_RUNNING);
+}
+
+/*
+ * @brief 
+ * Hands the slot returned by LanePeek back to the producers. Only the thread draining
+ * the lane may call it, after disarming the timer of the request. The slot is released
+ * with the cancel lock held, so LaneCancel never sees it reused while it scans.
+ * @param lane - The lane to update.
+ */
+void LanePop(WFS_LANE* lane)
+{
+	std::lock_guard<SpMutex> lock(lane->cancelMutex);
+	WFS_SLOT* slot = &lane->lpSlots[lane->nDequeuePos & lane->nMask];
+	slot->nSequence.store(lane->nDequeuePos + lane->nMask + 1, std::memory_order_release);
+	lane->nDequeuePos++;
+}
+
+/*
+ * @brief 
+ * Returns the request published at a position of the lane. Called with the cancel lock
+ * held, so the slot cannot be reused meanwhile.
+ * @param lane - The lane.
+ * @param pos - The position, between the dequeue and enqueue positions.
+ * @return WFS_MSG* the request, NULL if its producer has not published it yet.
+ */
+static WFS_MSG* LaneAt(WFS_LANE* lane, size_t pos)
+{
+	WFS_SLOT* slot = &lane->lpSlots[pos & lane->nMask];
+	if (slot->nSequence.load(std::memory_order_acquire) != pos + 1)
+		return NULL;
+	return &slot->msg;
+}
+
+/*
+ * @brief 
+ * Cancels one request if it is still queued.
+ * @param msg - The request.
+ * @param cb - Called if the request was cancelled.
+ * @return int 1 if the request was cancelled, 0 otherwise.
+ */
+static int LaneCancelRequest(WFS_MSG* msg, lanecancelcb cb)
+{
+	LONG lExpected = WFS_MSG_QUEUED;
+	if (!msg->lState.compare_exchange_strong(lExpected, WFS_MSG_CANCELLED))
+		return 0;
+
+	cb(msg);
+	return 1;
+}
+
+/*
+ * @brief 
+ * Cancels queued requests. A single request is looked up through the hint its producer
+ * left for its RequestID, which holds for identifiers handed out in sequence; on a miss,
+ * and for every request when reqId is 0, the published slots are scanned from the
+ * oldest one still held by the consumer to the newest one pushed, so the cost is
+ * bounded by the pending requests of the session. The cancel lock only competes with
+ * LanePop; producers never take it. A request pushed while the cancel runs may be
+ * missed, as if it came after it. The slot of a cancelled request is skipped and
+ * released later by the consumer.
+ * @param lane - The lane to search.
+ * @param reqId - The request identifier, 0 for every request of the lane.
+ * @param cb - Called, with the cancel lock held, for every request that was cancelled.
+ * @return int number of cancelled requests.
+ */
+int LaneCancel(WFS_LANE* lane, REQUESTID reqId, lanecancelcb cb)
+{
+	std::lock_guard<SpMutex> lock(lane->cancelMutex);
+	size_t nBegin = lane->nDequeuePos;
+	size_t nEnd = lane->nEnqueuePos.load(std::memory_order_acquire);
+
+	if (reqId != 0)
+	{
+		size_t nHint = lane->lpHints[reqId & lane->nMask].load(std::memory_order_relaxed);
+		if (nHint != 0 && nHint - 1 - nBegin < nEnd - nBegin)
+		{
+			WFS_MSG* msg = LaneAt(lane, nHint - 1);
+			if (msg != NULL && msg->RequestID == reqId)
+				return LaneCancelRequest(msg, cb);
+		}
+	}
+
+	int nCancelled = 0;
+	for (size_t pos = nBegin; pos != nEnd; pos++)
+	{
+		WFS_MSG* msg = LaneAt(lane, pos);
+		if (msg == NULL || (reqId != 0 && msg->RequestID != reqId))
+			continue;
+
+		nCancelled += LaneCancelRequest(msg, cb);
+		if (reqId != 0)
+			break;
+	}
+
+	return nCancelled;
+}
@@ -0,0 +1,32 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+struct WFS_LANE;
+struct WFS_MSG;
+struct SESSION;
+
+WFS_LANE* LaneCreate(SESSION* session, DWORD dwDepth);
+void LaneDestroy(WFS_LANE* lane);
+BOOL LaneTryPush(WFS_LANE* lane, HWND hWnd, LPWFSRESULT lpWFSResult, DWORD dwGeneration, DWORD dwTimeOut, timercb lpfnTimeout);
+WFS_MSG* LanePeek(WFS_LANE* lane);
+BOOL LaneBegin(WFS_LANE* lane, WFS_MSG* msg);
+void LanePop(WFS_LANE* lane);
+
+typedef void (*lanecancelcb)(WFS_MSG*);
+int LaneCancel(WFS_LANE* lane, REQUESTID reqId, lanecancelcb cb);
@@ -0,0 +1,176 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "pch.h"
+#include "xfssp.h"
+#include "lockmanager.h"
+
+LockManager g_lock_manager;
+
+LockManager::LockManager() : m_mutex("LockManager")
+{
+	m_lpOwner = NULL;
+}
+
+/*
+ * @brief 
+ * Grants the lock to a session or queues its request behind the current waiters. A
+ * session that already owns the lock is granted again.
+ * @param session - The requesting session.
+ * @param msg - The lock request; its dwTimeOut timer is armed when it is queued.
+ * @param dwTimeOut - Number of milliseconds to wait, WFS_INDEFINITE_WAIT for none.
+ * @param lpfnTimeout - Callback marking the request timed out when the timer expires.
+ * @return int LOCK_GRANTED if the caller completes the request now, LOCK_QUEUED if the
+ *             request now belongs to the manager.
+ */
+int LockManager::Acquire(SESSION* session, WFS_MSG* msg, DWORD dwTimeOut, timercb lpfnTimeout)
+{
+	if (m_lpOwner.load(std::memory_order_acquire) == session)
+	{
+		msg->lState.store(WFS_MSG_DONE);
+		return LOCK_GRANTED;
+	}
+
+	std::lock_guard<SpMutex> lock(m_mutex);
+
+	while (!m_waiters.empty() && m_waiters.front()->lState.load() != WFS_MSG_QUEUED)
+	{
+		Discard(m_waiters.front());
+		m_waiters.pop_front();
+	}
+
+	SESSION* lpExpected = NULL;
+	if (m_waiters.empty() && m_lpOwner.compare_exchange_strong(lpExpected, session))
+	{
+		msg->lState.store(WFS_MSG_DONE);
+		return LOCK_GRANTED;
+	}
+
+	m_waiters.push_back(msg);
+	if (dwTimeOut != WFS_INDEFINITE_WAIT)
+		g_timer_wheel.Schedule(&msg->timer, dwTimeOut, lpfnTimeout, msg);
+
+	return LOCK_QUEUED;
+}
+
+/*
+ * @brief 
+ * Releases the lock held by a session and hands it to the oldest live waiter.
+ * @param session - The releasing session.
+ * @param lppGranted - Receives the request that now owns the lock, NULL if none. The
+ *                     caller completes and frees it.
+ * @return BOOL TRUE if the session owned the lock.
+ */
+BOOL LockManager::Release(SESSION* session, WFS_MSG** lppGranted)
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+
+	*lppGranted = NULL;
+	SESSION* lpExpected = session;
+	if (!m_lpOwner.compare_exchange_strong(lpExpected, NULL))
+		return FALSE;
+
+	*lppGranted = GrantNext();
+	return TRUE;
+}
+
+/*
+ * @brief 
+ * Withdraws the waiting lock requests of a session.
+ * @param session - The session.
+ * @param reqId - The request to withdraw, 0 for all of them.
+ * @param cancelled - Receives the withdrawn requests. The caller completes and frees them.
+ */
+void LockManager::Cancel(SESSION* session, REQUESTID reqId, std::vector<WFS_MSG*>& cancelled)
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+
+	std::deque<WFS_MSG*>::iterator it = m_waiters.begin();
+	while (it != m_waiters.end())
+	{
+		WFS_MSG* msg = *it;
+		if (msg->lpSession != session || (reqId != 0 && msg->RequestID != reqId))
+		{
+			++it;
+			continue;
+		}
+
+		it = m_waiters.erase(it);
+
+		LONG lExpected = WFS_MSG_QUEUED;
+		if (msg->lState.compare_exchange_strong(lExpected, WFS_MSG_CANCELLED))
+		{
+			g_timer_wheel.Cancel(&msg->timer);
+			cancelled.push_back(msg);
+		}
+		else
+		{
+			Discard(msg);
+		}
+	}
+}
+
+/*
+ * @brief 
+ * Tells whether a session may use the device, i.e. nobody else holds the lock. This is a
+ * single load of the lock word, so WFPExecute never waits on the manager.
+ * @param session - The session.
+ * @return BOOL TRUE if the device is unlocked or locked by this session.
+ */
+BOOL LockManager::IsAdmitted(SESSION* session)
+{
+	SESSION* owner = m_lpOwner.load(std::memory_order_acquire);
+	return owner == NULL || owner == session;
+}
+
+/*
+ * @brief 
+ * Pops waiters until one can still be granted and makes its session the owner. Called
+ * with the manager locked and no owner.
+ * @return WFS_MSG* The granted request, NULL if no waiter is left.
+ */
+WFS_MSG* LockManager::GrantNext()
+{
+	while (!m_waiters.empty())
+	{
+		WFS_MSG* msg = m_waiters.front();
+		m_waiters.pop_front();
+
+		LONG lExpected = WFS_MSG_QUEUED;
+		if (msg->lState.compare_exchange_strong(lExpected, WFS_MSG_DONE))
+		{
+			g_timer_wheel.Cancel(&msg->timer);
+			m_lpOwner.store(msg->lpSession, std::memory_order_release);
+			return msg;
+		}
+
+		Discard(msg);
+	}
+
+	return NULL;
+}
+
+/*
+ * @brief 
+ * Frees a waiter that timed out while queued. Its completion has already been posted.
+ * @param msg - The request.
+ */
+void LockManager::Discard(WFS_MSG* msg)
+{
+	g_timer_wheel.Cancel(&msg->timer);
+	delete msg;
+}
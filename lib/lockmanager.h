@@ -0,0 +1,63 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#include <xfsapi.h>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include "sync.h"
+#include <atomic>
+#include "timerwheel.h"
+
+struct WFS_MSG;
+struct SESSION;
+
+#define LOCK_GRANTED 0
+#define LOCK_QUEUED 1
+
+/*
+ * @brief 
+ * Exclusive device lock shared by every session. Lock requests that cannot be granted
+ * wait in FIFO order and the lock passes to the oldest waiter when it is released.
+ * A waiter whose timer expires is only marked by its WFS_MSG state and stays queued
+ * until the manager meets it, so timer callbacks never take the manager lock. Admission
+ * checks and re-locks by the owner only read the lock word.
+ */
+class LockManager
+{
+public:
+	LockManager();
+
+	int Acquire(SESSION* session, WFS_MSG* msg, DWORD dwTimeOut, timercb lpfnTimeout);
+	BOOL Release(SESSION* session, WFS_MSG** lppGranted);
+	void Cancel(SESSION* session, REQUESTID reqId, std::vector<WFS_MSG*>& cancelled);
+	BOOL IsAdmitted(SESSION* session);
+
+private:
+	WFS_MSG* GrantNext();
+	void Discard(WFS_MSG* msg);
+
+	SpMutex m_mutex;
+	std::deque<WFS_MSG*> m_waiters;
+
+	// Lock word: NULL while unlocked, the owning session while locked. Changed with
+	// compare-and-swap under m_mutex and read without it.
+	std::atomic<SESSION*> m_lpOwner;
+};
+
+extern LockManager g_lock_manager;
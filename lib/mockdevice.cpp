@@ -18,112 +18,489 @@
 #include "pch.h"
 #include "mockdevice.h"
 #include "xfssp.h"
+#include "config.h"
+#include <chrono>
 
-static DWORD WINAPI MockDeviceAlarmLoop(LPVOID lpParam);
+MockScheduler g_mock_scheduler;
 
-static eventcb cbFunc = NULL;
-static HANDLE hThread = NULL;
-static DWORD threadId = 0;
-static HANDLE mutex = NULL;
+/*
+ * @brief 
+ * Reads the event generator settings.
+ * @param config - Receives the settings.
+ */
+static void MockEventConfigLoad(MOCK_EVENT_CONFIG* config) {
+	config->dwPattern = SPConfigGetDword("EventPattern", MOCK_PATTERN_STEADY);
+	config->dwRate = SPConfigGetDword("EventRate", 0);
+	config->dwBurstSize = SPConfigGetDword("EventBurstSize", 100);
+	config->dwPayloadStart = SPConfigGetDword("EventPayloadStart", 0);
+	config->dwPayloadStep = SPConfigGetDword("EventPayloadStep", 1);
+	config->dwPayloadCount = SPConfigGetDword("EventPayloadCount", 0);
+	config->dwSeed = SPConfigGetDword("EventSeed", 1);
+
+	if (config->dwRate > MOCK_MAX_EVENT_RATE)
+		config->dwRate = MOCK_MAX_EVENT_RATE;
+	if (config->dwBurstSize == 0)
+		config->dwBurstSize = 1;
+}
 
 /*
  * @brief 
- * Opens the target device for communication and sets up event callbacks.
- * @param cb 
- * @return int 0 on success, a negative value on failure.
+ * Gives the delay from one generated event to the next.
+ * @param config - The generator settings.
+ * @param rng - Random source of the Poisson pattern.
+ * @param ullEmitted - Number of events generated so far.
+ * @return ULONGLONG the delay in microseconds.
  */
-int OpenDevice(eventcb cb) {
-	int rv = -1;
-	if (mutex == NULL) {
-		mutex = CreateMutex(NULL, FALSE, NULL);
-		if (mutex == NULL) {
-			return rv;
-		}
+static ULONGLONG MockEventDelayUs(const MOCK_EVENT_CONFIG* config, std::minstd_rand& rng, ULONGLONG ullEmitted) {
+	if (config->dwRate == 0)
+		return MOCK_DEFAULT_PERIOD_MS * 1000ULL;
+
+	double dMeanUs = 1000000.0 / config->dwRate;
+
+	switch (config->dwPattern) {
+	case MOCK_PATTERN_BURSTY:
+		// A burst of dwBurstSize back-to-back events, then silence for the time the
+		// burst would have taken at the nominal rate.
+		if ((ullEmitted + 1) % config->dwBurstSize)
+			return 0;
+		return (ULONGLONG)(dMeanUs * config->dwBurstSize);
+	case MOCK_PATTERN_POISSON: {
+		std::exponential_distribution<double> interval(1.0 / dMeanUs);
+		return (ULONGLONG)interval(rng);
 	}
+	case MOCK_PATTERN_FLAPPING:
+		// Every SET is followed at once by its RESET; both count against the rate.
+		if (ullEmitted % 2 == 0)
+			return 0;
+		return (ULONGLONG)(dMeanUs * 2);
+	default:
+		return (ULONGLONG)dMeanUs;
+	}
+}
+
+static ULONGLONG MockClockUs(void) {
+	return (ULONGLONG)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MockDevice::MockDevice() : m_mutex("MockDevice"), m_ready(TRUE, FALSE)
+{
+	m_cbFunc = NULL;
+	m_lpContext = NULL;
+	m_bOpen = false;
+	m_bReady = false;
+	m_dwStatusReadDelay = 0;
+	m_dwResetDelay = 0;
+
+	m_dwStatusSeq.store(0);
+	m_bStatusValid.store(false);
+	m_fwStatusDevice.store(WFS_ALM_DEVNODEVICE);
+	m_bStatusAlarm.store(FALSE);
+	m_wStatusAfm.store(WFS_ALM_AFMOK);
+
+	memset(&m_config, 0, sizeof(m_config));
+	m_ullEmitted = 0;
+	m_ullNextUs = 0;
+	m_nAlarm = 0;
+	m_dwData = 0;
+	m_dwPayloadIndex = 0;
+	m_ullQueuedUs = 0;
+}
+
+MockDevice::~MockDevice()
+{
+	g_mock_scheduler.Remove(this);
+}
+
+/*
+ * @brief 
+ * Publishes a new status snapshot with a sequence lock. The writer makes the sequence
+ * odd while it updates the fields, readers retry until they see the same even sequence
+ * before and after copying them. Must be called with the device mutex held.
+ * @param bValid - FALSE while the state is unknown, e.g. during a reset.
+ * @param fwDevice - Device state.
+ * @param bAlarmSet - Alarm state.
+ */
+void MockDevice::Publish(bool bValid, WORD fwDevice, BOOL bAlarmSet)
+{
+	DWORD seq = m_dwStatusSeq.load(std::memory_order_relaxed);
+	m_dwStatusSeq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	m_bStatusValid.store(bValid, std::memory_order_relaxed);
+	m_fwStatusDevice.store(fwDevice, std::memory_order_relaxed);
+	m_bStatusAlarm.store(bAlarmSet, std::memory_order_relaxed);
+
+	m_dwStatusSeq.store(seq + 2, std::memory_order_release);
+}
+
+/*
+ * @brief 
+ * Opens the target device for communication and sets up event callbacks. The first
+ * open queues the device start-up on the shared scheduler, which brings the device
+ * online after DeviceReadyDelay milliseconds and then runs its event generator. Every
+ * open returns as soon as the device is ready. When it is not ready within
+ * DeviceOpenTimeout milliseconds, the open that started it closes it again.
+ * @param cb - Callback receiving the alarm events.
+ * @param lpContext - A pointer to user-defined data passed to the callback.
+ * @return int 0 on success, a negative value when the device does not come up in time.
+ */
+int MockDevice::Open(eventcb cb, LPVOID lpContext) {
+	if (g_mock_scheduler.Start() != 0)
+		return -1;
+
+	m_mutex.lock();
+	m_cbFunc = cb;
+	m_lpContext = lpContext;
 
-	if (hThread == NULL) {
-		hThread = CreateThread(NULL, 0, MockDeviceAlarmLoop, 0, 0, &threadId);
+	bool bStart = !m_bOpen;
+	if (bStart)
+	{
+		MockEventConfigLoad(&m_config);
+		m_rng.seed(m_config.dwSeed);
+		m_ullEmitted = 0;
+		m_ullNextUs = MockClockUs() + SPConfigGetDword("DeviceReadyDelay", 0) * 1000ULL;
+		m_nAlarm = 0;
+		m_dwData = m_config.dwPayloadStart;
+		m_dwPayloadIndex = 0;
+		m_dwStatusReadDelay = SPConfigGetDword("StatusReadDelay", 0);
+		m_dwResetDelay = SPConfigGetDword("ResetDelay", 0);
+		m_bOpen = true;
 	}
+	ULONGLONG ullDueUs = m_ullNextUs;
+	m_mutex.unlock();
 
-	Sleep(1000);
-	WaitForSingleObject(mutex, INFINITE);
-	cbFunc = cb;
-	rv = 0;
-	ReleaseMutex(mutex);
-	return rv;
+	if (bStart)
+		g_mock_scheduler.Add(this, ullDueUs);
+
+	if (!m_ready.Wait(SPConfigGetDword("DeviceOpenTimeout", MOCK_DEFAULT_OPEN_TIMEOUT)))
+	{
+		// Take the start-up back off the scheduler, or the device would come up later
+		// and raise events for an owner that saw its open fail.
+		if (bStart)
+			Close();
+		return -1;
+	}
+	return 0;
 }
 
 /*
  * @brief 
- * Closes the target device, terminating communication.
- * @param cb 
+ * Closes the target device, terminating communication. The event generator stops and
+ * the status is unknown until the device is opened again.
  * @return int 0 on success, a negative value on failure.
  */
-int CloseDevice(void) {
+int MockDevice::Close() {
+	g_mock_scheduler.Remove(this);
+
+	m_mutex.lock();
+	m_cbFunc = NULL;
+	m_lpContext = NULL;
+	m_bOpen = false;
+	m_bReady = false;
+	m_ready.Reset();
+	Publish(false, WFS_ALM_DEVNODEVICE, FALSE);
+	m_mutex.unlock();
 	return 0;
 }
 
 /*
  * @brief 
- * Reset the target device
- * @param cb 
+ * Reset the target device. The status is unknown while the reset takes its ResetDelay
+ * milliseconds.
  * @return int 0 on success, a negative value on failure.
  */
-int ResetDevice(void) {
+int MockDevice::Reset() {
 	int rv = -1;
-	WaitForSingleObject(mutex, INFINITE);
-	
-    rv = 0;
+	m_mutex.lock();
+	Publish(false, WFS_ALM_DEVBUSY, FALSE);
+	if (m_dwResetDelay != 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(m_dwResetDelay));
 
-	ReleaseMutex(mutex);
+	rv = 0;
+
+	Publish(true, WFS_ALM_DEVONLINE, FALSE);
+
+	m_mutex.unlock();
 	return rv;
 }
 
 /*
  * @brief 
  * Reset alarm value
- * @param cb 
  * @return int 0 on success, a negative value on failure.
  */
-int ResetAlarm(void) {
+int MockDevice::ResetAlarm() {
 	int rv = -1;
-	WaitForSingleObject(mutex, INFINITE);
+	m_mutex.lock();
 
-    rv = 0;
+	rv = 0;
+	Publish(true, m_fwStatusDevice.load(std::memory_order_relaxed), FALSE);
 
-	ReleaseMutex(mutex);
+	m_mutex.unlock();
 	return rv;
 }
 
 /*
  * @brief 
- * Entry point for a thread that simulates alarm events from a mock device.
- * @param lpParam - A pointer to user-defined data passed to the thread.
- * @return int 0 on success, a negative value on failure.
+ * Reads the last published device status without taking the device mutex.
+ * @param lpStatus - Receives the status.
+ * @return int 0 on success, a negative value when no valid status is published yet.
  */
-static DWORD WINAPI MockDeviceAlarmLoop(LPVOID lpParam) {
-    int alarm = 0, data = 0;
-	while (1)
+int MockDevice::GetStatus(DEVICE_STATUS* lpStatus) {
+	DWORD seq;
+	bool bValid;
+	do
+	{
+		seq = m_dwStatusSeq.load(std::memory_order_acquire);
+		if (seq & 1)
+			continue;
+
+		bValid = m_bStatusValid.load(std::memory_order_relaxed);
+		lpStatus->fwDevice = m_fwStatusDevice.load(std::memory_order_relaxed);
+		lpStatus->bAlarmSet = m_bStatusAlarm.load(std::memory_order_relaxed);
+		lpStatus->wAntiFraudModule = m_wStatusAfm.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((seq & 1) || m_dwStatusSeq.load(std::memory_order_relaxed) != seq);
+
+	return bValid ? 0 : -1;
+}
+
+/*
+ * @brief 
+ * Reads the device status from the device, behind any device I/O in progress such as a
+ * reset, for when GetStatus has no valid snapshot. The read itself keeps the device busy
+ * for the StatusReadDelay milliseconds.
+ * @param lpStatus - Receives the status.
+ * @return int 0 on success, a negative value when no valid status is published yet.
+ */
+int MockDevice::ReadStatus(DEVICE_STATUS* lpStatus) {
+	m_mutex.lock();
+	if (m_dwStatusReadDelay != 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(m_dwStatusReadDelay));
+	int rv = GetStatus(lpStatus);
+	m_mutex.unlock();
+	return rv;
+}
+
+/*
+ * @brief 
+ * Brings the device online on its first deadline and emits every event that is due on
+ * the later ones. Called on the scheduler thread. The flapping pattern emits a SET
+ * immediately followed by a RESET with the same payload, the other patterns alternate
+ * between RESET and SET. The callbacks run after the device mutex is released;
+ * MockScheduler::Remove still waits for them.
+ * @param ullNowUs - The current scheduler time.
+ * @return ULONGLONG the deadline of the next event.
+ */
+ULONGLONG MockDevice::Fire(ULONGLONG ullNowUs) {
+	m_mutex.lock();
+
+	if (!m_bReady)
+	{
+		Publish(true, WFS_ALM_DEVONLINE, FALSE);
+		m_bReady = true;
+		m_ready.Set();
+
+		m_ullNextUs = ullNowUs + MockEventDelayUs(&m_config, m_rng, 0);
+		ULONGLONG ullFirstUs = m_ullNextUs;
+		m_mutex.unlock();
+		return ullFirstUs;
+	}
+
+	// Bound the batch so a generator that fell behind does not starve requests
+	// waiting for the device mutex, or the other devices of the scheduler.
+	MOCK_EVENT events[MOCK_MAX_BATCH];
+	int nEvents = 0;
+	while (nEvents < MOCK_MAX_BATCH && m_ullNextUs <= ullNowUs)
+	{
+		BOOL bSet;
+		if (m_config.dwPattern == MOCK_PATTERN_FLAPPING)
+			bSet = (m_ullEmitted % 2 == 0) ? TRUE : FALSE;
+		else
+			bSet = (m_nAlarm++ % 2) ? TRUE : FALSE;
+
+		Publish(true, WFS_ALM_DEVONLINE, bSet);
+		events[nEvents].evt = bSet ? WFS_SRVE_ALM_DEVICE_SET : WFS_SRVE_ALM_DEVICE_RESET;
+		events[nEvents].dwData = m_dwData;
+		nEvents++;
+
+		// A flapping SET shares its payload with the RESET that follows it.
+		if (m_config.dwPattern != MOCK_PATTERN_FLAPPING || !bSet)
+		{
+			if (m_config.dwPayloadCount != 0 && ++m_dwPayloadIndex >= m_config.dwPayloadCount)
+			{
+				m_dwPayloadIndex = 0;
+				m_dwData = m_config.dwPayloadStart;
+			}
+			else
+			{
+				m_dwData += m_config.dwPayloadStep;
+			}
+		}
+
+		m_ullEmitted++;
+		m_ullNextUs += MockEventDelayUs(&m_config, m_rng, m_ullEmitted - 1);
+	}
+
+	ULONGLONG ullNextUs = m_ullNextUs;
+	eventcb cbFunc = m_cbFunc;
+	LPVOID lpContext = m_lpContext;
+	m_mutex.unlock();
+
+	if (cbFunc)
 	{
-		Sleep(30000);
-		WaitForSingleObject(mutex, INFINITE);
+		for (int i = 0; i < nEvents; i++)
+			cbFunc(lpContext, events[i].evt, events[i].dwData);
+	}
+	return ullNextUs;
+}
 
-        if (alarm % 2) {
-            if (cbFunc)
-                cbFunc(WFS_SRVE_ALM_DEVICE_SET, data);
-        }
-        else {
-            if (cbFunc)
-                cbFunc(WFS_SRVE_ALM_DEVICE_RESET, data);
-        }
+MockScheduler::MockScheduler() : m_mutex("MockScheduler")
+{
+	m_lpFiring = NULL;
+	m_bFiringRemoved = false;
+	m_bRunning = false;
+}
+
+MockScheduler::~MockScheduler()
+{
+	Stop();
+}
 
-       
+/*
+ * @brief 
+ * Starts the scheduler thread. Calling it on a running scheduler does nothing.
+ * @return int 0 on success, a negative value on failure.
+ */
+int MockScheduler::Start()
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+	if (m_bRunning)
+		return 0;
 
-        alarm++;
-        data++;
+	if (m_thread.joinable())
+		m_thread.join();
 
-		ReleaseMutex(mutex);
+	try
+	{
+		m_thread = std::thread(&MockScheduler::ServiceLoop, this);
+	}
+	catch (...)
+	{
+		return -1;
 	}
 
+	m_bRunning = true;
 	return 0;
-}
\ No newline at end of file
+}
+
+/*
+ * @brief 
+ * Stops and joins the scheduler thread. Queued devices stay queued and resume when
+ * the scheduler is started again.
+ */
+void MockScheduler::Stop()
+{
+	{
+		std::lock_guard<SpMutex> lock(m_mutex);
+		if (!m_bRunning)
+			return;
+		m_bRunning = false;
+	}
+	m_cond.NotifyAll();
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+/*
+ * @brief 
+ * Queues a device until its next deadline. A device is queued at most once.
+ * @param device - The device.
+ * @param ullDueUs - Deadline of its next event, on the MockClockUs() clock.
+ */
+void MockScheduler::Add(MockDevice* device, ULONGLONG ullDueUs)
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+	if (device->m_ullQueuedUs != 0 || device == m_lpFiring)
+		return;
+
+	if (ullDueUs == 0)
+		ullDueUs = 1;
+	device->m_ullQueuedUs = ullDueUs;
+	m_queue.insert(std::make_pair(ullDueUs, device));
+
+	if (m_queue.begin()->second == device)
+		m_cond.NotifyAll();
+}
+
+/*
+ * @brief 
+ * Takes a device off the scheduler. When its events are being emitted, waits until
+ * they are, so the device may be released once this returns.
+ * @param device - The device.
+ */
+void MockScheduler::Remove(MockDevice* device)
+{
+	std::unique_lock<SpMutex> lock(m_mutex);
+	if (device->m_ullQueuedUs != 0)
+	{
+		m_queue.erase(std::make_pair(device->m_ullQueuedUs, device));
+		device->m_ullQueuedUs = 0;
+	}
+
+	if (m_lpFiring == device)
+	{
+		m_bFiringRemoved = true;
+		while (m_lpFiring == device)
+			m_cond.Wait(lock);
+	}
+}
+
+/*
+ * @brief 
+ * Body of the scheduler thread.
+ */
+void MockScheduler::ServiceLoop()
+{
+	std::unique_lock<SpMutex> lock(m_mutex);
+	while (m_bRunning)
+	{
+		if (m_queue.empty())
+		{
+			m_cond.Wait(lock);
+			continue;
+		}
+
+		ULONGLONG ullNowUs = MockClockUs();
+		std::set<std::pair<ULONGLONG, MockDevice*> >::iterator it = m_queue.begin();
+		if (it->first > ullNowUs)
+		{
+			DWORD dwSleepMs = (DWORD)((it->first - ullNowUs) / 1000);
+			m_cond.Wait(lock, dwSleepMs ? dwSleepMs : 1);
+			continue;
+		}
+
+		MockDevice* device = it->second;
+		m_queue.erase(it);
+		device->m_ullQueuedUs = 0;
+		m_lpFiring = device;
+		m_bFiringRemoved = false;
+		lock.unlock();
+
+		ULONGLONG ullNextUs = device->Fire(ullNowUs);
+
+		lock.lock();
+		m_lpFiring = NULL;
+		if (m_bFiringRemoved)
+		{
+			m_cond.NotifyAll();
+			continue;
+		}
+
+		device->m_ullQueuedUs = ullNextUs ? ullNextUs : 1;
+		m_queue.insert(std::make_pair(device->m_ullQueuedUs, device));
+	}
+}
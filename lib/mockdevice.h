@@ -16,10 +16,152 @@
  */
 
 #pragma once
+#include <set>
+#include <thread>
+#include <random>
+#include <atomic>
+#include "sync.h"
 
-typedef int (*eventcb)(int, int);
+typedef int (*eventcb)(LPVOID, int, int);
 
-int OpenDevice(eventcb cb);
-int CloseDevice(void);
-int ResetDevice(void);
-int ResetAlarm(void);
\ No newline at end of file
+#define MOCK_PATTERN_STEADY 0
+#define MOCK_PATTERN_BURSTY 1
+#define MOCK_PATTERN_POISSON 2
+#define MOCK_PATTERN_FLAPPING 3
+
+#define MOCK_DEFAULT_PERIOD_MS 30000
+#define MOCK_MAX_EVENT_RATE 100000
+#define MOCK_DEFAULT_OPEN_TIMEOUT 10000
+#define MOCK_MAX_BATCH 1024
+
+/*
+ * @brief 
+ * Alarm event generator settings, read from the SP configuration key when the device
+ * opens. dwRate is in events per second; 0 keeps the historical one event every
+ * MOCK_DEFAULT_PERIOD_MS. Payloads run from dwPayloadStart in steps of dwPayloadStep,
+ * wrapping after dwPayloadCount values when it is not 0.
+ */
+struct MOCK_EVENT_CONFIG {
+	DWORD dwPattern;
+	DWORD dwRate;
+	DWORD dwBurstSize;
+	DWORD dwPayloadStart;
+	DWORD dwPayloadStep;
+	DWORD dwPayloadCount;
+	DWORD dwSeed;
+};
+
+/*
+ * @brief 
+ * Device state as last published by the device layer.
+ */
+struct DEVICE_STATUS {
+	WORD fwDevice;
+	BOOL bAlarmSet;
+	WORD wAntiFraudModule;
+};
+
+/*
+ * @brief 
+ * One generated event, kept until the device mutex is released.
+ */
+struct MOCK_EVENT {
+	int evt;
+	DWORD dwData;
+};
+
+class MockScheduler;
+
+/*
+ * @brief 
+ * One simulated alarm device. Any number of devices can live in a process; their
+ * start-up and alarm events are run on the shared scheduler thread instead of a thread
+ * each.
+ */
+class MockDevice
+{
+public:
+	MockDevice();
+	~MockDevice();
+
+	int Open(eventcb cb, LPVOID lpContext);
+	int Close();
+	int Reset();
+	int ResetAlarm();
+	int GetStatus(DEVICE_STATUS* lpStatus);
+	int ReadStatus(DEVICE_STATUS* lpStatus);
+
+private:
+	friend class MockScheduler;
+
+	MockDevice(const MockDevice&);
+	MockDevice& operator=(const MockDevice&);
+
+	void Publish(bool bValid, WORD fwDevice, BOOL bAlarmSet);
+	ULONGLONG Fire(ULONGLONG ullNowUs);
+
+	SpMutex m_mutex;
+	eventcb m_cbFunc;
+	LPVOID m_lpContext;
+	bool m_bOpen;
+
+	// Time a status read and a reset spend on the simulated device, read when the
+	// device opens.
+	DWORD m_dwStatusReadDelay;
+	DWORD m_dwResetDelay;
+
+	// Signaled by the scheduler thread once the device came up.
+	SpEvent m_ready;
+	bool m_bReady;
+
+	// Status snapshot, see Publish().
+	std::atomic<DWORD> m_dwStatusSeq;
+	std::atomic<bool> m_bStatusValid;
+	std::atomic<WORD> m_fwStatusDevice;
+	std::atomic<BOOL> m_bStatusAlarm;
+	std::atomic<WORD> m_wStatusAfm;
+
+	// Event generator, used by the scheduler thread with m_mutex held.
+	MOCK_EVENT_CONFIG m_config;
+	std::minstd_rand m_rng;
+	ULONGLONG m_ullEmitted;
+	ULONGLONG m_ullNextUs;
+	int m_nAlarm;
+	DWORD m_dwData;
+	DWORD m_dwPayloadIndex;
+
+	// Deadline the device is queued under in the scheduler, 0 when it is not queued.
+	// Guarded by the scheduler mutex.
+	ULONGLONG m_ullQueuedUs;
+};
+
+/*
+ * @brief 
+ * Single thread driving the event generators of every open device. Devices are kept
+ * ordered by their next deadline; the thread sleeps until the earliest one and lets
+ * that device emit the events that are due.
+ */
+class MockScheduler
+{
+public:
+	MockScheduler();
+	~MockScheduler();
+
+	int Start();
+	void Stop();
+	void Add(MockDevice* device, ULONGLONG ullDueUs);
+	void Remove(MockDevice* device);
+
+private:
+	void ServiceLoop();
+
+	SpMutex m_mutex;
+	SpCondition m_cond;
+	std::set<std::pair<ULONGLONG, MockDevice*> > m_queue;
+	MockDevice* m_lpFiring;
+	bool m_bFiringRemoved;
+	std::thread m_thread;
+	bool m_bRunning;
+};
+
+extern MockScheduler g_mock_scheduler;
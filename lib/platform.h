@@ -0,0 +1,100 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#include <xfsapi.h>
+
+/*
+ * Services the SP core takes from the platform it runs on. The Windows DLL implements
+ * them on Win32 and the registry (platform_win32.cpp); other builds take them from the
+ * in-process XFS manager stand-in. Threads and locks are std::thread and sync.h, and
+ * result blocks are allocated with the WFM* functions of the XFS manager, so neither
+ * appears here.
+ */
+
+/*
+ * @brief 
+ * Tells whether a window handle passed by the application can receive messages.
+ * @param hWnd - The window handle.
+ * @return BOOL TRUE if it is a window.
+ */
+BOOL PlatformIsWindow(HWND hWnd);
+
+/*
+ * @brief 
+ * Delivers a completion or event message and waits until the window processed it.
+ * @param hWnd - The destination window.
+ * @param uMessage - The WFS_* message.
+ * @param lpWFSResult - The result block, owned by the receiver once delivered.
+ */
+void PlatformSendMessage(HWND hWnd, UINT uMessage, LPWFSRESULT lpWFSResult);
+
+/*
+ * @brief 
+ * Delivers a completion or event message and waits a limited time for the window to
+ * process it.
+ * @param hWnd - The destination window.
+ * @param uMessage - The WFS_* message.
+ * @param lpWFSResult - The result block, owned by the receiver once delivered.
+ * @param dwTimeOut - Milliseconds to wait for the window.
+ * @return BOOL TRUE if the window processed the message in time. A message that timed
+ *	out may still be processed later, so the caller gives up the block either way.
+ */
+BOOL PlatformSendMessageTimeout(HWND hWnd, UINT uMessage, LPWFSRESULT lpWFSResult, DWORD dwTimeOut);
+
+/*
+ * @brief 
+ * Queues a completion or event message for a window and returns at once.
+ * @param hWnd - The destination window.
+ * @param uMessage - The WFS_* message.
+ * @param lpWFSResult - The result block, owned by the receiver once queued.
+ * @return BOOL TRUE if the message was queued; the caller keeps the block otherwise.
+ */
+BOOL PlatformPostMessage(HWND hWnd, UINT uMessage, LPWFSRESULT lpWFSResult);
+
+/*
+ * @brief 
+ * Monotonic milliseconds clock.
+ * @return ULONGLONG milliseconds from an arbitrary origin.
+ */
+ULONGLONG PlatformTickCount(void);
+
+/*
+ * @brief 
+ * Writes a diagnostic line where the platform collects them.
+ * @param lpszText - The null-terminated text.
+ */
+void PlatformDebugOutput(LPCSTR lpszText);
+
+/*
+ * @brief 
+ * Reads a DWORD setting of the service provider.
+ * @param lpszValueName - Name of the setting.
+ * @param lpdwValue - Receives the value.
+ * @return BOOL TRUE if the setting exists with this type.
+ */
+BOOL PlatformConfigGetDword(LPCSTR lpszValueName, LPDWORD lpdwValue);
+
+/*
+ * @brief 
+ * Reads a string setting of the service provider.
+ * @param lpszValueName - Name of the setting.
+ * @param lpszBuffer - Receives the null-terminated value.
+ * @param dwSize - Size of lpszBuffer in bytes.
+ * @return BOOL TRUE if the setting exists with this type and fits.
+ */
+BOOL PlatformConfigGetString(LPCSTR lpszValueName, LPSTR lpszBuffer, DWORD dwSize);
@@ -0,0 +1,66 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "pch.h"
+#include "platform.h"
+#include "config.h"
+
+BOOL PlatformIsWindow(HWND hWnd)
+{
+	WINDOWINFO callWindow;
+	callWindow.cbSize = sizeof(WINDOWINFO);
+	if (hWnd == NULL || (!GetWindowInfo(hWnd, &callWindow) && (GetLastError() == ERROR_INVALID_HANDLE)))
+		return FALSE;
+
+	return TRUE;
+}
+
+void PlatformSendMessage(HWND hWnd, UINT uMessage, LPWFSRESULT lpWFSResult)
+{
+	SendMessage(hWnd, uMessage, 0, (LPARAM)lpWFSResult);
+}
+
+BOOL PlatformSendMessageTimeout(HWND hWnd, UINT uMessage, LPWFSRESULT lpWFSResult, DWORD dwTimeOut)
+{
+	return SendMessageTimeout(hWnd, uMessage, 0, (LPARAM)lpWFSResult, SMTO_ABORTIFHUNG, dwTimeOut, NULL) != 0;
+}
+
+BOOL PlatformPostMessage(HWND hWnd, UINT uMessage, LPWFSRESULT lpWFSResult)
+{
+	return PostMessage(hWnd, uMessage, 0, (LPARAM)lpWFSResult);
+}
+
+ULONGLONG PlatformTickCount(void)
+{
+	return GetTickCount64();
+}
+
+void PlatformDebugOutput(LPCSTR lpszText)
+{
+	OutputDebugStringA(lpszText);
+}
+
+BOOL PlatformConfigGetDword(LPCSTR lpszValueName, LPDWORD lpdwValue)
+{
+	DWORD dwSize = sizeof(*lpdwValue);
+	return RegGetValueA(HKEY_LOCAL_MACHINE, SP_CONFIG_KEY, lpszValueName, RRF_RT_REG_DWORD, NULL, lpdwValue, &dwSize) == ERROR_SUCCESS;
+}
+
+BOOL PlatformConfigGetString(LPCSTR lpszValueName, LPSTR lpszBuffer, DWORD dwSize)
+{
+	return RegGetValueA(HKEY_LOCAL_MACHINE, SP_CONFIG_KEY, lpszValueName, RRF_RT_REG_SZ, NULL, lpszBuffer, &dwSize) == ERROR_SUCCESS;
+}
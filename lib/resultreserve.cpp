@@ -0,0 +1,263 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "pch.h"
+#include "resultreserve.h"
+#include "capabilities.h"
+#include "workerpool.h"
+#include <stddef.h>
+
+ResultReserve g_result_reserve;
+
+// The inline payload starts at the first suitably aligned offset after the head.
+static const ULONG g_result_payload_offset =
+	(ULONG)((sizeof(RESULT_BLOCK) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1));
+
+static const ULONG g_result_payload_sizes[RESULT_CLASSES] = {
+	sizeof(DWORD),
+	sizeof(WFSALMSTATUS),
+	sizeof(CAPS_IMAGE),
+};
+
+ResultReserve::ResultReserve() : m_mutex("ResultReserve")
+{
+	m_dwSize = 0;
+	m_bRunning = false;
+	m_bRefilling = false;
+	m_dwHits = 0;
+	m_dwMisses = 0;
+	m_dwRefills = 0;
+	m_dwReserved = 0;
+	m_dwPayloadOverflows = 0;
+}
+
+ResultReserve::~ResultReserve()
+{
+	Stop();
+}
+
+/*
+ * @brief 
+ * Returns the size of the WFM buffer backing a block of a class.
+ * @param eClass - The block class.
+ * @return ULONG the size in bytes, head included.
+ */
+ULONG ResultReserve::BlockSize(RESULT_CLASS eClass)
+{
+	return g_result_payload_offset + g_result_payload_sizes[eClass];
+}
+
+/*
+ * @brief 
+ * Allocates a zero-initialised block of a class from the XFS manager.
+ * @param eClass - The block class.
+ * @param lppBlock - Receives the block.
+ * @return HRESULT - WFS_SUCCESS on success, the WFMAllocateBuffer error on failure.
+ */
+HRESULT ResultReserve::AllocateBlock(RESULT_CLASS eClass, RESULT_BLOCK** lppBlock)
+{
+	HRESULT hResult = WFMAllocateBuffer(BlockSize(eClass), WFS_MEM_SHARE | WFS_MEM_ZEROINIT, (LPVOID*)lppBlock);
+	if (hResult != WFS_SUCCESS)
+		return hResult;
+
+	(*lppBlock)->dwPayloadSize = g_result_payload_sizes[eClass];
+	return WFS_SUCCESS;
+}
+
+/*
+ * @brief 
+ * Allocates the initial stocks. Calling it on a running reserve does nothing.
+ * @param dwSize - Number of blocks kept in stock per class, 0 selects RESULT_RESERVE_DEFAULT_SIZE.
+ * @return int 0 on success, a negative value on failure.
+ */
+int ResultReserve::Start(DWORD dwSize)
+{
+	{
+		std::lock_guard<SpMutex> lock(m_mutex);
+		if (m_bRunning)
+			return 0;
+
+		if (dwSize == 0)
+			dwSize = RESULT_RESERVE_DEFAULT_SIZE;
+
+		try
+		{
+			for (int i = 0; i < RESULT_CLASSES; i++)
+				m_stock[i].reserve(dwSize);
+		}
+		catch (...)
+		{
+			return -1;
+		}
+
+		m_dwSize = dwSize;
+		m_bRunning = true;
+	}
+
+	Refill();
+	return 0;
+}
+
+/*
+ * @brief 
+ * Gives the blocks still in stock back to the XFS manager.
+ */
+void ResultReserve::Stop()
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+	if (!m_bRunning)
+		return;
+
+	for (int i = 0; i < RESULT_CLASSES; i++)
+	{
+		for (size_t j = 0; j < m_stock[i].size(); j++)
+			WFMFreeBuffer(m_stock[i][j]);
+		m_stock[i].clear();
+	}
+	m_bRunning = false;
+}
+
+/*
+ * @brief 
+ * Hands out a zero-initialised result block. The block belongs to the application
+ * once it is sent, so it never comes back to the reserve.
+ * @param lppResult - Receives the result block.
+ * @param eClass - The block class, chosen for the payload the result will carry.
+ * @return HRESULT - WFS_SUCCESS on success, the WFMAllocateBuffer error when the stock is
+ *                  empty and the fallback allocation fails.
+ */
+HRESULT ResultReserve::Allocate(LPWFSRESULT* lppResult, RESULT_CLASS eClass)
+{
+	RESULT_BLOCK* block = NULL;
+	bool bRefill = false;
+	{
+		std::lock_guard<SpMutex> lock(m_mutex);
+		std::vector<RESULT_BLOCK*>& stock = m_stock[eClass];
+		if (!stock.empty())
+		{
+			block = stock.back();
+			stock.pop_back();
+		}
+
+		if (m_bRunning && stock.size() < m_dwSize / 4 + 1 && !m_bRefilling.exchange(true))
+			bRefill = true;
+	}
+
+	if (bRefill && g_worker_pool.Submit(RefillProcess, this) != 0)
+		m_bRefilling = false;
+
+	if (block == NULL)
+	{
+		m_dwMisses++;
+		HRESULT hResult = AllocateBlock(eClass, &block);
+		if (hResult != WFS_SUCCESS)
+			return hResult;
+	}
+	else
+	{
+		m_dwHits++;
+	}
+
+	*lppResult = &block->result;
+	return WFS_SUCCESS;
+}
+
+/*
+ * @brief 
+ * Attaches a payload to a result obtained from Allocate(). The payload lives inside the
+ * block when it fits the block class, otherwise it is allocated with WFMAllocateMore.
+ * A result carries at most one payload.
+ * @param lpResult - Result returned by Allocate().
+ * @param ulSize - Size of the payload in bytes.
+ * @param lppData - Receives the zero-initialised payload.
+ * @return HRESULT - WFS_SUCCESS on success, the WFMAllocateMore error on failure.
+ */
+HRESULT ResultReserve::AllocatePayload(LPWFSRESULT lpResult, ULONG ulSize, LPVOID* lppData)
+{
+	RESULT_BLOCK* block = (RESULT_BLOCK*)lpResult;
+	if (ulSize > block->dwPayloadSize)
+	{
+		m_dwPayloadOverflows++;
+		return WFMAllocateMore(ulSize, lpResult, lppData);
+	}
+
+	*lppData = (char*)block + g_result_payload_offset;
+	return WFS_SUCCESS;
+}
+
+/*
+ * @brief 
+ * Reads the allocation counters.
+ * @param lpCounters - Receives the counters.
+ */
+void ResultReserve::GetCounters(RESULT_RESERVE_COUNTERS* lpCounters)
+{
+	lpCounters->dwHits = m_dwHits;
+	lpCounters->dwMisses = m_dwMisses;
+	lpCounters->dwRefills = m_dwRefills;
+	lpCounters->dwReserved = m_dwReserved;
+	lpCounters->dwPayloadOverflows = m_dwPayloadOverflows;
+}
+
+/*
+ * @brief 
+ * Worker pool task that tops the stocks up.
+ * @param lpParam - The ResultReserve to refill.
+ * @return int 0 on success, a negative value on failure.
+ */
+DWORD WINAPI ResultReserve::RefillProcess(LPVOID lpParam)
+{
+	((ResultReserve*)lpParam)->Refill();
+	return 0;
+}
+
+/*
+ * @brief 
+ * Allocates blocks outside the lock until every stock is full again.
+ */
+void ResultReserve::Refill()
+{
+	m_dwRefills++;
+
+	for (int i = 0; i < RESULT_CLASSES; i++)
+	{
+		RESULT_CLASS eClass = (RESULT_CLASS)i;
+		for (;;)
+		{
+			{
+				std::lock_guard<SpMutex> lock(m_mutex);
+				if (!m_bRunning || m_stock[i].size() >= m_dwSize)
+					break;
+			}
+
+			RESULT_BLOCK* block;
+			if (AllocateBlock(eClass, &block) != WFS_SUCCESS)
+				break;
+
+			std::lock_guard<SpMutex> lock(m_mutex);
+			if (!m_bRunning || m_stock[i].size() >= m_dwSize)
+			{
+				WFMFreeBuffer(block);
+				break;
+			}
+			m_stock[i].push_back(block);
+			m_dwReserved++;
+		}
+	}
+
+	m_bRefilling = false;
+}
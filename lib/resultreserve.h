@@ -0,0 +1,99 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#include <xfsalm.h>
+#include <xfsspi.h>
+#include <mutex>
+#include "sync.h"
+#include <atomic>
+#include <vector>
+
+#define RESULT_RESERVE_DEFAULT_SIZE 64
+
+/*
+ * @brief 
+ * Block classes, sized for the payload each kind of result carries inline.
+ */
+enum RESULT_CLASS {
+	RESULT_CLASS_SMALL,		// completions without data, events (one DWORD)
+	RESULT_CLASS_STATUS,	// WFS_INF_ALM_STATUS
+	RESULT_CLASS_CAPS,		// WFS_INF_ALM_CAPABILITIES
+	RESULT_CLASSES
+};
+
+/*
+ * @brief 
+ * Head of a reserved WFM buffer. The WFSRESULT comes first so that the application
+ * releases the whole block, payload included, with WFSFreeResult. The inline payload
+ * follows the head.
+ */
+struct RESULT_BLOCK {
+	WFSRESULT result;
+	DWORD dwPayloadSize;
+};
+
+struct RESULT_RESERVE_COUNTERS {
+	DWORD dwHits;
+	DWORD dwMisses;
+	DWORD dwRefills;
+	DWORD dwReserved;
+	DWORD dwPayloadOverflows;
+};
+
+/*
+ * @brief 
+ * Zero-initialised result blocks allocated ahead of time from the XFS manager, one stock
+ * per block class. A block belongs to the application once it is sent and is released
+ * with WFSFreeResult, so blocks are never recycled: the reserve only moves the
+ * WFMAllocateBuffer call off the request path, and each stock is topped up from the
+ * worker pool whenever it falls below a quarter of its size.
+ */
+class ResultReserve
+{
+public:
+	ResultReserve();
+	~ResultReserve();
+
+	int Start(DWORD dwSize);
+	void Stop();
+
+	HRESULT Allocate(LPWFSRESULT* lppResult, RESULT_CLASS eClass = RESULT_CLASS_SMALL);
+	HRESULT AllocatePayload(LPWFSRESULT lpResult, ULONG ulSize, LPVOID* lppData);
+	void GetCounters(RESULT_RESERVE_COUNTERS* lpCounters);
+
+	static ULONG BlockSize(RESULT_CLASS eClass);
+
+private:
+	static DWORD WINAPI RefillProcess(LPVOID lpParam);
+	void Refill();
+	static HRESULT AllocateBlock(RESULT_CLASS eClass, RESULT_BLOCK** lppBlock);
+
+	SpMutex m_mutex;
+	std::vector<RESULT_BLOCK*> m_stock[RESULT_CLASSES];
+	DWORD m_dwSize;
+	bool m_bRunning;
+	std::atomic<bool> m_bRefilling;
+
+	std::atomic<DWORD> m_dwHits;
+	std::atomic<DWORD> m_dwMisses;
+	std::atomic<DWORD> m_dwRefills;
+	std::atomic<DWORD> m_dwReserved;
+	std::atomic<DWORD> m_dwPayloadOverflows;
+};
+
+extern ResultReserve g_result_reserve;
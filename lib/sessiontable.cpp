@@ -0,0 +1,194 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "pch.h"
+#include "sessiontable.h"
+
+SessionTable g_session_table;
+
+SessionTable::SessionTable() : m_mutex("SessionTable")
+{
+	for (int i = 0; i < SESSION_TABLE_CAPACITY; i++)
+	{
+		m_slots[i].lState = SESSION_FREE;
+		m_slots[i].dwGeneration = 0;
+		m_slots[i].hService = 0;
+		m_slots[i].bUsed = false;
+		m_slots[i].lpLane = NULL;
+		m_slots[i].lpDevice = NULL;
+		m_slots[i].lPendingExecutes = 0;
+		m_slots[i].dwExecuteRequests = 0;
+		m_slots[i].dwInfoRequests = 0;
+		m_slots[i].dwCancelRequests = 0;
+		m_slots[i].lpRequests = NULL;
+	}
+}
+
+/*
+ * @brief 
+ * Opens a session. The execute lane of a reused slot is kept.
+ * @param hService - Handle of the session.
+ * @param lppSession - Receives the session.
+ * @param lpdwGeneration - Optionally receives the generation of the session.
+ * @param lpDevice - Device of the session, set before the session can be found.
+ * @return HRESULT - WFS_SUCCESS on success, WFS_ERR_INVALID_HSERVICE when the handle is
+ *                  already open, WFS_ERR_OUT_OF_MEMORY when the table is full.
+ */
+HRESULT SessionTable::Insert(HSERVICE hService, SESSION** lppSession, DWORD* lpdwGeneration, WFS_DEVICE* lpDevice)
+{
+	if (hService == 0)
+		return WFS_ERR_INVALID_HSERVICE;
+
+	std::lock_guard<SpMutex> lock(m_mutex);
+	if (Find(hService) != NULL)
+		return WFS_ERR_INVALID_HSERVICE;
+
+	for (DWORD i = 0; i < SESSION_TABLE_CAPACITY; i++)
+	{
+		SESSION* session = &m_slots[(hService + i) & (SESSION_TABLE_CAPACITY - 1)];
+
+		LONG lExpected = SESSION_FREE;
+		if (!session->lState.compare_exchange_strong(lExpected, SESSION_BUSY))
+			continue;
+
+		DWORD dwGeneration = ++session->dwGeneration;
+		session->hService.store(hService, std::memory_order_relaxed);
+		session->lpDevice = lpDevice;
+		session->dwExecuteRequests = 0;
+		session->dwInfoRequests = 0;
+		session->dwCancelRequests = 0;
+		session->bUsed.store(true);
+		session->lState.store(SESSION_OPEN);
+
+		*lppSession = session;
+		if (lpdwGeneration != NULL)
+			*lpdwGeneration = dwGeneration;
+		return WFS_SUCCESS;
+	}
+
+	return WFS_ERR_OUT_OF_MEMORY;
+}
+
+/*
+ * @brief 
+ * Looks an open session up without locking.
+ * @param hService - Handle of the session.
+ * @param lpdwGeneration - Optionally receives the generation of the session.
+ * @return SESSION* - The session, NULL when it is not open.
+ */
+SESSION* SessionTable::Find(HSERVICE hService, DWORD* lpdwGeneration)
+{
+	if (hService == 0)
+		return NULL;
+
+	for (DWORD i = 0; i < SESSION_TABLE_CAPACITY; i++)
+	{
+		SESSION* session = &m_slots[(hService + i) & (SESSION_TABLE_CAPACITY - 1)];
+		if (!session->bUsed.load())
+			return NULL;
+
+		DWORD dwGeneration = session->dwGeneration.load();
+		if (session->lState.load() != SESSION_OPEN
+			|| session->hService.load(std::memory_order_relaxed) != hService)
+			continue;
+
+		if (session->dwGeneration.load() != dwGeneration)
+			continue;
+
+		if (lpdwGeneration != NULL)
+			*lpdwGeneration = dwGeneration;
+		return session;
+	}
+
+	return NULL;
+}
+
+/*
+ * @brief 
+ * Tells whether a session found earlier is still open and has not been reused.
+ * @param session - The session returned by Find() or Insert().
+ * @param dwGeneration - The generation returned with it.
+ * @return BOOL TRUE if the session is still the same open session.
+ */
+BOOL SessionTable::IsCurrent(SESSION* session, DWORD dwGeneration)
+{
+	return session->lState.load() == SESSION_OPEN && session->dwGeneration.load() == dwGeneration;
+}
+
+/*
+ * @brief 
+ * Ends a session found earlier. From then on lookups and IsCurrent fail, but the slot
+ * is not reused until Free is called, so the caller can tear the session down. Only one
+ * caller detaches a given session.
+ * @param session - The session returned by Find() or Insert().
+ * @param dwGeneration - The generation returned with it.
+ * @return BOOL TRUE if the caller detached the session, FALSE if it was no longer the
+ *         same open session.
+ */
+BOOL SessionTable::Detach(SESSION* session, DWORD dwGeneration)
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+	if (session->dwGeneration.load() != dwGeneration)
+		return FALSE;
+
+	LONG lExpected = SESSION_OPEN;
+	if (!session->lState.compare_exchange_strong(lExpected, SESSION_BUSY))
+		return FALSE;
+
+	session->dwGeneration++;
+	return TRUE;
+}
+
+/*
+ * @brief 
+ * Makes the slot of a detached session available to Insert again.
+ * @param session - The session, detached by the caller.
+ */
+void SessionTable::Free(SESSION* session)
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+	session->lState.store(SESSION_FREE);
+}
+
+/*
+ * @brief 
+ * Closes a session with nothing to tear down. Handles kept from before the close no
+ * longer validate.
+ * @param hService - Handle of the session.
+ * @return BOOL TRUE if the session was open.
+ */
+BOOL SessionTable::Remove(HSERVICE hService)
+{
+	DWORD dwGeneration;
+	SESSION* session = Find(hService, &dwGeneration);
+	if (session == NULL || !Detach(session, dwGeneration))
+		return FALSE;
+
+	Free(session);
+	return TRUE;
+}
+
+/*
+ * @brief 
+ * Gives access to a slot whatever its state, for walking every session.
+ * @param dwIndex - Slot index, below SESSION_TABLE_CAPACITY.
+ * @return SESSION* - The slot; check lState before using it.
+ */
+SESSION* SessionTable::At(DWORD dwIndex)
+{
+	return &m_slots[dwIndex];
+}
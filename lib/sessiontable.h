@@ -0,0 +1,103 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#include <xfsapi.h>
+#include <atomic>
+#include <map>
+#include "sync.h"
+
+#define SESSION_TABLE_CAPACITY 256
+
+#define SESSION_FREE 0
+#define SESSION_BUSY 1
+#define SESSION_OPEN 2
+
+struct WFS_LANE;
+struct WFS_DEVICE;
+struct WFS_MSG;
+
+/*
+ * @brief 
+ * Event registration of one window on a session. The device is taken when the window
+ * registers, so the event table is built without reading the session's device.
+ */
+struct SESSION_REGISTRATION {
+	DWORD dwEventClass;
+	WFS_DEVICE* lpDevice;
+};
+
+/*
+ * @brief 
+ * Slot of the session table, holding everything the SP keeps for one HSERVICE so a call
+ * fetches its state with a single lookup. dwGeneration changes every time the slot is
+ * opened or closed, so a session remembered with its generation can tell whether it is
+ * still the same session. Slots are cache-line aligned so sessions used by different
+ * threads do not share lines.
+ */
+struct alignas(64) SESSION {
+	std::atomic<LONG> lState;
+	std::atomic<DWORD> dwGeneration;
+	std::atomic<HSERVICE> hService;
+	std::atomic<bool> bUsed;
+
+	WFS_LANE* lpLane;
+	std::atomic<LONG> lPendingExecutes;
+
+	// Device of the logical service the session was opened on, set by Insert.
+	WFS_DEVICE* lpDevice;
+
+	// Requests issued since the session opened, see WFPQuerySessionCounters.
+	std::atomic<DWORD> dwExecuteRequests;
+	std::atomic<DWORD> dwInfoRequests;
+	std::atomic<DWORD> dwCancelRequests;
+
+	// Requests queued on the worker pool or a status flight and not released yet, so
+	// they can be cancelled. Guarded by requestMutex.
+	SpMutex requestMutex{"SESSION.requestMutex"};
+	WFS_MSG* lpRequests;
+
+	// Registration per window, guarded by g_wfs_event_mutex.
+	std::map<HWND, SESSION_REGISTRATION> registrations;
+};
+
+/*
+ * @brief 
+ * Fixed-capacity open-addressed table of open sessions. Lookups never lock; opening and
+ * closing are serialized by the table mutex, so one handle is never open twice. Closed
+ * slots stay in the probe chain and are reused by later opens. A session is closed in
+ * two steps, Detach and Free, so its state can be torn down before the slot is reused.
+ */
+class SessionTable
+{
+public:
+	SessionTable();
+
+	HRESULT Insert(HSERVICE hService, SESSION** lppSession, DWORD* lpdwGeneration = NULL, WFS_DEVICE* lpDevice = NULL);
+	SESSION* Find(HSERVICE hService, DWORD* lpdwGeneration = NULL);
+	BOOL IsCurrent(SESSION* session, DWORD dwGeneration);
+	BOOL Detach(SESSION* session, DWORD dwGeneration);
+	void Free(SESSION* session);
+	BOOL Remove(HSERVICE hService);
+	SESSION* At(DWORD dwIndex);
+
+private:
+	SpMutex m_mutex;
+	SESSION m_slots[SESSION_TABLE_CAPACITY];
+};
+
+extern SessionTable g_session_table;
@@ -0,0 +1,369 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "pch.h"
+#include "sync.h"
+#include "platform.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+/*
+ * Counters shared by every lock created with the same name. They are never freed, so
+ * a lock may outlive WFPUnloadService.
+ */
+struct SP_LOCK_COUNTERS {
+	CHAR szName[SP_LOCK_NAME_SIZE];
+	std::atomic<ULONGLONG> ullAcquires;
+	std::atomic<ULONGLONG> ullContended;
+	std::atomic<ULONGLONG> ullTotalWaitUs;
+	std::atomic<ULONGLONG> ullMaxHoldUs;
+	std::atomic<ULONGLONG> ullWaitHistogram[SP_LOCK_HISTOGRAM_BUCKETS];
+};
+
+static std::atomic<bool> g_lock_stats_enabled(false);
+
+/*
+ * @brief 
+ * Registry of the lock names. Built on first use because locks are also constructed
+ * during static initialization.
+ */
+static std::vector<SP_LOCK_COUNTERS*>& SpLockRegistry(std::mutex** lppMutex)
+{
+	static std::mutex mutex;
+	static std::vector<SP_LOCK_COUNTERS*> registry;
+	*lppMutex = &mutex;
+	return registry;
+}
+
+static SP_LOCK_COUNTERS* SpLockCounters(LPCSTR lpszName)
+{
+	std::mutex* lpMutex;
+	std::vector<SP_LOCK_COUNTERS*>& registry = SpLockRegistry(&lpMutex);
+	std::lock_guard<std::mutex> lock(*lpMutex);
+
+	for (size_t i = 0; i < registry.size(); i++)
+	{
+		if (strncmp(registry[i]->szName, lpszName, SP_LOCK_NAME_SIZE - 1) == 0)
+			return registry[i];
+	}
+
+	SP_LOCK_COUNTERS* counters = new SP_LOCK_COUNTERS();
+	size_t nLength = strnlen(lpszName, SP_LOCK_NAME_SIZE - 1);
+	memcpy(counters->szName, lpszName, nLength);
+	counters->szName[nLength] = '\0';
+	counters->ullAcquires = 0;
+	counters->ullContended = 0;
+	counters->ullTotalWaitUs = 0;
+	counters->ullMaxHoldUs = 0;
+	for (int i = 0; i < SP_LOCK_HISTOGRAM_BUCKETS; i++)
+		counters->ullWaitHistogram[i] = 0;
+
+	registry.push_back(counters);
+	return counters;
+}
+
+static ULONGLONG SpLockClockUs()
+{
+	return (ULONGLONG)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * @brief 
+ * Turns lock statistics on or off at run time.
+ * @param bEnable - TRUE to record acquires.
+ */
+void SpLockStatsEnable(BOOL bEnable)
+{
+	g_lock_stats_enabled.store(bEnable != FALSE);
+}
+
+/*
+ * @brief 
+ * Copies the statistics of every named lock.
+ * @param stats - Receives one entry per lock name.
+ */
+void SpLockStatsQuery(std::vector<SP_LOCK_STATS>& stats)
+{
+	std::mutex* lpMutex;
+	std::vector<SP_LOCK_COUNTERS*>& registry = SpLockRegistry(&lpMutex);
+	std::lock_guard<std::mutex> lock(*lpMutex);
+
+	stats.resize(registry.size());
+	for (size_t i = 0; i < registry.size(); i++)
+	{
+		memcpy(stats[i].szName, registry[i]->szName, SP_LOCK_NAME_SIZE);
+		stats[i].ullAcquires = registry[i]->ullAcquires;
+		stats[i].ullContended = registry[i]->ullContended;
+		stats[i].ullTotalWaitUs = registry[i]->ullTotalWaitUs;
+		stats[i].ullMaxHoldUs = registry[i]->ullMaxHoldUs;
+		for (int j = 0; j < SP_LOCK_HISTOGRAM_BUCKETS; j++)
+			stats[i].ullWaitHistogram[j] = registry[i]->ullWaitHistogram[j];
+	}
+}
+
+/*
+ * @brief 
+ * Writes the statistics of every lock that was acquired to the debugger output. Does
+ * nothing while statistics are disabled.
+ */
+void SpLockStatsDump()
+{
+	if (!g_lock_stats_enabled.load())
+		return;
+
+	std::vector<SP_LOCK_STATS> stats;
+	SpLockStatsQuery(stats);
+
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		if (stats[i].ullAcquires == 0)
+			continue;
+
+		char szLine[512];
+		int nLength = snprintf(szLine, sizeof(szLine), "XFSSP lock %s: acquires=%llu contended=%llu wait=%lluus maxhold=%lluus histogram=",
+			stats[i].szName, stats[i].ullAcquires, stats[i].ullContended, stats[i].ullTotalWaitUs, stats[i].ullMaxHoldUs);
+
+		for (int j = 0; j < SP_LOCK_HISTOGRAM_BUCKETS && nLength > 0 && nLength < (int)sizeof(szLine); j++)
+			nLength += snprintf(szLine + nLength, sizeof(szLine) - nLength, j ? ",%llu" : "%llu", stats[i].ullWaitHistogram[j]);
+
+		if (nLength > 0 && nLength < (int)sizeof(szLine) - 1)
+			memcpy(szLine + nLength, "\n", 2);
+		PlatformDebugOutput(szLine);
+	}
+}
+
+/*
+ * @brief 
+ * @param lpszName - Name the statistics of the lock are recorded under. Locks sharing a
+ *	name share their statistics.
+ */
+SpMutex::SpMutex(LPCSTR lpszName)
+{
+	m_lpCounters = SpLockCounters(lpszName);
+	m_ullAcquiredUs = 0;
+}
+
+void SpMutex::lock()
+{
+	if (!g_lock_stats_enabled.load(std::memory_order_relaxed))
+	{
+		m_mutex.lock();
+		return;
+	}
+
+	if (m_mutex.try_lock())
+		Acquired();
+	else
+		LockContended();
+}
+
+bool SpMutex::try_lock()
+{
+	if (!m_mutex.try_lock())
+		return false;
+
+	if (g_lock_stats_enabled.load(std::memory_order_relaxed))
+		Acquired();
+	return true;
+}
+
+void SpMutex::unlock()
+{
+	if (m_ullAcquiredUs != 0)
+		Releasing();
+	m_mutex.unlock();
+}
+
+/*
+ * @brief 
+ * Slow path of lock() while statistics are enabled: times the wait.
+ */
+void SpMutex::LockContended()
+{
+	ULONGLONG ullStart = SpLockClockUs();
+	m_mutex.lock();
+	ULONGLONG ullWaitUs = SpLockClockUs() - ullStart;
+
+	int nBucket = 0;
+	while (nBucket < SP_LOCK_HISTOGRAM_BUCKETS - 1 && (1ULL << nBucket) <= ullWaitUs)
+		nBucket++;
+
+	m_lpCounters->ullContended++;
+	m_lpCounters->ullTotalWaitUs += ullWaitUs;
+	m_lpCounters->ullWaitHistogram[nBucket]++;
+	Acquired();
+}
+
+/*
+ * @brief 
+ * Records an acquire. Called with the mutex held.
+ */
+void SpMutex::Acquired()
+{
+	m_lpCounters->ullAcquires++;
+	m_ullAcquiredUs = SpLockClockUs();
+	if (m_ullAcquiredUs == 0)
+		m_ullAcquiredUs = 1;
+}
+
+/*
+ * @brief 
+ * Records the hold time of the acquire being released. Called with the mutex held.
+ */
+void SpMutex::Releasing()
+{
+	ULONGLONG ullHoldUs = SpLockClockUs() - m_ullAcquiredUs;
+	m_ullAcquiredUs = 0;
+
+	ULONGLONG ullMax = m_lpCounters->ullMaxHoldUs.load(std::memory_order_relaxed);
+	while (ullHoldUs > ullMax && !m_lpCounters->ullMaxHoldUs.compare_exchange_weak(ullMax, ullHoldUs))
+	{
+	}
+}
+
+SpCondition::SpCondition()
+{
+}
+
+/*
+ * @brief 
+ * Releases the mutex, waits for a notification and takes the mutex again. Wakes up
+ * spuriously like any condition variable, so callers re-check their predicate.
+ * @param lock - Lock held on the SpMutex guarding the predicate.
+ */
+void SpCondition::Wait(std::unique_lock<SpMutex>& lock)
+{
+	SpMutex* mutex = lock.mutex();
+	if (mutex->m_ullAcquiredUs != 0)
+		mutex->Releasing();
+
+	std::unique_lock<std::mutex> inner(mutex->m_mutex, std::adopt_lock);
+	m_cond.wait(inner);
+	inner.release();
+
+	if (g_lock_stats_enabled.load(std::memory_order_relaxed))
+		mutex->Acquired();
+}
+
+/*
+ * @brief 
+ * Same as Wait() but gives up after a timeout.
+ * @param lock - Lock held on the SpMutex guarding the predicate.
+ * @param dwTimeOut - Number of milliseconds to wait, INFINITE for no limit.
+ * @return BOOL FALSE if the timeout expired, TRUE otherwise.
+ */
+BOOL SpCondition::Wait(std::unique_lock<SpMutex>& lock, DWORD dwTimeOut)
+{
+	if (dwTimeOut == INFINITE)
+	{
+		Wait(lock);
+		return TRUE;
+	}
+
+	SpMutex* mutex = lock.mutex();
+	if (mutex->m_ullAcquiredUs != 0)
+		mutex->Releasing();
+
+	std::unique_lock<std::mutex> inner(mutex->m_mutex, std::adopt_lock);
+	std::cv_status status = m_cond.wait_for(inner, std::chrono::milliseconds(dwTimeOut));
+	inner.release();
+
+	if (g_lock_stats_enabled.load(std::memory_order_relaxed))
+		mutex->Acquired();
+	return status == std::cv_status::no_timeout;
+}
+
+void SpCondition::NotifyOne()
+{
+	m_cond.notify_one();
+}
+
+void SpCondition::NotifyAll()
+{
+	m_cond.notify_all();
+}
+
+SpEvent::SpEvent(BOOL bManualReset, BOOL bInitialState) : m_mutex("SpEvent")
+{
+	m_bManualReset = bManualReset;
+	m_bSignaled = bInitialState;
+}
+
+/*
+ * @brief 
+ * Signals the event.
+ */
+void SpEvent::Set()
+{
+	{
+		std::lock_guard<SpMutex> lock(m_mutex);
+		m_bSignaled = TRUE;
+	}
+
+	if (m_bManualReset)
+		m_cond.NotifyAll();
+	else
+		m_cond.NotifyOne();
+}
+
+/*
+ * @brief 
+ * Puts the event back in the non-signaled state.
+ */
+void SpEvent::Reset()
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+	m_bSignaled = FALSE;
+}
+
+/*
+ * @brief 
+ * Waits until the event is signaled. An auto-reset event is reset by the waiter it
+ * releases.
+ * @param dwTimeOut - Number of milliseconds to wait, INFINITE for no limit.
+ * @return BOOL TRUE if the event was signaled, FALSE if the timeout expired.
+ */
+BOOL SpEvent::Wait(DWORD dwTimeOut)
+{
+	std::unique_lock<SpMutex> lock(m_mutex);
+
+	if (dwTimeOut == INFINITE)
+	{
+		while (!m_bSignaled)
+			m_cond.Wait(lock);
+	}
+	else
+	{
+		std::chrono::steady_clock::time_point deadline =
+			std::chrono::steady_clock::now() + std::chrono::milliseconds(dwTimeOut);
+
+		while (!m_bSignaled)
+		{
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (now >= deadline)
+				return FALSE;
+
+			m_cond.Wait(lock, (DWORD)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1);
+		}
+	}
+
+	if (!m_bManualReset)
+		m_bSignaled = FALSE;
+	return TRUE;
+}
@@ -0,0 +1,122 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+#define SP_LOCK_NAME_SIZE 32
+#define SP_LOCK_HISTOGRAM_BUCKETS 16
+
+/*
+ * @brief 
+ * Contention figures of every lock sharing one name. Bucket i of the wait histogram
+ * counts contended acquires that waited less than 2^i microseconds, the last bucket
+ * everything longer.
+ */
+struct SP_LOCK_STATS {
+	CHAR szName[SP_LOCK_NAME_SIZE];
+	ULONGLONG ullAcquires;
+	ULONGLONG ullContended;
+	ULONGLONG ullTotalWaitUs;
+	ULONGLONG ullMaxHoldUs;
+	ULONGLONG ullWaitHistogram[SP_LOCK_HISTOGRAM_BUCKETS];
+};
+
+struct SP_LOCK_COUNTERS;
+
+void SpLockStatsEnable(BOOL bEnable);
+void SpLockStatsQuery(std::vector<SP_LOCK_STATS>& stats);
+void SpLockStatsDump();
+
+/*
+ * @brief 
+ * In-process mutex. Uncontended acquires stay in user mode, unlike the kernel mutexes
+ * returned by CreateMutex. Meets the Lockable requirements, so std::lock_guard and
+ * std::unique_lock work with it. While lock statistics are enabled every acquire is
+ * recorded under the name of the lock; otherwise the only cost is one flag load.
+ */
+class SpMutex
+{
+public:
+	explicit SpMutex(LPCSTR lpszName);
+
+	void lock();
+	bool try_lock();
+	void unlock();
+
+private:
+	SpMutex(const SpMutex&);
+	SpMutex& operator=(const SpMutex&);
+
+	void LockContended();
+	void Acquired();
+	void Releasing();
+
+	friend class SpCondition;
+	std::mutex m_mutex;
+	SP_LOCK_COUNTERS* m_lpCounters;
+	ULONGLONG m_ullAcquiredUs;
+};
+
+/*
+ * @brief 
+ * Condition variable used together with an SpMutex.
+ */
+class SpCondition
+{
+public:
+	SpCondition();
+
+	void Wait(std::unique_lock<SpMutex>& lock);
+	BOOL Wait(std::unique_lock<SpMutex>& lock, DWORD dwTimeOut);
+	void NotifyOne();
+	void NotifyAll();
+
+private:
+	SpCondition(const SpCondition&);
+	SpCondition& operator=(const SpCondition&);
+
+	std::condition_variable m_cond;
+};
+
+/*
+ * @brief 
+ * Event object in the style of CreateEvent, without the kernel transition. An
+ * auto-reset event releases one waiter per Set(), a manual-reset event stays signaled
+ * until Reset().
+ */
+class SpEvent
+{
+public:
+	SpEvent(BOOL bManualReset, BOOL bInitialState);
+
+	void Set();
+	void Reset();
+	BOOL Wait(DWORD dwTimeOut);
+
+private:
+	SpEvent(const SpEvent&);
+	SpEvent& operator=(const SpEvent&);
+
+	SpMutex m_mutex;
+	SpCondition m_cond;
+	BOOL m_bManualReset;
+	BOOL m_bSignaled;
+};
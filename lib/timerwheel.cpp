@@ -0,0 +1,262 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "pch.h"
+#include "timerwheel.h"
+#include "platform.h"
+
+/*
+ * @brief 
+ * Milliseconds clock driving the SP timer wheel.
+ * @return ULONGLONG milliseconds elapsed since the system was started.
+ */
+static ULONGLONG TimerWheelClock(void)
+{
+	return PlatformTickCount();
+}
+
+TimerWheel g_timer_wheel(TimerWheelClock, TIMER_WHEEL_DEFAULT_TICK);
+
+/*
+ * @brief 
+ * Prepares a timer node that is not linked in any wheel.
+ * @param node - The node to initialize.
+ */
+void TimerNodeInit(TIMER_NODE* node)
+{
+	node->lpPrev = NULL;
+	node->lpNext = NULL;
+	node->ullExpires = 0;
+	node->lpfnExpired = NULL;
+	node->lpParam = NULL;
+}
+
+TimerWheel::TimerWheel(timerclock lpfnClock, DWORD dwTickMs) : m_mutex("TimerWheel"), m_serviceMutex("TimerWheel.service")
+{
+	m_lpfnClock = lpfnClock;
+	m_dwTickMs = dwTickMs ? dwTickMs : TIMER_WHEEL_DEFAULT_TICK;
+	m_ullNow = m_lpfnClock() / m_dwTickMs;
+	m_nArmed = 0;
+	m_bRunning = false;
+
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		for (int i = 0; i < TIMER_WHEEL_SIZE; i++)
+		{
+			m_slots[level][i].lpPrev = &m_slots[level][i];
+			m_slots[level][i].lpNext = &m_slots[level][i];
+		}
+	}
+}
+
+TimerWheel::~TimerWheel()
+{
+	Stop();
+}
+
+/*
+ * @brief 
+ * Arms a timer. An armed node must be cancelled before it is scheduled again.
+ * @param node - The timer node, usually embedded in the request it guards.
+ * @param dwTimeOut - Number of milliseconds until the timer expires.
+ * @param lpfnExpired - Callback run when the timer expires.
+ * @param lpParam - A pointer to user-defined data passed to the callback.
+ */
+void TimerWheel::Schedule(TIMER_NODE* node, DWORD dwTimeOut, timercb lpfnExpired, LPVOID lpParam)
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+
+	node->ullExpires = (m_lpfnClock() + dwTimeOut + m_dwTickMs - 1) / m_dwTickMs;
+	node->lpfnExpired = lpfnExpired;
+	node->lpParam = lpParam;
+	Insert(node);
+	m_nArmed++;
+}
+
+/*
+ * @brief 
+ * Disarms a timer.
+ * @param node - The timer node.
+ * @return BOOL TRUE if the timer was armed, FALSE if it already expired or was never set.
+ */
+BOOL TimerWheel::Cancel(TIMER_NODE* node)
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+	if (node->lpNext == NULL)
+		return FALSE;
+
+	node->lpPrev->lpNext = node->lpNext;
+	node->lpNext->lpPrev = node->lpPrev;
+	node->lpPrev = NULL;
+	node->lpNext = NULL;
+	m_nArmed--;
+	return TRUE;
+}
+
+/*
+ * @brief 
+ * Processes every tick up to the current clock value and fires the expired timers.
+ */
+void TimerWheel::Advance()
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+	ULONGLONG ullTarget = m_lpfnClock() / m_dwTickMs;
+
+	if (m_nArmed == 0 && m_ullNow <= ullTarget)
+		m_ullNow = ullTarget + 1;
+
+	while (m_ullNow <= ullTarget)
+	{
+		for (int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+		{
+			if ((m_ullNow & ((1ULL << (level * TIMER_WHEEL_BITS)) - 1)) != 0)
+				break;
+			Cascade(level);
+		}
+
+		TIMER_NODE* head = &m_slots[0][m_ullNow & TIMER_WHEEL_MASK];
+		while (head->lpNext != head)
+		{
+			TIMER_NODE* node = head->lpNext;
+			node->lpPrev->lpNext = node->lpNext;
+			node->lpNext->lpPrev = node->lpPrev;
+			node->lpPrev = NULL;
+			node->lpNext = NULL;
+			m_nArmed--;
+			node->lpfnExpired(node->lpParam);
+		}
+
+		m_ullNow++;
+	}
+}
+
+/*
+ * @brief 
+ * Links a node in the slot matching its expiry tick. Deadlines beyond the range of the
+ * top level are parked in its farthest slot and placed again when it cascades.
+ * @param node - The node to link.
+ */
+void TimerWheel::Insert(TIMER_NODE* node)
+{
+	ULONGLONG ullExpires = node->ullExpires < m_ullNow ? m_ullNow : node->ullExpires;
+	ULONGLONG ullDelta = ullExpires - m_ullNow;
+	ULONGLONG ullRange = 1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS);
+
+	if (ullDelta >= ullRange)
+	{
+		ullDelta = ullRange - 1;
+		ullExpires = m_ullNow + ullDelta;
+	}
+
+	int level = 0;
+	while (level < TIMER_WHEEL_LEVELS - 1 && ullDelta >= (1ULL << ((level + 1) * TIMER_WHEEL_BITS)))
+		level++;
+
+	TIMER_NODE* head = &m_slots[level][(ullExpires >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK];
+	node->lpPrev = head->lpPrev;
+	node->lpNext = head;
+	head->lpPrev->lpNext = node;
+	head->lpPrev = node;
+}
+
+/*
+ * @brief 
+ * Moves the timers of the current slot of a level down to the lower levels.
+ * @param level - The level to cascade.
+ */
+void TimerWheel::Cascade(int level)
+{
+	TIMER_NODE list;
+	TIMER_NODE* head = &m_slots[level][(m_ullNow >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK];
+
+	if (head->lpNext == head)
+		return;
+
+	list.lpNext = head->lpNext;
+	list.lpPrev = head->lpPrev;
+	list.lpNext->lpPrev = &list;
+	list.lpPrev->lpNext = &list;
+	head->lpNext = head;
+	head->lpPrev = head;
+
+	while (list.lpNext != &list)
+	{
+		TIMER_NODE* node = list.lpNext;
+		list.lpNext = node->lpNext;
+		node->lpNext->lpPrev = &list;
+		Insert(node);
+	}
+}
+
+/*
+ * @brief 
+ * Starts the thread advancing the wheel every tick. Calling it on a running wheel does
+ * nothing.
+ * @return int 0 on success, a negative value on failure.
+ */
+int TimerWheel::Start()
+{
+	std::lock_guard<SpMutex> lock(m_serviceMutex);
+	if (m_bRunning)
+		return 0;
+
+	try
+	{
+		m_thread = std::thread(&TimerWheel::ServiceLoop, this);
+	}
+	catch (...)
+	{
+		return -1;
+	}
+
+	m_bRunning = true;
+	return 0;
+}
+
+/*
+ * @brief 
+ * Stops and joins the thread advancing the wheel.
+ */
+void TimerWheel::Stop()
+{
+	{
+		std::lock_guard<SpMutex> lock(m_serviceMutex);
+		if (!m_bRunning)
+			return;
+		m_bRunning = false;
+	}
+	m_serviceCond.NotifyAll();
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+/*
+ * @brief 
+ * Body of the wheel thread.
+ */
+void TimerWheel::ServiceLoop()
+{
+	std::unique_lock<SpMutex> lock(m_serviceMutex);
+	while (m_bRunning)
+	{
+		m_serviceCond.Wait(lock, m_dwTickMs);
+		lock.unlock();
+		Advance();
+		lock.lock();
+	}
+}
@@ -0,0 +1,83 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#include <thread>
+#include <mutex>
+#include "sync.h"
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_DEFAULT_TICK 10
+
+struct TIMER_NODE;
+
+typedef void (*timercb)(LPVOID);
+typedef ULONGLONG (*timerclock)(void);
+
+struct TIMER_NODE {
+	TIMER_NODE* lpPrev;
+	TIMER_NODE* lpNext;
+	ULONGLONG ullExpires;
+	timercb lpfnExpired;
+	LPVOID lpParam;
+};
+
+/*
+ * @brief 
+ * Hierarchical timer wheel tracking request deadlines. Schedule and Cancel are O(1);
+ * Advance moves the wheel to the time returned by the clock and fires every expired
+ * timer. Expiry callbacks run with the wheel locked, so once Cancel returns the callback
+ * of that node is neither running nor pending and the node may be released. Callbacks
+ * must be short and must not call back into the wheel.
+ */
+class TimerWheel
+{
+public:
+	TimerWheel(timerclock lpfnClock, DWORD dwTickMs);
+	~TimerWheel();
+
+	void Schedule(TIMER_NODE* node, DWORD dwTimeOut, timercb lpfnExpired, LPVOID lpParam);
+	BOOL Cancel(TIMER_NODE* node);
+	void Advance();
+
+	int Start();
+	void Stop();
+
+private:
+	void Insert(TIMER_NODE* node);
+	void Cascade(int level);
+	void ServiceLoop();
+
+	timerclock m_lpfnClock;
+	DWORD m_dwTickMs;
+	ULONGLONG m_ullNow;
+	size_t m_nArmed;
+	TIMER_NODE m_slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+
+	SpMutex m_mutex;
+	SpMutex m_serviceMutex;
+	SpCondition m_serviceCond;
+	std::thread m_thread;
+	bool m_bRunning;
+};
+
+void TimerNodeInit(TIMER_NODE* node);
+
+extern TimerWheel g_timer_wheel;
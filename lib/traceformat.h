@@ -0,0 +1,84 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+/*
+ * Layout of the SP trace file. The file starts with a TRACE_FILE_HEADER followed by
+ * fixed-size TRACE_RECORDs in the order they were recorded, so a trace can be read,
+ * or cut after a crash, at any record boundary. Later runs of the SP append to the
+ * file, continuing its timestamps. All fields are little-endian.
+ */
+
+#define TRACE_FILE_MAGIC 0x43525458
+#define TRACE_FILE_VERSION 2
+
+#define TRACE_RECORD_CALL 1
+#define TRACE_RECORD_NAME 2
+#define TRACE_RECORD_COMPLETION 3
+#define TRACE_RECORD_EVENT 4
+
+#define TRACE_CALL_OPEN 1
+#define TRACE_CALL_CLOSE 2
+#define TRACE_CALL_LOCK 3
+#define TRACE_CALL_UNLOCK 4
+#define TRACE_CALL_REGISTER 5
+#define TRACE_CALL_DEREGISTER 6
+#define TRACE_CALL_GETINFO 7
+#define TRACE_CALL_EXECUTE 8
+#define TRACE_CALL_CANCEL 9
+#define TRACE_CALL_SETTRACELEVEL 10
+#define TRACE_CALL_UNLOAD 11
+#define TRACE_CALLS 12
+
+#define TRACE_NAME_LENGTH 20
+
+struct TRACE_FILE_HEADER {
+	DWORD dwMagic;
+	DWORD dwVersion;
+	DWORD dwRecordSize;
+	DWORD dwReserved;
+};
+
+/*
+ * @brief 
+ * One trace record.
+ * TRACE_RECORD_CALL: a WFP* call. dwCommand holds the category, command or event class
+ * of the call, dwParam its timeout or trace level.
+ * TRACE_RECORD_NAME: the logical name of the WFPOpen call or event recorded just before
+ * it, in szName, truncated to TRACE_NAME_LENGTH characters and not terminated when that
+ * long. wCall is TRACE_CALL_OPEN after an open and 0 after an event.
+ * TRACE_RECORD_COMPLETION: a completion message; lResult holds its hResult.
+ * TRACE_RECORD_EVENT: an event raised by a device; dwCommand holds the event id and
+ * dwParam its data. It is followed by a TRACE_RECORD_NAME with the logical name of the
+ * device.
+ */
+struct TRACE_RECORD {
+	ULONGLONG ullTimeUs;
+	WORD wType;
+	WORD wCall;
+	union {
+		struct {
+			DWORD dwService;
+			DWORD dwRequestID;
+			DWORD dwCommand;
+			DWORD dwParam;
+			LONG lResult;
+		} call;
+		CHAR szName[TRACE_NAME_LENGTH];
+	} u;
+};
@@ -0,0 +1,318 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "pch.h"
+#include "tracerecorder.h"
+#include <xfsspi.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+
+TraceRecorder g_trace_recorder;
+
+/*
+ * @brief 
+ * Microseconds clock of the trace timestamps.
+ * @return ULONGLONG microseconds from an arbitrary origin.
+ */
+static ULONGLONG TraceClockUs(void)
+{
+	return (ULONGLONG)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * @brief 
+ * Maps a completion message to the call that it completes.
+ * @param uMessage - The completion message.
+ * @return WORD the TRACE_CALL_* value, 0 for an unknown message.
+ */
+static WORD TraceCallOfMessage(UINT uMessage)
+{
+	switch (uMessage)
+	{
+	case WFS_OPEN_COMPLETE: return TRACE_CALL_OPEN;
+	case WFS_CLOSE_COMPLETE: return TRACE_CALL_CLOSE;
+	case WFS_LOCK_COMPLETE: return TRACE_CALL_LOCK;
+	case WFS_UNLOCK_COMPLETE: return TRACE_CALL_UNLOCK;
+	case WFS_REGISTER_COMPLETE: return TRACE_CALL_REGISTER;
+	case WFS_DEREGISTER_COMPLETE: return TRACE_CALL_DEREGISTER;
+	case WFS_GETINFO_COMPLETE: return TRACE_CALL_GETINFO;
+	case WFS_EXECUTE_COMPLETE: return TRACE_CALL_EXECUTE;
+	default: return 0;
+	}
+}
+
+TraceRecorder::TraceRecorder() : m_mutex("TraceRecorder"), m_fileMutex("TraceRecorder.file")
+{
+	m_bRunning.store(false);
+	m_bOpen = false;
+	m_ullStartUs = 0;
+}
+
+TraceRecorder::~TraceRecorder()
+{
+	Stop();
+}
+
+/*
+ * @brief 
+ * Checks whether a trace file can be appended to.
+ * @param lpszPath - Path of the trace file.
+ * @param lpullLastUs - Receives the timestamp of the last record, 0 when there is none.
+ * @return int 1 when the file holds a trace of this version that ends at a record
+ * boundary, 0 when it is missing or empty, -1 when it holds anything else.
+ */
+static int TraceFileState(LPCSTR lpszPath, ULONGLONG* lpullLastUs)
+{
+	*lpullLastUs = 0;
+
+	std::ifstream file(lpszPath, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return 0;
+	std::streamoff size = file.tellg();
+	if (size <= 0)
+		return 0;
+
+	TRACE_FILE_HEADER header;
+	file.seekg(0);
+	if (!file.read((char*)&header, sizeof(header))
+		|| header.dwMagic != TRACE_FILE_MAGIC
+		|| header.dwVersion != TRACE_FILE_VERSION
+		|| header.dwRecordSize != sizeof(TRACE_RECORD)
+		|| (size - (std::streamoff)sizeof(header)) % sizeof(TRACE_RECORD) != 0)
+		return -1;
+
+	if (size > (std::streamoff)sizeof(header))
+	{
+		TRACE_RECORD record;
+		file.seekg(size - (std::streamoff)sizeof(record));
+		if (!file.read((char*)&record, sizeof(record)))
+			return -1;
+		*lpullLastUs = record.ullTimeUs;
+	}
+	return 1;
+}
+
+/*
+ * @brief 
+ * Opens the trace file and starts recording. A trace of this version already in the
+ * file is appended to, with timestamps continuing from its last record; any other file
+ * is kept as <path>.1, replacing an older one, and a new trace is started. Calling it
+ * while a trace is running does nothing.
+ * @param lpszPath - Path of the trace file.
+ * @return int 0 on success, a negative value on failure.
+ */
+int TraceRecorder::Start(LPCSTR lpszPath)
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+	if (m_bOpen)
+		return 0;
+
+	ULONGLONG ullLastUs;
+	int state = TraceFileState(lpszPath, &ullLastUs);
+	if (state < 0)
+	{
+		std::string rotated = std::string(lpszPath) + ".1";
+		remove(rotated.c_str());
+		if (rename(lpszPath, rotated.c_str()) != 0)
+			return -1;
+	}
+
+	std::lock_guard<SpMutex> file(m_fileMutex);
+	m_file.open(lpszPath, std::ios::binary | std::ios::out | std::ios::app);
+	if (!m_file.is_open())
+		return -1;
+
+	if (state <= 0)
+	{
+		TRACE_FILE_HEADER header;
+		header.dwMagic = TRACE_FILE_MAGIC;
+		header.dwVersion = TRACE_FILE_VERSION;
+		header.dwRecordSize = sizeof(TRACE_RECORD);
+		header.dwReserved = 0;
+		m_file.write((const char*)&header, sizeof(header));
+	}
+
+	m_buffer.reserve(TRACE_BUFFER_RECORDS);
+	m_ullStartUs = TraceClockUs() - ullLastUs;
+	m_bOpen = true;
+	m_bRunning.store(true);
+	return 0;
+}
+
+/*
+ * @brief 
+ * Writes the records still buffered and closes the trace file.
+ */
+void TraceRecorder::Stop()
+{
+	m_bRunning.store(false);
+
+	std::unique_lock<SpMutex> lock(m_mutex);
+	if (!m_bOpen)
+		return;
+	m_bOpen = false;
+	Flush(lock);
+
+	std::lock_guard<SpMutex> file(m_fileMutex);
+	m_file.close();
+}
+
+/*
+ * @brief 
+ * Records a WFP* call.
+ * @param wCall - TRACE_CALL_* value of the call.
+ * @param hService - The session of the call.
+ * @param reqId - The request of the call, 0 for synchronous calls.
+ * @param dwCommand - Category, command or event class of the call.
+ * @param dwParam - Timeout or trace level of the call.
+ */
+void TraceRecorder::Call(WORD wCall, HSERVICE hService, REQUESTID reqId, DWORD dwCommand, DWORD dwParam)
+{
+	if (!m_bRunning.load(std::memory_order_relaxed))
+		return;
+
+	TRACE_RECORD record;
+	memset(&record, 0, sizeof(record));
+	record.wType = TRACE_RECORD_CALL;
+	record.wCall = wCall;
+	record.u.call.dwService = hService;
+	record.u.call.dwRequestID = (DWORD)reqId;
+	record.u.call.dwCommand = dwCommand;
+	record.u.call.dwParam = dwParam;
+	Append(&record, 1);
+}
+
+/*
+ * @brief 
+ * Records a WFPOpen call together with the logical name it opens.
+ * @param hService - The session being opened.
+ * @param reqId - The request of the call.
+ * @param lpszLogicalName - The logical service name, may be NULL.
+ * @param dwTimeOut - Timeout of the call.
+ */
+void TraceRecorder::Open(HSERVICE hService, REQUESTID reqId, LPCSTR lpszLogicalName, DWORD dwTimeOut)
+{
+	if (!m_bRunning.load(std::memory_order_relaxed))
+		return;
+
+	TRACE_RECORD records[2];
+	memset(records, 0, sizeof(records));
+	records[0].wType = TRACE_RECORD_CALL;
+	records[0].wCall = TRACE_CALL_OPEN;
+	records[0].u.call.dwService = hService;
+	records[0].u.call.dwRequestID = (DWORD)reqId;
+	records[0].u.call.dwParam = dwTimeOut;
+	records[1].wType = TRACE_RECORD_NAME;
+	records[1].wCall = TRACE_CALL_OPEN;
+	if (lpszLogicalName != NULL)
+		memcpy(records[1].u.szName, lpszLogicalName, strnlen(lpszLogicalName, TRACE_NAME_LENGTH));
+	Append(records, 2);
+}
+
+/*
+ * @brief 
+ * Records a completion message. Must be called before the message is sent, as the
+ * receiver owns the result block afterwards.
+ * @param uMessage - The completion message.
+ * @param lpWFSResult - The result block carried by the message.
+ */
+void TraceRecorder::Completion(UINT uMessage, LPWFSRESULT lpWFSResult)
+{
+	if (!m_bRunning.load(std::memory_order_relaxed))
+		return;
+
+	TRACE_RECORD record;
+	memset(&record, 0, sizeof(record));
+	record.wType = TRACE_RECORD_COMPLETION;
+	record.wCall = TraceCallOfMessage(uMessage);
+	record.u.call.dwService = lpWFSResult->hService;
+	record.u.call.dwRequestID = (DWORD)lpWFSResult->RequestID;
+	record.u.call.dwCommand = lpWFSResult->u.dwCommandCode;
+	record.u.call.lResult = lpWFSResult->hResult;
+	Append(&record, 1);
+}
+
+/*
+ * @brief 
+ * Records an event raised by a device together with the logical name of the device.
+ * @param lpszLogicalName - The logical service name of the device, may be NULL.
+ * @param dwEventID - The event identifier.
+ * @param dwData - Data associated with the event.
+ */
+void TraceRecorder::Event(LPCSTR lpszLogicalName, DWORD dwEventID, DWORD dwData)
+{
+	if (!m_bRunning.load(std::memory_order_relaxed))
+		return;
+
+	TRACE_RECORD records[2];
+	memset(records, 0, sizeof(records));
+	records[0].wType = TRACE_RECORD_EVENT;
+	records[0].u.call.dwCommand = dwEventID;
+	records[0].u.call.dwParam = dwData;
+	records[1].wType = TRACE_RECORD_NAME;
+	if (lpszLogicalName != NULL)
+		memcpy(records[1].u.szName, lpszLogicalName, strnlen(lpszLogicalName, TRACE_NAME_LENGTH));
+	Append(records, 2);
+}
+
+/*
+ * @brief 
+ * Timestamps records and buffers them in one piece. The timestamp is taken with the
+ * recorder locked so the records of a file are in time order.
+ * @param records - The records.
+ * @param count - Number of records.
+ */
+void TraceRecorder::Append(TRACE_RECORD* records, size_t count)
+{
+	std::unique_lock<SpMutex> lock(m_mutex);
+	if (!m_bOpen)
+		return;
+
+	ULONGLONG ullTimeUs = TraceClockUs() - m_ullStartUs;
+	for (size_t i = 0; i < count; i++)
+	{
+		records[i].ullTimeUs = ullTimeUs;
+		m_buffer.push_back(records[i]);
+	}
+
+	if (m_buffer.size() >= TRACE_BUFFER_RECORDS)
+		Flush(lock);
+}
+
+/*
+ * @brief 
+ * Takes the buffered records and writes them out with the recorder unlocked. The file
+ * is locked before the recorder is released, so blocks are written in the order they
+ * were taken.
+ * @param lock - Holds the recorder lock; released on return.
+ */
+void TraceRecorder::Flush(std::unique_lock<SpMutex>& lock)
+{
+	std::vector<TRACE_RECORD> block;
+	block.reserve(TRACE_BUFFER_RECORDS);
+	block.swap(m_buffer);
+
+	std::lock_guard<SpMutex> file(m_fileMutex);
+	lock.unlock();
+
+	if (!block.empty())
+		m_file.write((const char*)&block[0], block.size() * sizeof(TRACE_RECORD));
+	m_file.flush();
+}
@@ -0,0 +1,61 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#include <xfsapi.h>
+#include <fstream>
+#include <atomic>
+#include <vector>
+#include "sync.h"
+#include "traceformat.h"
+
+#define TRACE_BUFFER_RECORDS 4096
+
+/*
+ * @brief 
+ * Appends WFP* calls, completions and device events to a binary trace file for offline
+ * replay, across runs of the SP. Records are buffered in memory and written in blocks;
+ * while no trace is running every hook costs a single atomic load.
+ */
+class TraceRecorder
+{
+public:
+	TraceRecorder();
+	~TraceRecorder();
+
+	int Start(LPCSTR lpszPath);
+	void Stop();
+
+	void Call(WORD wCall, HSERVICE hService, REQUESTID reqId, DWORD dwCommand, DWORD dwParam);
+	void Open(HSERVICE hService, REQUESTID reqId, LPCSTR lpszLogicalName, DWORD dwTimeOut);
+	void Completion(UINT uMessage, LPWFSRESULT lpWFSResult);
+	void Event(LPCSTR lpszLogicalName, DWORD dwEventID, DWORD dwData);
+
+private:
+	void Append(TRACE_RECORD* records, size_t count);
+	void Flush(std::unique_lock<SpMutex>& lock);
+
+	std::atomic<bool> m_bRunning;
+	SpMutex m_mutex;
+	SpMutex m_fileMutex;
+	std::ofstream m_file;
+	bool m_bOpen;
+	ULONGLONG m_ullStartUs;
+	std::vector<TRACE_RECORD> m_buffer;
+};
+
+extern TraceRecorder g_trace_recorder;
@@ -0,0 +1,133 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "pch.h"
+#include "workerpool.h"
+
+WorkerPool g_worker_pool;
+WorkerPool g_execute_pool;
+
+WorkerPool::WorkerPool() : m_mutex("WorkerPool")
+{
+	m_bRunning = false;
+}
+
+WorkerPool::~WorkerPool()
+{
+	Stop();
+}
+
+/*
+ * @brief 
+ * Starts the worker threads. Calling it on a running pool does nothing.
+ * @param dwThreads - Number of worker threads, 0 selects WORKER_POOL_DEFAULT_THREADS.
+ * @return int 0 on success, a negative value on failure.
+ */
+int WorkerPool::Start(DWORD dwThreads)
+{
+	std::lock_guard<SpMutex> lock(m_mutex);
+	if (m_bRunning)
+		return 0;
+
+	if (dwThreads == 0)
+		dwThreads = WORKER_POOL_DEFAULT_THREADS;
+
+	try
+	{
+		for (DWORD i = 0; i < dwThreads; i++)
+			m_threads.emplace_back(&WorkerPool::WorkerLoop, this);
+	}
+	catch (...)
+	{
+		if (m_threads.empty())
+			return -1;
+	}
+
+	m_bRunning = true;
+	return 0;
+}
+
+/*
+ * @brief 
+ * Queues a routine to be run by one of the worker threads.
+ * @param lpRoutine - The routine to run.
+ * @param lpParam - A pointer to user-defined data passed to the routine.
+ * @return int 0 on success, a negative value on failure.
+ */
+int WorkerPool::Submit(LPTHREAD_START_ROUTINE lpRoutine, LPVOID lpParam)
+{
+	{
+		std::lock_guard<SpMutex> lock(m_mutex);
+		if (!m_bRunning)
+			return -1;
+
+		WORKER_TASK task;
+		task.lpRoutine = lpRoutine;
+		task.lpParam = lpParam;
+		m_tasks.push_back(task);
+	}
+	m_cond.NotifyOne();
+	return 0;
+}
+
+/*
+ * @brief 
+ * Runs the tasks still queued and joins every worker thread.
+ */
+void WorkerPool::Stop()
+{
+	std::vector<std::thread> threads;
+	{
+		std::lock_guard<SpMutex> lock(m_mutex);
+		if (!m_bRunning)
+			return;
+
+		m_bRunning = false;
+		threads.swap(m_threads);
+	}
+	m_cond.NotifyAll();
+
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		if (threads[i].joinable())
+			threads[i].join();
+	}
+}
+
+/*
+ * @brief 
+ * Body of every worker thread: waits for tasks and runs them until the pool is stopped
+ * and its queue is empty.
+ */
+void WorkerPool::WorkerLoop()
+{
+	while (true)
+	{
+		WORKER_TASK task;
+		{
+			std::unique_lock<SpMutex> lock(m_mutex);
+			while (m_tasks.empty() && m_bRunning)
+				m_cond.Wait(lock);
+			if (m_tasks.empty())
+				return;
+
+			task = m_tasks.front();
+			m_tasks.pop_front();
+		}
+		task.lpRoutine(task.lpParam);
+	}
+}
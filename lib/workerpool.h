@@ -0,0 +1,58 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#include <thread>
+#include <mutex>
+#include "sync.h"
+#include <deque>
+#include <vector>
+
+#define WORKER_POOL_DEFAULT_THREADS 4
+
+struct WORKER_TASK {
+	LPTHREAD_START_ROUTINE lpRoutine;
+	LPVOID lpParam;
+};
+
+/*
+ * @brief 
+ * Fixed-size pool of worker threads shared by every asynchronous WFP* request.
+ * Threads are started on demand and stay alive until Stop() is called.
+ */
+class WorkerPool
+{
+public:
+	WorkerPool();
+	~WorkerPool();
+
+	int Start(DWORD dwThreads);
+	int Submit(LPTHREAD_START_ROUTINE lpRoutine, LPVOID lpParam);
+	void Stop();
+
+private:
+	void WorkerLoop();
+
+	SpMutex m_mutex;
+	SpCondition m_cond;
+	std::deque<WORKER_TASK> m_tasks;
+	std::vector<std::thread> m_threads;
+	bool m_bRunning;
+};
+
+extern WorkerPool g_worker_pool;
+extern WorkerPool g_execute_pool;
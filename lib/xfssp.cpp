@@ -18,65 +18,637 @@
 #include "pch.h"
 #include "mockdevice.h"
 #include "xfssp.h"
+#include "workerpool.h"
+#include "executelane.h"
+#include "eventdispatcher.h"
+#include "config.h"
+#include "resultreserve.h"
+#include "capabilities.h"
+#include "sessiontable.h"
+#include "lockmanager.h"
+#include "tracerecorder.h"
+#include "platform.h"
+#include <new>
+#include <set>
+
+static HPROVIDER g_hProvider = NULL;
+
+static SpMutex g_wfs_event_mutex("g_wfs_event_mutex");
+static std::shared_ptr<const WFS_EVENT_TABLE> g_wfs_event_table;
+static SpMutex g_wfs_queue_mutex("g_wfs_queue_mutex");
+static SpMutex g_wfs_device_mutex("g_wfs_device_mutex");
+static std::map<std::string, WFS_DEVICE*> g_wfs_devices;
+
+/*
+ * Settings read once per load of the SP, by the first WFPOpen, rather than on every
+ * open and close.
+ */
+struct WFS_CONFIG {
+	DWORD dwDeviceLinger;
+	DWORD dwExecuteQueueDepth;
+	BOOL bInlineGetInfo;
+};
+
+static SpMutex g_wfs_config_mutex("g_wfs_config_mutex");
+static std::atomic<bool> g_wfs_config_loaded(false);
+static WFS_CONFIG g_wfs_config;
+
+static const DWORD g_wfs_event_class_masks[WFS_EVENT_CLASSES] = {
+	SERVICE_EVENTS, USER_EVENTS, SYSTEM_EVENTS, EXECUTE_EVENTS
+};
+
+/*
+ * @brief 
+ * Reads the settings of g_wfs_config unless they were read since the SP was loaded.
+ */
+static void WFPLoadConfig()
+{
+	if (g_wfs_config_loaded.load(std::memory_order_acquire))
+		return;
+
+	std::lock_guard<SpMutex> lock(g_wfs_config_mutex);
+	if (g_wfs_config_loaded.load(std::memory_order_relaxed))
+		return;
+
+	g_wfs_config.dwDeviceLinger = SPConfigGetDword("DeviceLinger", WFS_DEVICE_DEFAULT_LINGER);
+	g_wfs_config.dwExecuteQueueDepth = SPConfigGetDword("ExecuteQueueDepth", WFS_LANE_DEFAULT_DEPTH);
+	g_wfs_config.bInlineGetInfo = SPConfigGetDword("InlineGetInfo", 1) != 0;
+	g_wfs_config_loaded.store(true, std::memory_order_release);
+}
+
+/*
+ * @brief 
+ * Rebuilds the per-class subscriber arrays from the registrations of every open session
+ * and publishes them as a new immutable snapshot. Windows no session registers any more
+ * are dropped from the event dispatcher. Must be called with g_wfs_event_mutex held.
+ */
+static void WFPPublishEventTable()
+{
+	std::shared_ptr<WFS_EVENT_TABLE> table = std::make_shared<WFS_EVENT_TABLE>();
+	std::set<HWND> windows;
+
+	for (DWORD i = 0; i < SESSION_TABLE_CAPACITY; i++)
+	{
+		SESSION* session = g_session_table.At(i);
+		if (session->lState.load() != SESSION_OPEN)
+			continue;
+
+		std::map<HWND, SESSION_REGISTRATION>::iterator it;
+		for (it = session->registrations.begin(); it != session->registrations.end(); ++it)
+		{
+			WFS_SUBSCRIBER subscriber;
+			subscriber.hWnd = (*it).first;
+			subscriber.hService = session->hService.load();
+			subscriber.lpDevice = (*it).second.lpDevice;
+
+			for (int j = 0; j < WFS_EVENT_CLASSES; j++)
+			{
+				if (((*it).second.dwEventClass & g_wfs_event_class_masks[j]) == g_wfs_event_class_masks[j])
+					table->classes[j].push_back(subscriber);
+			}
+			windows.insert(subscriber.hWnd);
+		}
+	}
+
+	std::shared_ptr<const WFS_EVENT_TABLE> previous =
+		std::atomic_exchange(&g_wfs_event_table, std::shared_ptr<const WFS_EVENT_TABLE>(table));
+	if (!previous)
+		return;
+
+	for (int j = 0; j < WFS_EVENT_CLASSES; j++)
+	{
+		for (size_t k = 0; k < previous->classes[j].size(); k++)
+		{
+			if (windows.find(previous->classes[j][k].hWnd) == windows.end())
+				g_event_dispatcher.Remove(previous->classes[j][k].hWnd);
+		}
+	}
+}
 
 /*
  * @brief 
- * Sends an event with associated data to XFS.
+ * Sends an event with associated data to XFS. The event is queued for every window
+ * registered for service events on a session of the device, and delivered by the event
+ * dispatcher, so the caller never waits for a client. The subscriber snapshot is read
+ * without locking.
+ * @param lpContext - The WFS_DEVICE raising the event.
  * @param evt - The event identifier, specifying the type of event to send.
  * @param data - Additional data associated with the event.
  * @return int 0 on success, a negative value on failure.
  */
-int WFPSendEvent(int evt, int data)
+int WFPSendEvent(LPVOID lpContext, int evt, int data)
 {
-	if (!g_wfs_event.empty())
+	g_trace_recorder.Event(((WFS_DEVICE*)lpContext)->lpszLogicalName, evt, data);
+
+	std::shared_ptr<const WFS_EVENT_TABLE> table = std::atomic_load(&g_wfs_event_table);
+	if (!table)
+		return 0;
+
+	const std::vector<WFS_SUBSCRIBER>& subscribers = table->classes[WFS_EVENT_CLASS_SERVICE];
+	for (size_t i = 0; i < subscribers.size(); i++)
 	{
-		std::map<HWND, WFS_EVENTS>::iterator it;
-		for (it = g_wfs_event.begin(); it != g_wfs_event.end(); ++it)
-		{
-			if (((*it).second.dwEvent & SERVICE_EVENTS) == SERVICE_EVENTS
-				|| ((*it).second.dwEvent & USER_EVENTS) == USER_EVENTS
-				|| ((*it).second.dwEvent & SYSTEM_EVENTS) == SYSTEM_EVENTS
-				|| ((*it).second.dwEvent & EXECUTE_EVENTS) == EXECUTE_EVENTS)
-			{
-				LPWFSRESULT lpWFSResult;
-				if (WFMAllocateBuffer(sizeof(WFSRESULT), WFS_MEM_ZEROINIT, (LPVOID*)&lpWFSResult) != WFS_SUCCESS)
-				{
-					return WFS_ERR_INTERNAL_ERROR;
-				}
+		if (subscribers[i].lpDevice != lpContext)
+			continue;
+		g_event_dispatcher.Publish(subscribers[i].hWnd, subscribers[i].hService, WFS_SERVICE_EVENT, evt, data);
+	}
+
+	return 0;
+}
+
+/*
+ * @brief 
+ * Sends a completion message, recording it in the trace first.
+ * @param hWnd - The window handle which is to receive the completion message.
+ * @param uMessage - The completion message.
+ * @param lpWFSResult - The result block, owned by the receiver once sent.
+ */
+static void WFPSendCompletion(HWND hWnd, UINT uMessage, LPWFSRESULT lpWFSResult)
+{
+	g_trace_recorder.Completion(uMessage, lpWFSResult);
+	PlatformSendMessage(hWnd, uMessage, lpWFSResult);
+}
 
-				lpWFSResult->hResult = WFS_SERVICE_EVENT;
-				lpWFSResult->hService = (*it).second.hService;
-				lpWFSResult->RequestID = NULL;					
-				lpWFSResult->lpBuffer = NULL;
-				lpWFSResult->u.dwEventID = evt;
+/*
+ * @brief 
+ * Hands an asynchronous request over to the shared worker pool. The result block is
+ * released if the request cannot be queued.
+ * @param lpRoutine - The routine that completes the request.
+ * @param lpWFSResult - The result block passed to the routine.
+ * @return HRESULT - WFS_SUCCESS on success, WFS_ERR_INTERNAL_ERROR on failure.
+ */
+static HRESULT WFPSubmitProcess(LPTHREAD_START_ROUTINE lpRoutine, LPWFSRESULT lpWFSResult)
+{
+	if (g_worker_pool.Submit(lpRoutine, lpWFSResult) != 0)
+	{
+		WFMFreeBuffer(lpWFSResult);
+		return WFS_ERR_INTERNAL_ERROR;
+	}
 
-				WFMAllocateMore(sizeof(DWORD), lpWFSResult, &lpWFSResult->lpBuffer);
-				LPWORD lpwLampThreshold = (LPWORD)lpWFSResult->lpBuffer;
-				*lpwLampThreshold = data;
+	return WFS_SUCCESS;
+}
 
-				SendMessage((*it).first, WFS_USER_EVENT, 0, (LPARAM)lpWFSResult);
-			}
+/*
+ * @brief 
+ * Worker pool task that delivers a completion prepared by another thread.
+ * @param lpParam - The WFS_COMPLETION to deliver.
+ * @return int 0 on success, a negative value on failure.
+ */
+DWORD WINAPI WFPCompletionProcess(LPVOID lpParam)
+{
+	WFS_COMPLETION* completion = (WFS_COMPLETION*)(lpParam);
+
+	WFPSendCompletion(completion->hWnd, completion->uMessage, completion->lpWFSResult);
+
+	delete completion;
+	return 0;
+}
+
+/*
+ * @brief 
+ * Completes a request with an error code from the worker pool. When no worker can take
+ * the completion it is posted to the window from the calling thread instead, which
+ * never blocks; the result block is released if even that fails.
+ * @param msg - The request; only its completion fields are read.
+ * @param hResult - The error code reported to the application.
+ */
+static void WFPPostCompletion(WFS_MSG* msg, HRESULT hResult)
+{
+	msg->lpWFSResult->hResult = hResult;
+	msg->lpWFSResult->lpBuffer = NULL;
+
+	WFS_COMPLETION* completion = new (std::nothrow) WFS_COMPLETION();
+	if (completion != NULL)
+	{
+		completion->hWnd = msg->hWnd;
+		completion->uMessage = msg->uMessage;
+		completion->lpWFSResult = msg->lpWFSResult;
+
+		if (g_worker_pool.Submit(WFPCompletionProcess, completion) == 0)
+			return;
+		delete completion;
+	}
+
+	g_trace_recorder.Completion(msg->uMessage, msg->lpWFSResult);
+	if (!PlatformPostMessage(msg->hWnd, msg->uMessage, msg->lpWFSResult))
+		WFMFreeBuffer(msg->lpWFSResult);
+}
+
+/*
+ * @brief 
+ * Timer wheel callback fired when the dwTimeOut of a request expires. A request that is
+ * still queued or running is completed with WFS_ERR_TIMEOUT; whichever thread was to
+ * complete it later finds it timed out and leaves its result block alone.
+ * @param lpParam - The WFS_MSG of the request.
+ */
+static void WFPOnRequestTimeout(LPVOID lpParam)
+{
+	WFS_MSG* msg = (WFS_MSG*)lpParam;
+
+	LONG lExpected = WFS_MSG_QUEUED;
+	if (!msg->lState.compare_exchange_strong(lExpected, WFS_MSG_TIMEDOUT))
+	{
+		if (lExpected != WFS_MSG_RUNNING || !msg->lState.compare_exchange_strong(lExpected, WFS_MSG_TIMEDOUT))
+			return;
+	}
+
+	WFPPostCompletion(msg, WFS_ERR_TIMEOUT);
+}
+
+/*
+ * @brief 
+ * Allocates the WFS_MSG tracking a request that is not held in an execute lane.
+ * @param lpWFSResult - The result block of the request.
+ * @param hWnd - The window handle which is to receive the completion message.
+ * @param uMessage - The completion message.
+ * @param session - The session issuing the request, NULL if it is not needed.
+ * @param dwGeneration - The generation of the session, returned with it by the session table.
+ * @return WFS_MSG* the queued request, NULL on failure.
+ */
+static WFS_MSG* WFPNewRequest(LPWFSRESULT lpWFSResult, HWND hWnd, UINT uMessage, SESSION* session, DWORD dwGeneration)
+{
+	WFS_MSG* msg = new (std::nothrow) WFS_MSG();
+	if (msg == NULL)
+		return NULL;
+
+	msg->hWnd = hWnd;
+	msg->uMessage = uMessage;
+	msg->lpWFSResult = lpWFSResult;
+	msg->RequestID = lpWFSResult->RequestID;
+	msg->dwCommand = lpWFSResult->u.dwCommandCode;
+	msg->lpDataReceived = NULL;
+	msg->lState.store(WFS_MSG_QUEUED);
+	msg->lpLane = NULL;
+	msg->lpSession = session;
+	msg->dwGeneration = dwGeneration;
+	msg->lpDevice = session ? session->lpDevice : NULL;
+	msg->lpPrevRequest = NULL;
+	msg->lpNextRequest = NULL;
+	TimerNodeInit(&msg->timer);
+	return msg;
+}
+
+/*
+ * @brief 
+ * Adds a request to the request list of its session, where WFPCancelRequests finds it.
+ * @param msg - A request allocated by WFPNewRequest.
+ */
+static void WFPTrackRequest(WFS_MSG* msg)
+{
+	SESSION* session = msg->lpSession;
+	std::lock_guard<SpMutex> lock(session->requestMutex);
+	msg->lpNextRequest = session->lpRequests;
+	if (session->lpRequests != NULL)
+		session->lpRequests->lpPrevRequest = msg;
+	session->lpRequests = msg;
+}
+
+/*
+ * @brief 
+ * Removes a request added by WFPTrackRequest from the request list of its session.
+ * @param msg - The request.
+ */
+static void WFPUntrackRequest(WFS_MSG* msg)
+{
+	SESSION* session = msg->lpSession;
+	std::lock_guard<SpMutex> lock(session->requestMutex);
+	if (msg->lpPrevRequest != NULL)
+		msg->lpPrevRequest->lpNextRequest = msg->lpNextRequest;
+	else
+		session->lpRequests = msg->lpNextRequest;
+	if (msg->lpNextRequest != NULL)
+		msg->lpNextRequest->lpPrevRequest = msg->lpPrevRequest;
+}
+
+/*
+ * @brief 
+ * Disarms the timer of a request queued by WFPSubmitTimedProcess or the status flight,
+ * drops it from the request list of its session and frees it.
+ * @param msg - The request.
+ */
+static void WFPReleaseRequest(WFS_MSG* msg)
+{
+	g_timer_wheel.Cancel(&msg->timer);
+	WFPUntrackRequest(msg);
+	delete msg;
+}
+
+/*
+ * @brief 
+ * Queues a request that honours dwTimeOut on the worker pool. The routine receives the
+ * WFS_MSG and must complete it through WFPBeginRequest, WFPEndRequest and
+ * WFPReleaseRequest.
+ * @param lpRoutine - The routine that completes the request.
+ * @param lpWFSResult - The result block of the request.
+ * @param hWnd - The window handle which is to receive the completion message.
+ * @param uMessage - The completion message.
+ * @param session - The session the request belongs to.
+ * @param dwGeneration - The generation of the session.
+ * @param dwTimeOut - Number of milliseconds to wait for completion, WFS_INDEFINITE_WAIT for none.
+ * @return HRESULT - WFS_SUCCESS on success, WFS_ERR_INTERNAL_ERROR on failure.
+ */
+static HRESULT WFPSubmitTimedProcess(LPTHREAD_START_ROUTINE lpRoutine, LPWFSRESULT lpWFSResult, HWND hWnd, UINT uMessage, SESSION* session, DWORD dwGeneration, DWORD dwTimeOut)
+{
+	WFS_MSG* msg = WFPNewRequest(lpWFSResult, hWnd, uMessage, session, dwGeneration);
+	if (msg == NULL)
+	{
+		WFMFreeBuffer(lpWFSResult);
+		return WFS_ERR_INTERNAL_ERROR;
+	}
+
+	WFPTrackRequest(msg);
+	if (dwTimeOut != WFS_INDEFINITE_WAIT)
+		g_timer_wheel.Schedule(&msg->timer, dwTimeOut, WFPOnRequestTimeout, msg);
+
+	if (g_worker_pool.Submit(lpRoutine, msg) != 0)
+	{
+		LONG lExpected = WFS_MSG_QUEUED;
+		BOOL bOwned = msg->lState.compare_exchange_strong(lExpected, WFS_MSG_DONE);
+		WFPReleaseRequest(msg);
+		if (bOwned)
+		{
+			WFMFreeBuffer(lpWFSResult);
+			return WFS_ERR_INTERNAL_ERROR;
 		}
 	}
 
+	return WFS_SUCCESS;
+}
+
+/*
+ * @brief 
+ * Marks a queued request as started.
+ * @param msg - The request.
+ * @return BOOL TRUE if the request must be processed, FALSE if it already timed out.
+ */
+static BOOL WFPBeginRequest(WFS_MSG* msg)
+{
+	LONG lExpected = WFS_MSG_QUEUED;
+	return msg->lState.compare_exchange_strong(lExpected, WFS_MSG_RUNNING);
+}
+
+/*
+ * @brief 
+ * Marks a running request as finished. The result block may only be written, and the
+ * completion sent, when this returns TRUE.
+ * @param msg - The request.
+ * @return BOOL TRUE if the caller completes the request, FALSE if it timed out meanwhile.
+ */
+static BOOL WFPEndRequest(WFS_MSG* msg)
+{
+	LONG lExpected = WFS_MSG_RUNNING;
+	return msg->lState.compare_exchange_strong(lExpected, WFS_MSG_DONE);
+}
+
+/*
+ * @brief 
+ * Releases the device lock of a session, if it holds it, and completes the lock
+ * request of the waiter it passes to.
+ * @param session - The releasing session.
+ * @return BOOL TRUE if the session held the lock.
+ */
+static BOOL WFPReleaseLock(SESSION* session)
+{
+	WFS_MSG* granted;
+	if (!g_lock_manager.Release(session, &granted))
+		return FALSE;
+
+	if (granted != NULL)
+	{
+		WFPPostCompletion(granted, WFS_SUCCESS);
+		delete granted;
+	}
+
+	return TRUE;
+}
+
+/*
+ * @brief 
+ * Completes the waiting lock requests withdrawn from the lock manager.
+ * @param session - The session.
+ * @param reqId - The request to withdraw, 0 for all of them.
+ */
+static void WFPCancelLockRequests(SESSION* session, REQUESTID reqId)
+{
+	std::vector<WFS_MSG*> cancelled;
+	g_lock_manager.Cancel(session, reqId, cancelled);
+
+	for (size_t i = 0; i < cancelled.size(); i++)
+	{
+		WFPPostCompletion(cancelled[i], WFS_ERR_CANCELED);
+		delete cancelled[i];
+	}
+}
+
+/*
+ * @brief 
+ * Called by LaneCancel for every request it cancelled. The completion is sent right
+ * away from the worker pool instead of waiting for the lane to reach the request.
+ * @param msg - The cancelled request.
+ */
+static void WFPOnRequestCancelled(WFS_MSG* msg)
+{
+	WFPPostCompletion(msg, WFS_ERR_CANCELED);
+}
+
+/*
+ * @brief 
+ * Cancels the requests of a session still waiting on the worker pool or a status
+ * flight. Their owner finds them cancelled and only releases them.
+ * @param session - The session.
+ * @param reqId - The request to cancel, 0 for all of them.
+ */
+static void WFPCancelRequests(SESSION* session, REQUESTID reqId)
+{
+	std::lock_guard<SpMutex> lock(session->requestMutex);
+	for (WFS_MSG* msg = session->lpRequests; msg != NULL; msg = msg->lpNextRequest)
+	{
+		if (reqId != 0 && msg->RequestID != reqId)
+			continue;
+
+		LONG lExpected = WFS_MSG_QUEUED;
+		if (msg->lState.compare_exchange_strong(lExpected, WFS_MSG_CANCELLED))
+			WFPOnRequestCancelled(msg);
+	}
+}
+
+/*
+ * @brief 
+ * Takes a session reference on the device of a logical service, creating the device on
+ * first use. A close still lingering on the device is called off.
+ * @param lpszLogicalName - The logical service name.
+ * @return WFS_DEVICE* the device, NULL when it cannot be created.
+ */
+static WFS_DEVICE* WFPAcquireDevice(LPCSTR lpszLogicalName)
+{
+	std::lock_guard<SpMutex> lock(g_wfs_device_mutex);
+	std::map<std::string, WFS_DEVICE*>::iterator it = g_wfs_devices.insert(
+		std::make_pair(std::string(lpszLogicalName ? lpszLogicalName : ""), (WFS_DEVICE*)NULL)).first;
+	WFS_DEVICE*& device = it->second;
+	if (device == NULL)
+	{
+		device = new (std::nothrow) WFS_DEVICE();
+		if (device == NULL)
+			return NULL;
+		device->lpszLogicalName = it->first.c_str();
+		TimerNodeInit(&device->linger);
+	}
+
+	device->lRefs++;
+	if (device->bLingering)
+	{
+		g_timer_wheel.Cancel(&device->linger);
+		device->bLingering = false;
+	}
+	return device;
+}
+
+/*
+ * @brief 
+ * Worker pool task that closes a device whose linger time passed, unless a session
+ * took it again meanwhile.
+ * @param lpParam - The WFS_DEVICE.
+ * @return int 0 on success, a negative value on failure.
+ */
+DWORD WINAPI WFPDeviceCloseProcess(LPVOID lpParam)
+{
+	WFS_DEVICE* device = (WFS_DEVICE*)lpParam;
+
+	std::lock_guard<SpMutex> lock(g_wfs_device_mutex);
+	if (!device->bLingering)
+		return 0;
+
+	device->bLingering = false;
+	device->bOpen = false;
+	device->dwCloses++;
+	device->device.Close();
+	return 0;
+}
+
+/*
+ * @brief 
+ * Timer wheel callback run when the linger time of a device passed. The close is
+ * handed to the worker pool as it must not run under the wheel lock.
+ * @param lpParam - The WFS_DEVICE.
+ */
+static void WFPOnDeviceLinger(LPVOID lpParam)
+{
+	g_worker_pool.Submit(WFPDeviceCloseProcess, lpParam);
+}
+
+/*
+ * @brief 
+ * Starts the linger time of an open device nobody references any more. Called with
+ * g_wfs_device_mutex held.
+ * @param device - The device.
+ * @param dwLinger - The linger time in milliseconds.
+ */
+static void WFPLingerDevice(WFS_DEVICE* device, DWORD dwLinger)
+{
+	device->bLingering = true;
+	g_timer_wheel.Schedule(&device->linger, dwLinger, WFPOnDeviceLinger, device);
+}
+
+/*
+ * @brief 
+ * Drops a session reference on a device. When the last one goes, the device is closed
+ * after DeviceLinger milliseconds, so a session opened in the meantime finds it open.
+ * A device still being opened is left to the opening session, which checks the
+ * references again once the open is done.
+ * @param device - The device.
+ */
+static void WFPReleaseDevice(WFS_DEVICE* device)
+{
+	std::lock_guard<SpMutex> lock(g_wfs_device_mutex);
+	if (--device->lRefs > 0 || !device->bOpen)
+		return;
+
+	WFPLingerDevice(device, g_wfs_config.dwDeviceLinger);
+}
+
+/*
+ * @brief 
+ * Opens a device for a session. Only the first session does device I/O; sessions that
+ * arrive during the open wait for it, later ones find the device open and return at
+ * once. When every session left while the device was opening, its close is scheduled.
+ * @param device - The device, referenced by the session.
+ * @return int 0 on success, a negative value on failure.
+ */
+static int WFPOpenDevice(WFS_DEVICE* device)
+{
+	std::unique_lock<SpMutex> lock(g_wfs_device_mutex);
+	while (device->bOpening)
+		device->opened.Wait(lock);
+	if (device->bOpen)
+		return 0;
+
+	device->bOpening = true;
+	device->dwOpens++;
+	lock.unlock();
+
+	int rv = device->device.Open(WFPSendEvent, device);
+
+	lock.lock();
+	device->bOpening = false;
+	device->opened.NotifyAll();
+	if (rv != 0)
+		return -1;
+
+	device->bOpen = true;
+	if (device->lRefs == 0 && !device->bLingering)
+		WFPLingerDevice(device, g_wfs_config.dwDeviceLinger);
 	return 0;
 }
 
 /*
  * @brief 
- * Entry point for a thread that opens device.
+ * Undoes a WFPOpen that failed after its session was inserted, dropping any window
+ * registered on it meanwhile. Nothing is done when a WFPClose detached the session
+ * first, as that close releases it.
+ * @param session - The session inserted by WFPOpen.
+ * @param dwGeneration - The generation returned with it.
+ */
+static void WFPAbortOpen(SESSION* session, DWORD dwGeneration)
+{
+	if (!g_session_table.Detach(session, dwGeneration))
+		return;
+
+	{
+		std::lock_guard<SpMutex> lock(g_wfs_event_mutex);
+		session->registrations.clear();
+		WFPPublishEventTable();
+	}
+
+	WFPReleaseDevice(session->lpDevice);
+	g_session_table.Free(session);
+}
+
+/*
+ * @brief 
+ * Worker pool task that opens device.
  * @param lpParam - A pointer to user-defined data passed to the thread.
  * @return int 0 on success, a negative value on failure.
  */
 DWORD WINAPI WFPOpenProcess(LPVOID lpParam)
 {
-	LPWFSRESULT lpWfsResult = (LPWFSRESULT)(lpParam);
-	HWND hWindowReturn = (HWND)(lpWfsResult->lpBuffer);
+	WFS_MSG* msg = (WFS_MSG*)(lpParam);
 
-	if (OpenDevice(WFPSendEvent))
-		lpWfsResult->hResult = WFS_ERR_DEV_NOT_READY;
+	if (WFPBeginRequest(msg))
+	{
+		// A session closed before its open ran has dropped its device reference already.
+		HRESULT hResult = WFS_SUCCESS;
+		if (!g_session_table.IsCurrent(msg->lpSession, msg->dwGeneration))
+			hResult = WFS_ERR_CANCELED;
+		else if (WFPOpenDevice(msg->lpDevice) != 0)
+			hResult = WFS_ERR_DEV_NOT_READY;
+
+		if (WFPEndRequest(msg))
+		{
+			msg->lpWFSResult->hResult = hResult;
+			WFPSendCompletion(msg->hWnd, WFS_OPEN_COMPLETE, msg->lpWFSResult);
+		}
+	}
 
-	SendMessage(hWindowReturn, WFS_OPEN_COMPLETE, 0, (LPARAM)lpParam);
+	WFPReleaseRequest(msg);
 	return 0;
 }
 
@@ -168,9 +740,16 @@ HRESULT ProcessVersions(const DWORD dwSPIVersionsRequired, const DWORD dwSrvcVer
  */
 HRESULT WINAPI WFPOpen(HSERVICE hService, LPSTR lpszLogicalName, HAPP hApp, LPSTR lpszAppID, DWORD dwTraceLevel, DWORD dwTimeOut, HWND hWnd, REQUESTID reqId, HPROVIDER hProvider, DWORD dwSPIVersionsRequired, LPWFSVERSION lpSPIVersion, DWORD dwSrvcVersionsRequired, LPWFSVERSION lpSrvcVersion)
 {
-	WINDOWINFO callWindow;
-	callWindow.cbSize = sizeof(WINDOWINFO);
-	if (hWnd == NULL || (!GetWindowInfo(hWnd, &callWindow) && (GetLastError() == ERROR_INVALID_HANDLE)))
+	UNREFERENCED_PARAMETER(hApp);
+	UNREFERENCED_PARAMETER(lpszAppID);
+	UNREFERENCED_PARAMETER(dwTraceLevel);
+
+	CHAR szTraceFile[MAX_PATH];
+	if (SPConfigGetString("TraceFile", szTraceFile, sizeof(szTraceFile)))
+		g_trace_recorder.Start(szTraceFile);
+	g_trace_recorder.Open(hService, reqId, lpszLogicalName, dwTimeOut);
+
+	if (!PlatformIsWindow(hWnd))
 	{
 		return WFS_ERR_INVALID_HWND;
 	}
@@ -181,41 +760,85 @@ HRESULT WINAPI WFPOpen(HSERVICE hService, LPSTR lpszLogicalName, HAPP hApp, LPST
 	}
 
 	ProcessVersions(dwSPIVersionsRequired, dwSrvcVersionsRequired, lpSPIVersion, lpSrvcVersion);
+	CapsBuildImage();
+
+	SpLockStatsEnable(SPConfigGetDword("LockStats", 0) != 0);
+
+	if (g_worker_pool.Start(SPConfigGetDword("WorkerThreads", WORKER_POOL_DEFAULT_THREADS)) != 0
+		|| g_result_reserve.Start(SPConfigGetDword("ResultReserve", RESULT_RESERVE_DEFAULT_SIZE)) != 0
+		|| g_execute_pool.Start(SPConfigGetDword("ExecuteThreads", std::thread::hardware_concurrency())) != 0
+		|| g_timer_wheel.Start() != 0
+		|| g_event_dispatcher.Start(SPConfigGetDword("EventThreads", EVENT_DEFAULT_THREADS),
+			SPConfigGetDword("EventQueueDepth", EVENT_DEFAULT_DEPTH),
+			SPConfigGetDword("EventOverflowPolicy", EVENT_POLICY_DROP_OLDEST),
+			SPConfigGetDword("EventSendTimeout", EVENT_DEFAULT_SEND_TIMEOUT)) != 0)
+	{
+		return WFS_ERR_INTERNAL_ERROR;
+	}
+
+	WFPLoadConfig();
+
+	WFS_DEVICE* device = WFPAcquireDevice(lpszLogicalName);
+	if (device == NULL)
+	{
+		return WFS_ERR_OUT_OF_MEMORY;
+	}
+
+	SESSION* session;
+	DWORD dwGeneration;
+	HRESULT hInsert = g_session_table.Insert(hService, &session, &dwGeneration, device);
+	if (hInsert != WFS_SUCCESS)
+	{
+		WFPReleaseDevice(device);
+		return hInsert;
+	}
+
+	{
+		std::lock_guard<SpMutex> lock(g_wfs_queue_mutex);
+		if (session->lpLane == NULL)
+			session->lpLane = LaneCreate(session, g_wfs_config.dwExecuteQueueDepth);
+		if (session->lpLane == NULL)
+		{
+			WFPAbortOpen(session, dwGeneration);
+			return WFS_ERR_OUT_OF_MEMORY;
+		}
+	}
 
 	g_hProvider = hProvider;
-	g_h_services[hService] = true;
 
 	LPWFSRESULT lpWFSResult;
-	if (WFMAllocateBuffer(sizeof(WFSRESULT), WFS_MEM_SHARE, (LPVOID*)&lpWFSResult) != WFS_SUCCESS)
+	if (g_result_reserve.Allocate(&lpWFSResult) != WFS_SUCCESS)
 	{
+		WFPAbortOpen(session, dwGeneration);
 		return WFS_ERR_INTERNAL_ERROR;
 	}
 
 	lpWFSResult->RequestID = reqId;
 	lpWFSResult->hService = hService;
-	lpWFSResult->lpBuffer = (LPVOID)(hWnd);
+	lpWFSResult->lpBuffer = NULL;
 	lpWFSResult->hResult = WFS_SUCCESS;
 
-	HANDLE hOpenThread;
-	DWORD dwThreadId;
-	hOpenThread = CreateThread(NULL, 0, WFPOpenProcess, lpWFSResult, 0, &dwThreadId);
-	return WFS_SUCCESS;
+	HRESULT hResult = WFPSubmitTimedProcess(WFPOpenProcess, lpWFSResult, hWnd, WFS_OPEN_COMPLETE, session, dwGeneration, dwTimeOut);
+	if (hResult != WFS_SUCCESS)
+	{
+		WFPAbortOpen(session, dwGeneration);
+	}
+	return hResult;
 }
 
 /*
  * @brief 
- * Entry point for a thread that closes device.
+ * Worker pool task that completes a close.
  * @param lpParam - A pointer to user-defined data passed to the thread.
  * @return int 0 on success, a negative value on failure.
  */
 DWORD WINAPI WFPCloseProcess(LPVOID lpParam)
 {
 	LPWFSRESULT lpWfsResult = (LPWFSRESULT)(lpParam);
-	HWND hWindowReturn = (HWND)(lpWfsResult);
-
-	CloseDevice();
+	HWND hWindowReturn = (HWND)(lpWfsResult->lpBuffer);
+	lpWfsResult->lpBuffer = NULL;
 
-	SendMessage(hWindowReturn, WFS_CLOSE_COMPLETE, 0, (LPARAM)lpParam);
+	WFPSendCompletion(hWindowReturn, WFS_CLOSE_COMPLETE, lpWfsResult);
 	return 0;
 }
 
@@ -233,20 +856,31 @@ DWORD WINAPI WFPCloseProcess(LPVOID lpParam)
  */
 HRESULT WINAPI WFPClose(HSERVICE hService, HWND hWnd, REQUESTID reqId)
 {
-	if (hService == NULL || g_h_services.find(hService) == g_h_services.end())
+	g_trace_recorder.Call(TRACE_CALL_CLOSE, hService, reqId, 0, 0);
+
+	DWORD dwGeneration;
+	SESSION* session = g_session_table.Find(hService, &dwGeneration);
+	if (session == NULL || !g_session_table.Detach(session, dwGeneration))
 	{
 		return WFS_ERR_INVALID_HSERVICE;
 	}
 
-	WaitForSingleObject(g_lock_mutex, INFINITE);
-	g_lock_state = UNLOCKED;
-	g_lock_hservice = NULL;
-	ReleaseMutex(g_lock_mutex);
+	LaneCancel(session->lpLane, 0, WFPOnRequestCancelled);
+	WFPCancelRequests(session, 0);
+	WFPCancelLockRequests(session, 0);
+	WFPReleaseLock(session);
 
-	g_h_services.erase(hService);
+	{
+		std::lock_guard<SpMutex> lock(g_wfs_event_mutex);
+		session->registrations.clear();
+		WFPPublishEventTable();
+	}
+
+	WFPReleaseDevice(session->lpDevice);
+	g_session_table.Free(session);
 
 	LPWFSRESULT lpWFSResult;
-	if (WFMAllocateBuffer(sizeof(WFSRESULT), WFS_MEM_SHARE, (LPVOID*)&lpWFSResult) != WFS_SUCCESS)
+	if (g_result_reserve.Allocate(&lpWFSResult) != WFS_SUCCESS)
 	{
 		return WFS_ERR_INTERNAL_ERROR;
 	}
@@ -256,39 +890,14 @@ HRESULT WINAPI WFPClose(HSERVICE hService, HWND hWnd, REQUESTID reqId)
 	lpWFSResult->lpBuffer = (LPVOID)(hWnd);
 	lpWFSResult->hResult = WFS_SUCCESS;
 
-	HANDLE hCloseThread;
-	DWORD dwThreadId;
-	hCloseThread = CreateThread(NULL, 0, WFPCloseProcess, lpWFSResult, 0, &dwThreadId);
-
-	return WFS_SUCCESS;
-}
-
-/*
- * @brief 
- * Entry point for a thread that locks device.
- * @param lpParam - A pointer to user-defined data passed to the thread.
- * @return int 0 on success, a negative value on failure.
- */
-DWORD WINAPI WFPLockProcess(LPVOID lpParam)
-{
-	LPWFSRESULT lpWfsResult = (LPWFSRESULT)(lpParam);
-	HWND hWindowReturn = (HWND)(lpWfsResult);
-
-	WaitForSingleObject(g_lock_mutex, INFINITE);
-
-	g_lock_state = LOCKED;
-	g_lock_hservice = lpWfsResult->hService;
-
-	ReleaseMutex(g_lock_mutex);
-
-	SendMessage(hWindowReturn, WFS_LOCK_COMPLETE, 0, (LPARAM)lpParam);
-	return 0;
+	return WFPSubmitProcess(WFPCloseProcess, lpWFSResult);
 }
 
 /*
  * @brief 
  *
- * Locks a XFS service provider, preventing access by other processes.
+ * Locks a XFS service provider, preventing access by other processes. While another session
+ * holds the lock the request waits, in arrival order, until it is granted or dwTimeOut expires.
  *
  * @param hService - Handle to the Service Provider
  * @param dwTimeOut - Number of milliseconds to wait for completion (WFS_INDEFINITE_WAIT to specify a 
@@ -302,58 +911,55 @@ DWORD WINAPI WFPLockProcess(LPVOID lpParam)
  */
 HRESULT WINAPI WFPLock(HSERVICE hService, DWORD dwTimeOut, HWND hWnd, REQUESTID reqId)
 {
-	if (hService == NULL || g_h_services.find(hService) == g_h_services.end())
-	{
-		return WFS_ERR_INVALID_HSERVICE;
-	}
-
-	WaitForSingleObject(g_lock_mutex, INFINITE);
+	g_trace_recorder.Call(TRACE_CALL_LOCK, hService, reqId, 0, dwTimeOut);
 
-	if (g_lock_state == LOCKED || g_lock_state == LOCK_PENDING)
+	DWORD dwGeneration;
+	SESSION* session = g_session_table.Find(hService, &dwGeneration);
+	if (session == NULL)
 	{
-		ReleaseMutex(g_lock_mutex);
-		return WFS_ERR_LOCKED;
+		return WFS_ERR_INVALID_HSERVICE;
 	}
 
-	g_lock_state = LOCK_PENDING;
-
-	ReleaseMutex(g_lock_mutex);
-
 	LPWFSRESULT lpWFSResult;
-	if (WFMAllocateBuffer(sizeof(WFSRESULT), WFS_MEM_SHARE, (LPVOID*)&lpWFSResult) != WFS_SUCCESS)
+	if (g_result_reserve.Allocate(&lpWFSResult) != WFS_SUCCESS)
 	{
 		return WFS_ERR_INTERNAL_ERROR;
 	}
 
 	lpWFSResult->RequestID = reqId;
 	lpWFSResult->hService = hService;
-	lpWFSResult->lpBuffer = (LPVOID)(hWnd);
+	lpWFSResult->lpBuffer = NULL;
 	lpWFSResult->hResult = WFS_SUCCESS;
 
-	HANDLE hCloseThread;
-	DWORD dwThreadId;
-	hCloseThread = CreateThread(NULL, 0, WFPLockProcess, lpWFSResult, 0, &dwThreadId);
+	WFS_MSG* msg = WFPNewRequest(lpWFSResult, hWnd, WFS_LOCK_COMPLETE, session, dwGeneration);
+	if (msg == NULL)
+	{
+		WFMFreeBuffer(lpWFSResult);
+		return WFS_ERR_INTERNAL_ERROR;
+	}
+
+	if (g_lock_manager.Acquire(session, msg, dwTimeOut, WFPOnRequestTimeout) == LOCK_GRANTED)
+	{
+		WFPPostCompletion(msg, WFS_SUCCESS);
+		delete msg;
+	}
 
 	return WFS_SUCCESS;
 }
 
 /*
  * @brief 
- * Entry point for a thread that unlocks device.
+ * Worker pool task that unlocks device.
  * @param lpParam - A pointer to user-defined data passed to the thread.
  * @return int 0 on success, a negative value on failure.
  */
 DWORD WINAPI WFPUnLockProcess(LPVOID lpParam)
 {
 	LPWFSRESULT lpWfsResult = (LPWFSRESULT)(lpParam);
-	HWND hWindowReturn = (HWND)(lpWfsResult);
-
-	WaitForSingleObject(g_lock_mutex, INFINITE);
-	g_lock_state = UNLOCKED;
-	g_lock_hservice = NULL;
-	ReleaseMutex(g_lock_mutex);
+	HWND hWindowReturn = (HWND)(lpWfsResult->lpBuffer);
+	lpWfsResult->lpBuffer = NULL;
 
-	SendMessage(hWindowReturn, WFS_UNLOCK_COMPLETE, 0, (LPARAM)lpParam);
+	WFPSendCompletion(hWindowReturn, WFS_UNLOCK_COMPLETE, lpWfsResult);
 	return 0;
 }
 
@@ -372,21 +978,21 @@ DWORD WINAPI WFPUnLockProcess(LPVOID lpParam)
  */
 HRESULT WINAPI WFPUnlock(HSERVICE hService, HWND hWnd, REQUESTID reqId)
 {
-	if (hService == NULL || g_h_services.find(hService) == g_h_services.end())
+	g_trace_recorder.Call(TRACE_CALL_UNLOCK, hService, reqId, 0, 0);
+
+	SESSION* session = g_session_table.Find(hService);
+	if (session == NULL)
 	{
 		return WFS_ERR_INVALID_HSERVICE;
 	}
 
-	WaitForSingleObject(g_lock_mutex, INFINITE);
-	if (g_lock_state == UNLOCKED)
+	if (!WFPReleaseLock(session))
 	{
-		ReleaseMutex(g_lock_mutex);
 		return WFS_ERR_LOCKED;
 	}
-	ReleaseMutex(g_lock_mutex);
 
 	LPWFSRESULT lpWFSResult;
-	if (WFMAllocateBuffer(sizeof(WFSRESULT), WFS_MEM_SHARE, (LPVOID*)&lpWFSResult) != WFS_SUCCESS)
+	if (g_result_reserve.Allocate(&lpWFSResult) != WFS_SUCCESS)
 	{
 		return WFS_ERR_INTERNAL_ERROR;
 	}
@@ -396,16 +1002,12 @@ HRESULT WINAPI WFPUnlock(HSERVICE hService, HWND hWnd, REQUESTID reqId)
 	lpWFSResult->lpBuffer = (LPVOID)(hWnd);
 	lpWFSResult->hResult = WFS_SUCCESS;
 
-	HANDLE hCloseThread;
-	DWORD dwThreadId;
-	hCloseThread = CreateThread(NULL, 0, WFPUnLockProcess, lpWFSResult, 0, &dwThreadId);
-
-	return WFS_SUCCESS;
+	return WFPSubmitProcess(WFPUnLockProcess, lpWFSResult);
 }
 
 /*
  * @brief 
- * Entry point for a thread that registers client
+ * Worker pool task that registers client
  * @param lpParam - A pointer to user-defined data passed to the thread.
  * @return int 0 on success, a negative value on failure.
  */
@@ -413,8 +1015,9 @@ DWORD WINAPI WFPRegisterProcess(LPVOID lpParam)
 {
 	LPWFSRESULT lpWfsResult = (LPWFSRESULT)(lpParam);
 	HWND hWindowReturn = (HWND)(lpWfsResult->lpBuffer);
+	lpWfsResult->lpBuffer = NULL;
 
-	SendMessage(hWindowReturn, WFS_REGISTER_COMPLETE, 0, (LPARAM)lpWfsResult);
+	WFPSendCompletion(hWindowReturn, WFS_REGISTER_COMPLETE, lpWfsResult);
 	return 0;
 }
 
@@ -436,7 +1039,11 @@ DWORD WINAPI WFPRegisterProcess(LPVOID lpParam)
  */
 HRESULT WINAPI WFPRegister(HSERVICE hService, DWORD dwEventClass, HWND hWndReg, HWND hWnd, REQUESTID reqId)
 {
-	if (hService == NULL || g_h_services.find(hService) == g_h_services.end())
+	g_trace_recorder.Call(TRACE_CALL_REGISTER, hService, reqId, dwEventClass, 0);
+
+	DWORD dwGeneration;
+	SESSION* session = g_session_table.Find(hService, &dwGeneration);
+	if (session == NULL)
 		return WFS_ERR_INVALID_HSERVICE;
 
 	if ((dwEventClass & SERVICE_EVENTS) != SERVICE_EVENTS
@@ -445,39 +1052,38 @@ HRESULT WINAPI WFPRegister(HSERVICE hService, DWORD dwEventClass, HWND hWndReg,
 		&& (dwEventClass & EXECUTE_EVENTS) != EXECUTE_EVENTS)
 		return WFS_ERR_USER_ERROR;
 
-	if (g_wfs_event.find(hWndReg) != g_wfs_event.end())
 	{
-		g_wfs_event[hWndReg].dwEvent |= dwEventClass;
-	}
-	else
-	{
-		WFS_EVENTS wfsEvent;
-		wfsEvent.hService = hService;
-		wfsEvent.dwEvent = dwEventClass;
-		g_wfs_event[hWndReg] = wfsEvent;
+		// The window must reach the dispatcher before the table that routes events to it,
+		// and under the same lock, or a concurrent publish could drop it again.
+		// A session current here is not freed before the lock is released, as closing it
+		// clears its registrations under the lock first; its device is stable meanwhile.
+		std::lock_guard<SpMutex> lock(g_wfs_event_mutex);
+		if (!g_session_table.IsCurrent(session, dwGeneration))
+			return WFS_ERR_INVALID_HSERVICE;
+		SESSION_REGISTRATION& registration = session->registrations[hWndReg];
+		registration.dwEventClass |= dwEventClass;
+		registration.lpDevice = session->lpDevice;
+		g_event_dispatcher.Add(hWndReg);
+		WFPPublishEventTable();
 	}
 
 	LPWFSRESULT lpWFSResult;
-	if (WFMAllocateBuffer(sizeof(WFSRESULT), WFS_MEM_SHARE, (LPVOID*)&lpWFSResult) != WFS_SUCCESS)
+	if (g_result_reserve.Allocate(&lpWFSResult) != WFS_SUCCESS)
 	{
 		return WFS_ERR_INTERNAL_ERROR;
 	}
 
 	lpWFSResult->RequestID = reqId;
 	lpWFSResult->hService = hService;
-	lpWFSResult->lpBuffer = hWndReg;
+	lpWFSResult->lpBuffer = hWnd;
 	lpWFSResult->u.dwCommandCode = dwEventClass;
 
-	HANDLE hGetInfoThread;
-	DWORD dwThreadId;
-	hGetInfoThread = CreateThread(NULL, 0, WFPRegisterProcess, lpWFSResult, 0, &dwThreadId);
-
-	return WFS_SUCCESS;
+	return WFPSubmitProcess(WFPRegisterProcess, lpWFSResult);
 }
 
 /*
  * @brief 
- * Entry point for a thread that deregisters client
+ * Worker pool task that deregisters client
  * @param lpParam - A pointer to user-defined data passed to the thread.
  * @return int 0 on success, a negative value on failure.
  */
@@ -487,7 +1093,7 @@ DWORD WINAPI WFPDeRegisterProcess(LPVOID lpParam)
 	HWND hWindowReturn = (HWND)(lpWfsResult->lpBuffer);
 	lpWfsResult->lpBuffer = NULL;
 
-	SendMessage(hWindowReturn, WFS_DEREGISTER_COMPLETE, 0, (LPARAM)lpWfsResult);
+	WFPSendCompletion(hWindowReturn, WFS_DEREGISTER_COMPLETE, lpWfsResult);
 	return 0;
 }
 
@@ -509,23 +1115,37 @@ DWORD WINAPI WFPDeRegisterProcess(LPVOID lpParam)
  */
 HRESULT WINAPI WFPDeregister(HSERVICE hService, DWORD dwEventClass, HWND hWndReg, HWND hWnd, REQUESTID reqId)
 {
-	if (hWndReg == NULL) {
-		g_wfs_event.clear();
-	}
-	else if (g_wfs_event.find(hWndReg) != g_wfs_event.end())
-	{
-		g_wfs_event[hWndReg].dwEvent &= (~dwEventClass);
+	g_trace_recorder.Call(TRACE_CALL_DEREGISTER, hService, reqId, dwEventClass, 0);
+
+	DWORD dwGeneration;
+	SESSION* session = g_session_table.Find(hService, &dwGeneration);
+	if (session == NULL)
+		return WFS_ERR_INVALID_HSERVICE;
 
-		if (g_wfs_event[hWndReg].dwEvent == 0)
-			g_wfs_event.erase(hWndReg);
-	}
-	else
 	{
-		return WFS_ERR_INVALID_HWNDREG;
+		std::lock_guard<SpMutex> lock(g_wfs_event_mutex);
+		if (!g_session_table.IsCurrent(session, dwGeneration))
+			return WFS_ERR_INVALID_HSERVICE;
+		std::map<HWND, SESSION_REGISTRATION>::iterator it = session->registrations.find(hWndReg);
+		if (hWndReg == NULL) {
+			session->registrations.clear();
+		}
+		else if (it != session->registrations.end())
+		{
+			(*it).second.dwEventClass &= (~dwEventClass);
+
+			if ((*it).second.dwEventClass == 0)
+				session->registrations.erase(it);
+		}
+		else
+		{
+			return WFS_ERR_INVALID_HWNDREG;
+		}
+		WFPPublishEventTable();
 	}
 
 	LPWFSRESULT lpWFSResult;
-	if (WFMAllocateBuffer(sizeof(WFSRESULT), WFS_MEM_SHARE, (LPVOID*)&lpWFSResult) != WFS_SUCCESS)
+	if (g_result_reserve.Allocate(&lpWFSResult) != WFS_SUCCESS)
 	{
 		return WFS_ERR_INTERNAL_ERROR;
 	}
@@ -535,23 +1155,21 @@ HRESULT WINAPI WFPDeregister(HSERVICE hService, DWORD dwEventClass, HWND hWndReg
 	lpWFSResult->lpBuffer = hWnd;
 	lpWFSResult->u.dwCommandCode = dwEventClass;
 
-	HANDLE hGetInfoThread;
-	DWORD dwThreadId;
-	hGetInfoThread = CreateThread(NULL, 0, WFPDeRegisterProcess, lpWFSResult, 0, &dwThreadId);
-	return WFS_SUCCESS;
+	return WFPSubmitProcess(WFPDeRegisterProcess, lpWFSResult);
 }
 
 /*
  * @brief 
  *
- * Provide informations
+ * Provide informations from a status snapshot published by the device
  *
  * @param wfs_result - Pointer to the WFSRESULT structure containing the result status.
+ * @param status - The device status to report.
  *
  */
-void ProcessGetInfoStatus(LPWFSRESULT wfs_result)
+void ProcessGetInfoStatus(LPWFSRESULT wfs_result, const DEVICE_STATUS& status)
 {
-	HRESULT res = WFMAllocateMore(sizeof(WFSALMSTATUS), wfs_result, &wfs_result->lpBuffer);
+	HRESULT res = g_result_reserve.AllocatePayload(wfs_result, sizeof(WFSALMSTATUS), &wfs_result->lpBuffer);
 	if (res != WFS_SUCCESS)
 	{
 		wfs_result->hResult = WFS_ERR_INTERNAL_ERROR;
@@ -560,9 +1178,9 @@ void ProcessGetInfoStatus(LPWFSRESULT wfs_result)
 	{
 		LPWFSALMSTATUS lpStatus = (LPWFSALMSTATUS)wfs_result->lpBuffer;
 
-		lpStatus->fwDevice = WFS_ALM_DEVONLINE;
-		lpStatus->bAlarmSet = FALSE;
-		lpStatus->wAntiFraudModule = WFS_ALM_AFMOK;
+		lpStatus->fwDevice = status.fwDevice;
+		lpStatus->bAlarmSet = status.bAlarmSet;
+		lpStatus->wAntiFraudModule = status.wAntiFraudModule;
 		lpStatus->lpszExtra = NULL;
 	}
 }
@@ -570,56 +1188,280 @@ void ProcessGetInfoStatus(LPWFSRESULT wfs_result)
 /*
  * @brief 
  *
- * Provide capabilities
+ * Provide capabilities from the image built at open
  *
  * @param wfs_result - Pointer to the WFSRESULT structure containing the result status.
  *
  */
 void ProcessGetInfoCapabilities(LPWFSRESULT wfs_result)
 {
-	HRESULT res = WFMAllocateMore(sizeof(WFSALMCAPS), wfs_result, &wfs_result->lpBuffer);
-	if (res != WFS_SUCCESS)
+	if (CapsCopyImage(wfs_result) != WFS_SUCCESS)
 	{
 		wfs_result->hResult = WFS_ERR_INTERNAL_ERROR;
 	}
-	else
+}
+
+/*
+ * @brief 
+ * Completes a status request from a status read. A request whose session closed
+ * meanwhile is cancelled instead.
+ * @param msg - The request, queued.
+ * @param hResult - The result of the read.
+ * @param status - The status returned by the read, valid when hResult is WFS_SUCCESS.
+ */
+static void WFPCompleteStatusRequest(WFS_MSG* msg, HRESULT hResult, const DEVICE_STATUS& status)
+{
+	if (!g_session_table.IsCurrent(msg->lpSession, msg->dwGeneration))
+		hResult = WFS_ERR_CANCELED;
+
+	if (WFPBeginRequest(msg) && WFPEndRequest(msg))
+	{
+		LPWFSRESULT lpWfsResult = msg->lpWFSResult;
+		lpWfsResult->hResult = hResult;
+		if (hResult == WFS_SUCCESS)
+			ProcessGetInfoStatus(lpWfsResult, status);
+		WFPSendCompletion(msg->hWnd, WFS_GETINFO_COMPLETE, lpWfsResult);
+	}
+
+	WFPReleaseRequest(msg);
+}
+
+/*
+ * @brief 
+ * Worker pool task that reads the device status for the request that opened the flight,
+ * and completes it together with every request that attached to the flight meanwhile.
+ * The read is done even when the opening request timed out, since others may wait on it.
+ * @param lpParam - The WFS_MSG that opened the flight.
+ * @return int 0 on success, a negative value on failure.
+ */
+DWORD WINAPI WFPStatusReadProcess(LPVOID lpParam)
+{
+	WFS_MSG* msg = (WFS_MSG*)(lpParam);
+	WFS_DEVICE* device = msg->lpDevice;
+	WFS_STATUS_FLIGHT& flight = device->flight;
+
+	DEVICE_STATUS status;
+	HRESULT hResult = WFS_SUCCESS;
+	if (device->device.ReadStatus(&status) != 0)
+		hResult = WFS_ERR_DEV_NOT_READY;
+
+	std::vector<WFS_MSG*> waiters;
+	{
+		std::lock_guard<SpMutex> lock(flight.mutex);
+		waiters.swap(flight.waiters);
+		flight.bInFlight = false;
+	}
+
+	WFPCompleteStatusRequest(msg, hResult, status);
+	for (size_t i = 0; i < waiters.size(); i++)
+		WFPCompleteStatusRequest(waiters[i], hResult, status);
+	return 0;
+}
+
+/*
+ * @brief 
+ * Queues a status request. A request that finds a read of its device in flight, that is
+ * queued or running but not finished, attaches to it; otherwise it opens a flight and
+ * a worker reads the status for it.
+ * @param lpWFSResult - The result block of the request.
+ * @param hWnd - The window handle which is to receive the completion message.
+ * @param session - The session the request belongs to.
+ * @param dwGeneration - The generation of the session.
+ * @param dwTimeOut - Number of milliseconds to wait for completion, WFS_INDEFINITE_WAIT for none.
+ * @return HRESULT - WFS_SUCCESS on success, WFS_ERR_INTERNAL_ERROR on failure.
+ */
+static HRESULT WFPSubmitStatusRequest(LPWFSRESULT lpWFSResult, HWND hWnd, SESSION* session, DWORD dwGeneration, DWORD dwTimeOut)
+{
+	WFS_MSG* msg = WFPNewRequest(lpWFSResult, hWnd, WFS_GETINFO_COMPLETE, session, dwGeneration);
+	if (msg == NULL)
+	{
+		WFMFreeBuffer(lpWFSResult);
+		return WFS_ERR_INTERNAL_ERROR;
+	}
+
+	WFPTrackRequest(msg);
+	if (dwTimeOut != WFS_INDEFINITE_WAIT)
+		g_timer_wheel.Schedule(&msg->timer, dwTimeOut, WFPOnRequestTimeout, msg);
+
+	WFS_STATUS_FLIGHT& flight = msg->lpDevice->flight;
 	{
-		LPWFSALMCAPS lpCaps = (LPWFSALMCAPS)wfs_result->lpBuffer;
+		std::lock_guard<SpMutex> lock(flight.mutex);
+		if (flight.bInFlight)
+		{
+			flight.waiters.push_back(msg);
+			flight.dwCoalesced++;
+			return WFS_SUCCESS;
+		}
+		flight.bInFlight = true;
+		flight.dwIssued++;
+	}
+
+	if (g_worker_pool.Submit(WFPStatusReadProcess, msg) == 0)
+		return WFS_SUCCESS;
 
-		lpCaps->wClass = WFS_SERVICE_CLASS_ALM;
-		lpCaps->bProgrammaticallyDeactivate = TRUE;
-		lpCaps->lpszExtra = NULL;
-		lpCaps->bAntiFraudModule = TRUE;
-		lpCaps->lpdwSynchronizableCommands = NULL;
+	// No worker took the read: fail the requests that attached meanwhile, and this one
+	// unless it already timed out.
+	std::vector<WFS_MSG*> waiters;
+	{
+		std::lock_guard<SpMutex> lock(flight.mutex);
+		waiters.swap(flight.waiters);
+		flight.bInFlight = false;
 	}
+
+	DEVICE_STATUS status;
+	for (size_t i = 0; i < waiters.size(); i++)
+		WFPCompleteStatusRequest(waiters[i], WFS_ERR_INTERNAL_ERROR, status);
+
+	LONG lExpected = WFS_MSG_QUEUED;
+	BOOL bOwned = msg->lState.compare_exchange_strong(lExpected, WFS_MSG_DONE);
+	WFPReleaseRequest(msg);
+	if (bOwned)
+	{
+		WFMFreeBuffer(lpWFSResult);
+		return WFS_ERR_INTERNAL_ERROR;
+	}
+	return WFS_SUCCESS;
+}
+
+/*
+ * @brief 
+ * Reads the request counters of an open session.
+ * @param hService - Handle of the session.
+ * @param lpCounters - Receives the number of Execute, GetInfo and CancelAsyncRequest
+ *	calls made on the session since it was opened.
+ * @return BOOL TRUE on success, FALSE when the session is not open.
+ */
+BOOL WFPQuerySessionCounters(HSERVICE hService, WFS_SESSION_COUNTERS* lpCounters)
+{
+	SESSION* session = g_session_table.Find(hService);
+	if (session == NULL)
+		return FALSE;
+
+	lpCounters->dwExecuteRequests = session->dwExecuteRequests;
+	lpCounters->dwInfoRequests = session->dwInfoRequests;
+	lpCounters->dwCancelRequests = session->dwCancelRequests;
+	return TRUE;
+}
+
+/*
+ * @brief 
+ * Reads the open and close counters of a device.
+ * @param lpszLogicalName - The logical service name of the device.
+ * @param lpCounters - Receives the number of times the device was opened and closed.
+ * @return BOOL TRUE on success, FALSE when no session ever opened the device.
+ */
+BOOL WFPQueryDeviceCounters(LPCSTR lpszLogicalName, WFS_DEVICE_COUNTERS* lpCounters)
+{
+	std::lock_guard<SpMutex> lock(g_wfs_device_mutex);
+	std::map<std::string, WFS_DEVICE*>::iterator it = g_wfs_devices.find(lpszLogicalName ? lpszLogicalName : "");
+	if (it == g_wfs_devices.end())
+		return FALSE;
+
+	lpCounters->dwOpens = it->second->dwOpens;
+	lpCounters->dwCloses = it->second->dwCloses;
+	return TRUE;
 }
 
 /*
  * @brief 
- * Entry point for a thread that performs information retrieval.
+ * Reads the status read counters of a device.
+ * @param lpszLogicalName - The logical service name of the device.
+ * @param lpCounters - Receives the number of requests answered from the status snapshot,
+ *	of reads issued, and of requests that attached to a read already in flight.
+ * @return BOOL TRUE on success, FALSE when no session ever opened the device.
+ */
+BOOL WFPQueryStatusCounters(LPCSTR lpszLogicalName, WFS_STATUS_COUNTERS* lpCounters)
+{
+	std::lock_guard<SpMutex> lock(g_wfs_device_mutex);
+	std::map<std::string, WFS_DEVICE*>::iterator it = g_wfs_devices.find(lpszLogicalName ? lpszLogicalName : "");
+	if (it == g_wfs_devices.end())
+		return FALSE;
+
+	lpCounters->dwSnapshot = it->second->flight.dwSnapshot;
+	lpCounters->dwIssued = it->second->flight.dwIssued;
+	lpCounters->dwCoalesced = it->second->flight.dwCoalesced;
+	return TRUE;
+}
+
+/*
+ * @brief 
+ * Worker pool task that performs information retrieval.
  * @param lpParam - A pointer to user-defined data passed to the thread.
  * @return int 0 on success, a negative value on failure.
  */
 DWORD WINAPI WFPGetInfoProcess(LPVOID lpParam)
 {
-	LPWFSRESULT lpWfsResult = (LPWFSRESULT)(lpParam);
-	HWND hWindowReturn = (HWND)(lpWfsResult->lpBuffer);
+	WFS_MSG* msg = (WFS_MSG*)(lpParam);
+	LPWFSRESULT lpWfsResult = msg->lpWFSResult;
 
-	if (lpWfsResult->u.dwCommandCode == WFS_INF_ALM_CAPABILITIES)
+	if (!WFPBeginRequest(msg))
 	{
-		ProcessGetInfoCapabilities(lpWfsResult);
-		lpWfsResult->hResult = WFS_SUCCESS;
+		WFPReleaseRequest(msg);
+		return 0;
+	}
+
+	if (!WFPEndRequest(msg))
+	{
+		WFPReleaseRequest(msg);
+		return 0;
 	}
-	else if (lpWfsResult->u.dwCommandCode == WFS_INF_ALM_STATUS)
+
+	if (!g_session_table.IsCurrent(msg->lpSession, msg->dwGeneration))
 	{
-		ProcessGetInfoStatus(lpWfsResult);
+		lpWfsResult->hResult = WFS_ERR_CANCELED;
+	}
+	else if (msg->dwCommand == WFS_INF_ALM_CAPABILITIES)
+	{
+		ProcessGetInfoCapabilities(lpWfsResult);
 		lpWfsResult->hResult = WFS_SUCCESS;
 	}
 
-	SendMessage(hWindowReturn, WFS_GETINFO_COMPLETE, 0, (LPARAM)lpParam);
+	WFPSendCompletion(msg->hWnd, WFS_GETINFO_COMPLETE, lpWfsResult);
+
+	WFPReleaseRequest(msg);
 	return 0;
 }
 
+/*
+ * @brief 
+ * Answers a GetInfo request on the calling thread when the answer is already in memory:
+ * the capabilities, and the status while the device publishes a valid snapshot, which
+ * is read without locking. Without a snapshot, status requests take the asynchronous
+ * path so that concurrent pollers share one device read. The completion is posted, so
+ * it still reaches the application after WFPGetInfo has returned. Setting InlineGetInfo
+ * to 0 sends every request down the asynchronous path, for comparison.
+ * @param lpWFSResult - The prepared result block.
+ * @param hWnd - The window handle which is to receive the completion message.
+ * @param device - The device of the session.
+ * @return BOOL - TRUE when the request was completed, FALSE when it must take the
+ *                asynchronous path.
+ */
+static BOOL WFPGetInfoInline(LPWFSRESULT lpWFSResult, HWND hWnd, WFS_DEVICE* device)
+{
+	DEVICE_STATUS status;
+	if (lpWFSResult->u.dwCommandCode == WFS_INF_ALM_CAPABILITIES)
+	{
+		lpWFSResult->hResult = WFS_SUCCESS;
+		ProcessGetInfoCapabilities(lpWFSResult);
+	}
+	else if (lpWFSResult->u.dwCommandCode == WFS_INF_ALM_STATUS && device->device.GetStatus(&status) == 0)
+	{
+		lpWFSResult->hResult = WFS_SUCCESS;
+		ProcessGetInfoStatus(lpWFSResult, status);
+		device->flight.dwSnapshot++;
+	}
+	else
+	{
+		return FALSE;
+	}
+
+	g_trace_recorder.Completion(WFS_GETINFO_COMPLETE, lpWFSResult);
+	if (!PlatformPostMessage(hWnd, WFS_GETINFO_COMPLETE, lpWFSResult))
+		WFMFreeBuffer(lpWFSResult);
+
+	return TRUE;
+}
+
 /*
  * @brief 
 *
@@ -645,28 +1487,51 @@ DWORD WINAPI WFPGetInfoProcess(LPVOID lpParam)
  */
 HRESULT WINAPI WFPGetInfo(HSERVICE hService, DWORD dwCategory, LPVOID lpQueryDetails, DWORD dwTimeOut, HWND hWnd, REQUESTID reqId)
 {
-	if (hService == NULL || g_h_services.find(hService) == g_h_services.end())
+	UNREFERENCED_PARAMETER(lpQueryDetails);
+
+	g_trace_recorder.Call(TRACE_CALL_GETINFO, hService, reqId, dwCategory, dwTimeOut);
+
+	DWORD dwGeneration;
+	SESSION* session = g_session_table.Find(hService, &dwGeneration);
+	if (session == NULL)
+	{
+		return WFS_ERR_INVALID_HSERVICE;
+	}
+
+	// The device is read before the session is checked again, so a session closed and
+	// reused meanwhile cannot answer from the device of its successor.
+	WFS_DEVICE* device = session->lpDevice;
+	if (!g_session_table.IsCurrent(session, dwGeneration))
 	{
 		return WFS_ERR_INVALID_HSERVICE;
 	}
 
+	session->dwInfoRequests++;
+
+	RESULT_CLASS eClass = RESULT_CLASS_SMALL;
+	if (dwCategory == WFS_INF_ALM_STATUS)
+		eClass = RESULT_CLASS_STATUS;
+	else if (dwCategory == WFS_INF_ALM_CAPABILITIES)
+		eClass = RESULT_CLASS_CAPS;
+
 	LPWFSRESULT lpWFSResult;
-	if (WFMAllocateBuffer(sizeof(WFSRESULT), WFS_MEM_SHARE | WFS_MEM_ZEROINIT, (LPVOID*)&lpWFSResult) != WFS_SUCCESS)
+	if (g_result_reserve.Allocate(&lpWFSResult, eClass) != WFS_SUCCESS)
 	{
 		return WFS_ERR_INTERNAL_ERROR;
 	}
 
 	lpWFSResult->RequestID = reqId;
 	lpWFSResult->hService = hService;
-	lpWFSResult->lpBuffer = (LPVOID)(hWnd);
+	lpWFSResult->lpBuffer = NULL;
 	lpWFSResult->u.dwCommandCode = dwCategory;
 
+	if (g_wfs_config.bInlineGetInfo && WFPGetInfoInline(lpWFSResult, hWnd, device))
+		return WFS_SUCCESS;
 
-	HANDLE hCloseThread;
-	DWORD dwThreadId;
-	hCloseThread = CreateThread(NULL, 0, WFPGetInfoProcess, lpWFSResult, 0, &dwThreadId);
+	if (dwCategory == WFS_INF_ALM_STATUS)
+		return WFPSubmitStatusRequest(lpWFSResult, hWnd, session, dwGeneration, dwTimeOut);
 
-	return WFS_SUCCESS;
+	return WFPSubmitTimedProcess(WFPGetInfoProcess, lpWFSResult, hWnd, WFS_GETINFO_COMPLETE, session, dwGeneration, dwTimeOut);
 }
 
 /*
@@ -675,12 +1540,13 @@ HRESULT WINAPI WFPGetInfo(HSERVICE hService, DWORD dwCategory, LPVOID lpQueryDet
  * Executes a command to reset alarms
  *
  * @param wfs_result - Pointer to the WFSRESULT structure containing the result status.
+ * @param device - The device of the session.
  *
  */
-void WFPExecuteResetAlarmCommand(LPWFSRESULT wfs_result)
+void WFPExecuteResetAlarmCommand(LPWFSRESULT wfs_result, MockDevice* device)
 {
 	wfs_result->hResult = WFS_SUCCESS;
-	if(ResetAlarm())
+	if(device->ResetAlarm())
 		wfs_result->hResult = WFS_ERR_INTERNAL_ERROR;
 	
 	wfs_result->lpBuffer = NULL;
@@ -692,12 +1558,13 @@ void WFPExecuteResetAlarmCommand(LPWFSRESULT wfs_result)
  * Executes a command to reset alarm command
  *
  * @param wfs_result - Pointer to the WFSRESULT structure containing the result status.
+ * @param device - The device of the session.
  *
  */
-void WFPExecuteResetDeviceCommand(LPWFSRESULT wfs_result)
+void WFPExecuteResetDeviceCommand(LPWFSRESULT wfs_result, MockDevice* device)
 {
 	wfs_result->hResult = WFS_SUCCESS;
-	if (ResetDevice())
+	if (device->Reset())
 		wfs_result->hResult = WFS_ERR_INTERNAL_ERROR;
 
 	wfs_result->lpBuffer = NULL;
@@ -705,50 +1572,103 @@ void WFPExecuteResetDeviceCommand(LPWFSRESULT wfs_result)
 
 /*
  * @brief 
- * Entry point for a thread responsible for executing SP operations.
- * @param lpParam - A pointer to user-defined data passed to the thread.
+ * Executor pool task that drains the lane of one session. A lane is scheduled at most
+ * once at a time, so the requests of a session run in submission order while other
+ * sessions run on the remaining executor threads.
+ * @param lpParam - The WFS_LANE to drain.
  * @return int 0 on success, a negative value on failure.
  */
-DWORD WINAPI WFPExecuteThread(LPVOID lpParam)
+DWORD WINAPI WFPExecuteLaneProcess(LPVOID lpParam)
 {
-	while (TRUE)
+	WFS_LANE* lane = (WFS_LANE*)lpParam;
+
+	do
 	{
-		WaitForSingleObject(g_wfs_queue_mutex, INFINITE);
-		if (!g_wfs_msg_queue.empty())
+		WFS_MSG* msg;
+		while ((msg = LanePeek(lane)) != NULL)
 		{
-			WFS_MSG* msg = g_wfs_msg_queue.front();
 			LPWFSRESULT lpWfsResult = msg->lpWFSResult;
 			HWND hWindowReturn = (HWND)msg->hWnd;
-			g_wfs_msg_queue.pop_front();
-			ReleaseMutex(g_wfs_queue_mutex);
 
-			if (msg->bCancelled == TRUE)
+			if (LaneBegin(lane, msg))
 			{
-				msg->lpWFSResult->hResult = WFS_ERR_CANCELED;
-			}
-			else
-			{
-				if (lpWfsResult->u.dwCommandCode == WFS_CMD_ALM_RESET_ALARM)
+				WFSRESULT result;
+				memset(&result, 0, sizeof(result));
+				if (!g_session_table.IsCurrent(msg->lpSession, msg->dwGeneration))
+				{
+					// Left behind by a session that closed since.
+					result.hResult = WFS_ERR_CANCELED;
+				}
+				else if (msg->dwCommand == WFS_CMD_ALM_RESET_ALARM)
 				{
-					WFPExecuteResetAlarmCommand(lpWfsResult);
+					WFPExecuteResetAlarmCommand(&result, &msg->lpDevice->device);
 				}
-				else if (lpWfsResult->u.dwCommandCode == WFS_CMD_ALM_RESET)
+				else if (msg->dwCommand == WFS_CMD_ALM_RESET)
+				{
+					WFPExecuteResetDeviceCommand(&result, &msg->lpDevice->device);
+				}
+
+				if (WFPEndRequest(msg))
 				{
-					WFPExecuteResetDeviceCommand(lpWfsResult);
+					lpWfsResult->hResult = result.hResult;
+					lpWfsResult->lpBuffer = result.lpBuffer;
+					WFPSendCompletion(hWindowReturn, WFS_EXECUTE_COMPLETE, lpWfsResult);
 				}
 			}
-			SendMessage(hWindowReturn, WFS_EXECUTE_COMPLETE, NULL, (LPARAM)lpWfsResult);
 
-			free(msg);
+			g_timer_wheel.Cancel(&msg->timer);
+			LanePop(lane);
+			lane->lpSession->lPendingExecutes--;
 		}
-		else
+
+		lane->bScheduled.store(false);
+	} while (LanePeek(lane) != NULL && !lane->bScheduled.exchange(true));
+
+	return 0;
+}
+
+/*
+ * @brief 
+ * Empties a lane the execute pool refused to drain, which only happens once the pool
+ * stopped. The caller set bScheduled, so it is the only consumer of the lane. Its own
+ * request is withdrawn, as WFPExecute reports the error itself; every other queued
+ * request is completed with WFS_ERR_CANCELED.
+ * @param lane - The lane.
+ * @param lpWFSResult - The result block of the request the caller pushed.
+ * @return BOOL TRUE if the caller's request was withdrawn, FALSE if its timeout or a
+ *         cancellation completed it first.
+ */
+static BOOL WFPAbandonLane(WFS_LANE* lane, LPWFSRESULT lpWFSResult)
+{
+	BOOL bWithdrawn = FALSE;
+
+	do
+	{
+		WFS_MSG* msg;
+		while ((msg = LanePeek(lane)) != NULL)
 		{
-			ReleaseMutex(g_wfs_queue_mutex);
+			g_timer_wheel.Cancel(&msg->timer);
+			if (LaneBegin(lane, msg) && WFPEndRequest(msg))
+			{
+				if (msg->lpWFSResult == lpWFSResult)
+				{
+					WFMFreeBuffer(lpWFSResult);
+					bWithdrawn = TRUE;
+				}
+				else
+				{
+					WFPPostCompletion(msg, WFS_ERR_CANCELED);
+				}
+			}
+
+			LanePop(lane);
+			lane->lpSession->lPendingExecutes--;
 		}
-		Sleep(1000L);
-	}
 
-	return 0;
+		lane->bScheduled.store(false);
+	} while (LanePeek(lane) != NULL && !lane->bScheduled.exchange(true));
+
+	return bWithdrawn;
 }
 
 /*
@@ -765,23 +1685,29 @@ DWORD WINAPI WFPExecuteThread(LPVOID lpParam)
  * @param reqId - Request identification number.
  *
  * @return HRESULT - WFS_SUCCESS on success, an error code on failure. Specific error codes
- *                  should be documented elsewhere in the project.
+ *                  should be documented elsewhere in the project. WFS_ERR_OUT_OF_MEMORY is
+ *                  returned when the execute lane of the session is full.
  *
  */
 HRESULT WINAPI WFPExecute(HSERVICE hService, DWORD dwCommand, LPVOID lpCmdData, DWORD dwTimeOut, HWND hWnd, REQUESTID reqId)
 {
-	if (hService == NULL || g_h_services.find(hService) == g_h_services.end())
+	UNREFERENCED_PARAMETER(lpCmdData);
+
+	g_trace_recorder.Call(TRACE_CALL_EXECUTE, hService, reqId, dwCommand, dwTimeOut);
+
+	DWORD dwGeneration;
+	SESSION* session = g_session_table.Find(hService, &dwGeneration);
+	if (session == NULL)
 	{
 		return WFS_ERR_INVALID_HSERVICE;
 	}
 
-	WaitForSingleObject(g_lock_mutex, INFINITE);
-	if (g_lock_state == LOCKED && g_lock_hservice != hService)
+	session->dwExecuteRequests++;
+
+	if (!g_lock_manager.IsAdmitted(session))
 	{
-		ReleaseMutex(g_lock_mutex);
 		return WFS_ERR_LOCKED;
 	}
-	ReleaseMutex(g_lock_mutex);
 
 	if (dwCommand == WFS_CMD_ALM_SYNCHRONIZE_COMMAND || dwCommand == WFS_CMD_ALM_SET_ALARM || dwCommand == WFS_CMD_ALM_RESET_ALARM)
 	{
@@ -789,7 +1715,7 @@ HRESULT WINAPI WFPExecute(HSERVICE hService, DWORD dwCommand, LPVOID lpCmdData,
 	}
 
 	LPWFSRESULT lpWFSResult;
-	if (WFMAllocateBuffer(sizeof(WFSRESULT), WFS_MEM_SHARE, (LPVOID*)&lpWFSResult) != WFS_SUCCESS)
+	if (g_result_reserve.Allocate(&lpWFSResult) != WFS_SUCCESS)
 	{
 		return WFS_ERR_INTERNAL_ERROR;
 	}
@@ -798,21 +1724,23 @@ HRESULT WINAPI WFPExecute(HSERVICE hService, DWORD dwCommand, LPVOID lpCmdData,
 	lpWFSResult->hService = hService;
 	lpWFSResult->u.dwCommandCode = dwCommand;
 
-	WFS_MSG* msgData = (WFS_MSG*)malloc(sizeof(WFS_MSG));
-	msgData->lpWFSResult = lpWFSResult;
-	msgData->hWnd = hWnd;
-	msgData->bCancelled = false;
-	msgData->lpDataReceived = NULL;
+	WFS_LANE* lane = session->lpLane;
 
-	DWORD dwThreadId;
-	if (hExecuteThread == NULL)
+	session->lPendingExecutes++;
+	if (!LaneTryPush(lane, hWnd, lpWFSResult, dwGeneration, dwTimeOut, WFPOnRequestTimeout))
 	{
-		hExecuteThread = CreateThread(NULL, 0, WFPExecuteThread, 0, 0, &dwThreadId);
+		session->lPendingExecutes--;
+		WFMFreeBuffer(lpWFSResult);
+		return WFS_ERR_OUT_OF_MEMORY;
 	}
 
-	WaitForSingleObject(g_wfs_queue_mutex, INFINITE);
-	g_wfs_msg_queue.push_back(msgData);
-	ReleaseMutex(g_wfs_queue_mutex);
+	if (!lane->bScheduled.exchange(true) && g_execute_pool.Submit(WFPExecuteLaneProcess, lane) != 0)
+	{
+		// The request is already published and its timer armed; take it back so the
+		// application gets either this error or a completion, never both.
+		if (WFPAbandonLane(lane, lpWFSResult))
+			return WFS_ERR_INTERNAL_ERROR;
+	}
 
 	return WFS_SUCCESS;
 }
@@ -832,24 +1760,19 @@ HRESULT WINAPI WFPExecute(HSERVICE hService, DWORD dwCommand, LPVOID lpCmdData,
  */
 HRESULT WINAPI WFPCancelAsyncRequest(HSERVICE hService, REQUESTID reqId)
 {
-	if (hService == NULL || g_h_services.find(hService) == g_h_services.end())
+	g_trace_recorder.Call(TRACE_CALL_CANCEL, hService, reqId, 0, 0);
+
+	SESSION* session = g_session_table.Find(hService);
+	if (session == NULL)
 	{
 		return WFS_ERR_INVALID_HSERVICE;
 	}
 
-	WaitForSingleObject(g_wfs_queue_mutex, INFINITE);
-	std::deque<WFS_MSG*>::iterator it;
-	for (it = g_wfs_msg_queue.begin(); it != g_wfs_msg_queue.end(); ++it)
-	{
-		if ((*it)->lpWFSResult->hService == hService)
-		{
-			if ((reqId == NULL) || ((*it)->lpWFSResult->RequestID == reqId))
-			{
-				(*it)->bCancelled = true;
-			}
-		}
-	}
-	ReleaseMutex(g_wfs_queue_mutex);
+	session->dwCancelRequests++;
+	LaneCancel(session->lpLane, reqId, WFPOnRequestCancelled);
+	WFPCancelRequests(session, reqId);
+	WFPCancelLockRequests(session, reqId);
+
 	return WFS_SUCCESS;
 }
 
@@ -867,6 +1790,8 @@ HRESULT WINAPI WFPCancelAsyncRequest(HSERVICE hService, REQUESTID reqId)
  */
 HRESULT WINAPI WFPSetTraceLevel(HSERVICE hService, DWORD dwTraceLevel)
 {
+	g_trace_recorder.Call(TRACE_CALL_SETTRACELEVEL, hService, 0, 0, dwTraceLevel);
+
 	return WFS_SUCCESS;
 }
 
@@ -881,5 +1806,40 @@ HRESULT WINAPI WFPSetTraceLevel(HSERVICE hService, DWORD dwTraceLevel)
  */
 HRESULT WINAPI WFPUnloadService()
 {
+	g_trace_recorder.Call(TRACE_CALL_UNLOAD, 0, 0, 0, 0);
+
+	g_mock_scheduler.Stop();
+	g_timer_wheel.Stop();
+	g_execute_pool.Stop();
+	g_worker_pool.Stop();
+	g_event_dispatcher.Stop();
+	g_result_reserve.Stop();
+	g_trace_recorder.Stop();
+	SpLockStatsDump();
+
+	std::lock_guard<SpMutex> lock(g_wfs_queue_mutex);
+	for (DWORD i = 0; i < SESSION_TABLE_CAPACITY; i++)
+	{
+		SESSION* session = g_session_table.At(i);
+		if (session->lpLane != NULL)
+		{
+			LaneDestroy(session->lpLane);
+			session->lpLane = NULL;
+		}
+		session->lpDevice = NULL;
+	}
+
+	std::lock_guard<SpMutex> devices(g_wfs_device_mutex);
+	std::map<std::string, WFS_DEVICE*>::iterator it;
+	for (it = g_wfs_devices.begin(); it != g_wfs_devices.end(); ++it)
+	{
+		if (it->second == NULL)
+			continue;
+		g_timer_wheel.Cancel(&it->second->linger);
+		delete it->second;
+	}
+	g_wfs_devices.clear();
+	g_wfs_config_loaded.store(false);
+
 	return WFS_SUCCESS;
 }
\ No newline at end of file
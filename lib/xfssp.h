@@ -19,36 +19,148 @@
 #include <xfsalm.h>
 #include <xfsspi.h>
 #include <map>
-#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include "sync.h"
+#include <atomic>
+#include "timerwheel.h"
+#include "sessiontable.h"
+#include "mockdevice.h"
+#include <string>
 
-static HPROVIDER g_hProvider = NULL;
-static std::map<HSERVICE, bool> g_h_services;
+#define WFS_EVENT_CLASS_SERVICE 0
+#define WFS_EVENT_CLASS_USER 1
+#define WFS_EVENT_CLASS_SYSTEM 2
+#define WFS_EVENT_CLASS_EXECUTE 3
+#define WFS_EVENT_CLASSES 4
 
-struct WFS_EVENTS {
-	DWORD dwEvent;
+struct WFS_DEVICE;
+
+struct WFS_SUBSCRIBER {
+	HWND hWnd;
 	HSERVICE hService;
+	WFS_DEVICE* lpDevice;
+};
+
+struct WFS_EVENT_TABLE {
+	std::vector<WFS_SUBSCRIBER> classes[WFS_EVENT_CLASSES];
 };
 
-static std::map<HWND, WFS_EVENTS> g_wfs_event;
+struct WFS_LANE;
+
+#define WFS_MSG_QUEUED 0
+#define WFS_MSG_RUNNING 1
+#define WFS_MSG_CANCELLED 2
+#define WFS_MSG_TIMEDOUT 3
+#define WFS_MSG_DONE 4
 
 struct WFS_MSG {
 	HWND hWnd;
+	UINT uMessage;
 	LPWFSRESULT lpWFSResult;
+	REQUESTID RequestID;
+	DWORD dwCommand;
 	LPVOID lpDataReceived;
-	BOOL bCancelled;
+	std::atomic<LONG> lState;
+	WFS_LANE* lpLane;
+	SESSION* lpSession;
+	// Generation of lpSession when the request was queued, see SessionTable::IsCurrent.
+	DWORD dwGeneration;
+	// Device of lpSession when the request was queued.
+	WFS_DEVICE* lpDevice;
+	// Links in the request list of lpSession, see WFPTrackRequest.
+	WFS_MSG* lpPrevRequest;
+	WFS_MSG* lpNextRequest;
+	TIMER_NODE timer;
+};
+
+struct WFS_COMPLETION {
+	HWND hWnd;
+	UINT uMessage;
+	LPWFSRESULT lpWFSResult;
+};
+
+struct WFS_SLOT {
+	std::atomic<size_t> nSequence;
+	WFS_MSG msg;
+};
+
+#define WFS_LANE_DEFAULT_DEPTH 256
+
+struct WFS_LANE {
+	SESSION* lpSession;
+	WFS_SLOT* lpSlots;
+	size_t nMask;
+	std::atomic<size_t> nEnqueuePos;
+	size_t nDequeuePos;
+	std::atomic<bool> bScheduled;
+	// Position + 1 of the last request pushed with a RequestID equal to the entry index
+	// modulo the lane size. Only a hint for LaneCancel, checked against the slot.
+	std::atomic<size_t>* lpHints;
+	// Held by LaneCancel while it reads the ring and by LanePop while it frees a slot.
+	SpMutex cancelMutex{"WFS_LANE.cancelMutex"};
 };
 
-static std::deque<WFS_MSG*> g_wfs_msg_queue;
-static HANDLE g_wfs_queue_mutex = NULL;
-static HANDLE hExecuteThread = NULL;
+/*
+ * Status read of a device, for the status requests that find no valid snapshot, such as
+ * while the device opens or resets; the others are answered from the snapshot inline.
+ * A read is in flight from the moment the request that opens it is queued until its
+ * result is taken; status requests that arrive meanwhile wait here and are completed
+ * from that result.
+ */
+struct WFS_STATUS_FLIGHT {
+	SpMutex mutex{"WFS_STATUS_FLIGHT.mutex"};
+	bool bInFlight;
+	std::vector<WFS_MSG*> waiters;
+	std::atomic<DWORD> dwSnapshot;
+	std::atomic<DWORD> dwIssued;
+	std::atomic<DWORD> dwCoalesced;
+};
+
+#define WFS_DEVICE_DEFAULT_LINGER 0
+
+/*
+ * Simulated device behind a logical service name, shared by every session opened on
+ * that name. The device is opened by the first session and closed once the last
+ * session closed and the linger time passed; the object lives until the SP is unloaded.
+ * While one session opens the device, the others wait on opened for the outcome.
+ */
+struct WFS_DEVICE {
+	MockDevice device;
+	WFS_STATUS_FLIGHT flight;
+	LPCSTR lpszLogicalName; // Key of the device in g_wfs_devices
 
-static HANDLE g_serial_mutex;
+	// Guarded by g_wfs_device_mutex.
+	LONG lRefs;
+	bool bOpen;
+	bool bOpening;
+	bool bLingering;
+	TIMER_NODE linger;
+	SpCondition opened;
+	DWORD dwOpens;
+	DWORD dwCloses;
+};
+
+struct WFS_STATUS_COUNTERS {
+	DWORD dwSnapshot;
+	DWORD dwIssued;
+	DWORD dwCoalesced;
+};
 
-#define UNLOCKED 0
-#define LOCK_PENDING 1
-#define LOCKED 2
+BOOL WFPQueryStatusCounters(LPCSTR lpszLogicalName, WFS_STATUS_COUNTERS* lpCounters);
 
-static int g_lock_state = UNLOCKED;
-static HSERVICE g_lock_hservice = NULL;
-static HANDLE g_lock_mutex;
+struct WFS_DEVICE_COUNTERS {
+	DWORD dwOpens;
+	DWORD dwCloses;
+};
+
+BOOL WFPQueryDeviceCounters(LPCSTR lpszLogicalName, WFS_DEVICE_COUNTERS* lpCounters);
+
+struct WFS_SESSION_COUNTERS {
+	DWORD dwExecuteRequests;
+	DWORD dwInfoRequests;
+	DWORD dwCancelRequests;
+};
 
+BOOL WFPQuerySessionCounters(HSERVICE hService, WFS_SESSION_COUNTERS* lpCounters);
@@ -0,0 +1,70 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "replay.h"
+
+/**
+ * Replay Driver
+ *
+ * Usage: replay <trace file> [-sp <service provider dll>] [-speed <factor>|max] [-drain <ms>]
+ *
+ * Replays a trace recorded with the TraceFile setting of the SP against a service
+ * provider DLL, SampleSP.dll by default, and prints throughput and latencies. The
+ * default speed 1 keeps the recorded pacing, 10 replays ten times faster and max
+ * issues the calls back to back. -drain sets how long the outstanding completions are
+ * waited for once every call was issued, REPLAY_DRAIN_TIMEOUT ms by default.
+ */
+int main(int argc, char* argv[])
+{
+	std::string trace;
+	std::string provider = "SampleSP.dll";
+	double speed = 1.0;
+	DWORD dwDrainTimeOut = REPLAY_DRAIN_TIMEOUT;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "-sp" && i + 1 < argc)
+			provider = argv[++i];
+		else if (arg == "-speed" && i + 1 < argc)
+		{
+			std::string value = argv[++i];
+			speed = value == "max" ? 0.0 : atof(value.c_str());
+		}
+		else if (arg == "-drain" && i + 1 < argc)
+			dwDrainTimeOut = (DWORD)strtoul(argv[++i], NULL, 10);
+		else
+			trace = arg;
+	}
+
+	if (trace.empty() || speed < 0)
+	{
+		std::cout << "usage: replay <trace file> [-sp <service provider dll>] [-speed <factor>|max] [-drain <ms>]" << std::endl;
+		return 1;
+	}
+
+	TraceReplayer* replayer = new TraceReplayer();
+	if (replayer->Load(trace) != S_OK || replayer->Attach(provider) != S_OK || replayer->Run(speed, dwDrainTimeOut) != S_OK)
+	{
+		delete replayer;
+		return 1;
+	}
+
+	replayer->Report();
+	delete replayer;
+	return 0;
+}
@@ -0,0 +1,552 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "replay.h"
+#include <fstream>
+#include <algorithm>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+
+#define REPLAY_WINDOW_CLASS "CLASS.XFSSPREPLAY"
+
+static const char* g_call_names[TRACE_CALLS] = {
+	"", "Open", "Close", "Lock", "Unlock", "Register", "Deregister",
+	"GetInfo", "Execute", "Cancel", "SetTraceLevel", "Unload"
+};
+
+TraceReplayer::TraceReplayer()
+{
+}
+
+TraceReplayer::~TraceReplayer()
+{
+	EndMessageWindow();
+#ifdef _WIN32
+	if (hProvider)
+		FreeLibrary(hProvider);
+#endif
+}
+
+/**
+ * Load Trace
+ *
+ * Reads every record of a trace file. A file cut in the middle of a record is read up
+ * to the last complete record. Recorded events are counted per device for the report.
+ *
+ * @param path - Path of the trace file.
+ * @return HRESULT - S_OK on success, an error code on failure.
+ */
+HRESULT TraceReplayer::Load(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "Cannot open trace " << path << std::endl;
+		return E_FAIL;
+	}
+
+	TRACE_FILE_HEADER header;
+	if (!file.read((char*)&header, sizeof(header))
+		|| header.dwMagic != TRACE_FILE_MAGIC
+		|| header.dwVersion != TRACE_FILE_VERSION
+		|| header.dwRecordSize != sizeof(TRACE_RECORD))
+	{
+		std::cout << "Not a trace of this version: " << path << std::endl;
+		return E_FAIL;
+	}
+
+	TRACE_RECORD record;
+	while (file.read((char*)&record, sizeof(record)))
+	{
+		if (record.wType == TRACE_RECORD_COMPLETION)
+			expected[std::make_pair(record.u.call.dwService, record.u.call.dwRequestID)] = record.u.call.lResult;
+		else if (record.wType == TRACE_RECORD_EVENT)
+			dwRecordedEvents++;
+		else if (record.wType == TRACE_RECORD_NAME && !records.empty() && records.back().wType == TRACE_RECORD_EVENT)
+		{
+			CHAR szName[TRACE_NAME_LENGTH + 1] = { 0 };
+			memcpy(szName, record.u.szName, TRACE_NAME_LENGTH);
+			deviceEvents[szName]++;
+		}
+		records.push_back(record);
+	}
+
+	std::cout << "Loaded " << records.size() << " records from " << path << std::endl;
+	return S_OK;
+}
+
+/**
+ * Attach Service Provider
+ *
+ * Loads the service provider DLL and resolves its WFP* entry points. Outside Windows
+ * the entry points are those of the SP core linked into the replayer.
+ *
+ * @param path - Path of the service provider DLL.
+ * @return HRESULT - S_OK on success, an error code on failure.
+ */
+HRESULT TraceReplayer::Attach(const std::string& path)
+{
+#ifdef _WIN32
+	hProvider = LoadLibraryA(path.c_str());
+	if (hProvider == NULL)
+	{
+		std::cout << "Cannot load " << path << std::endl;
+		return E_FAIL;
+	}
+
+	lpfnOpen = (LPFNWFPOPEN)GetProcAddress(hProvider, "WFPOpen");
+	lpfnClose = (LPFNWFPCLOSE)GetProcAddress(hProvider, "WFPClose");
+	lpfnLock = (LPFNWFPLOCK)GetProcAddress(hProvider, "WFPLock");
+	lpfnUnlock = (LPFNWFPUNLOCK)GetProcAddress(hProvider, "WFPUnlock");
+	lpfnRegister = (LPFNWFPREGISTER)GetProcAddress(hProvider, "WFPRegister");
+	lpfnDeregister = (LPFNWFPREGISTER)GetProcAddress(hProvider, "WFPDeregister");
+	lpfnGetInfo = (LPFNWFPGETINFO)GetProcAddress(hProvider, "WFPGetInfo");
+	lpfnExecute = (LPFNWFPEXECUTE)GetProcAddress(hProvider, "WFPExecute");
+	lpfnCancelAsyncRequest = (LPFNWFPCANCELASYNCREQUEST)GetProcAddress(hProvider, "WFPCancelAsyncRequest");
+	lpfnSetTraceLevel = (LPFNWFPSETTRACELEVEL)GetProcAddress(hProvider, "WFPSetTraceLevel");
+	lpfnUnloadService = (LPFNWFPUNLOADSERVICE)GetProcAddress(hProvider, "WFPUnloadService");
+
+	if (!lpfnOpen || !lpfnClose || !lpfnLock || !lpfnUnlock || !lpfnRegister || !lpfnDeregister
+		|| !lpfnGetInfo || !lpfnExecute || !lpfnCancelAsyncRequest || !lpfnSetTraceLevel || !lpfnUnloadService)
+	{
+		std::cout << path << " is not a service provider" << std::endl;
+		return E_FAIL;
+	}
+#else
+	UNREFERENCED_PARAMETER(path);
+	lpfnOpen = WFPOpen;
+	lpfnClose = WFPClose;
+	lpfnLock = WFPLock;
+	lpfnUnlock = WFPUnlock;
+	lpfnRegister = WFPRegister;
+	lpfnDeregister = WFPDeregister;
+	lpfnGetInfo = WFPGetInfo;
+	lpfnExecute = WFPExecute;
+	lpfnCancelAsyncRequest = WFPCancelAsyncRequest;
+	lpfnSetTraceLevel = WFPSetTraceLevel;
+	lpfnUnloadService = WFPUnloadService;
+#endif
+
+	return InitMessageWindow();
+}
+
+/**
+ * Run Replay
+ *
+ * Issues the recorded calls, waits for their completions and unloads the service
+ * provider.
+ *
+ * @param speed - Replay speed relative to the recording, 0 for as fast as possible.
+ * @param dwDrainTimeOut - Milliseconds to wait for the outstanding completions.
+ * @return HRESULT - S_OK on success, an error code on failure.
+ */
+HRESULT TraceReplayer::Run(double speed, DWORD dwDrainTimeOut)
+{
+	if (hWndReplay == NULL)
+		return E_FAIL;
+
+	LONGLONG llStartUs = NowUs();
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		const TRACE_RECORD& record = records[i];
+		if (record.wType != TRACE_RECORD_CALL)
+			continue;
+
+		if (speed > 0)
+		{
+			LONGLONG llDueUs = llStartUs + (LONGLONG)(record.ullTimeUs / speed);
+			LONGLONG llWaitUs = llDueUs - NowUs();
+			if (llWaitUs >= 1000)
+				std::this_thread::sleep_for(std::chrono::milliseconds(llWaitUs / 1000));
+			while (NowUs() < llDueUs)
+				std::this_thread::yield();
+		}
+
+		const TRACE_RECORD* name = NULL;
+		if (i + 1 < records.size() && records[i + 1].wType == TRACE_RECORD_NAME)
+			name = &records[i + 1];
+		Issue(record, name);
+	}
+
+	if (!Drain(dwDrainTimeOut))
+		std::cout << "Requests still outstanding after " << dwDrainTimeOut << " ms" << std::endl;
+
+	llElapsedUs = NowUs() - llStartUs;
+	lpfnUnloadService();
+	return S_OK;
+}
+
+/**
+ * Issue Call
+ *
+ * Issues one recorded WFP* call. Asynchronous calls are tracked until their
+ * completion arrives or the call fails synchronously.
+ *
+ * @param record - The recorded call.
+ * @param name - The logical name record of an open, NULL if there is none.
+ * @return HRESULT - The result returned by the service provider.
+ */
+HRESULT TraceReplayer::Issue(const TRACE_RECORD& record, const TRACE_RECORD* name)
+{
+	HSERVICE hService = (HSERVICE)record.u.call.dwService;
+	REQUESTID reqId = (REQUESTID)record.u.call.dwRequestID;
+	WORD wCall = record.wCall < TRACE_CALLS ? record.wCall : 0;
+
+	BOOL bAsync = wCall != TRACE_CALL_CANCEL && wCall != TRACE_CALL_SETTRACELEVEL && wCall != TRACE_CALL_UNLOAD && wCall != 0;
+	std::pair<DWORD, DWORD> key = std::make_pair(record.u.call.dwService, record.u.call.dwRequestID);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stats[wCall].dwIssued++;
+		if (bAsync)
+		{
+			REPLAY_REQUEST& request = pending[key];
+			std::map<std::pair<DWORD, DWORD>, LONG>::iterator it = expected.find(key);
+			request.wCall = wCall;
+			request.llIssuedUs = NowUs();
+			request.bExpected = it != expected.end();
+			request.lExpected = request.bExpected ? it->second : 0;
+		}
+	}
+
+	HRESULT hr = WFS_SUCCESS;
+	switch (wCall)
+	{
+	case TRACE_CALL_OPEN:
+	{
+		CHAR szName[TRACE_NAME_LENGTH + 1] = { 0 };
+		if (name)
+			memcpy(szName, name->u.szName, TRACE_NAME_LENGTH);
+		WFSVERSION spiVersion, srvcVersion;
+		hr = lpfnOpen(hService, szName, NULL, NULL, 0, record.u.call.dwParam, hWndReplay, reqId, NULL,
+			0x00030203, &spiVersion, 0x00030203, &srvcVersion);
+		break;
+	}
+	case TRACE_CALL_CLOSE:
+		hr = lpfnClose(hService, hWndReplay, reqId);
+		break;
+	case TRACE_CALL_LOCK:
+		hr = lpfnLock(hService, record.u.call.dwParam, hWndReplay, reqId);
+		break;
+	case TRACE_CALL_UNLOCK:
+		hr = lpfnUnlock(hService, hWndReplay, reqId);
+		break;
+	case TRACE_CALL_REGISTER:
+		hr = lpfnRegister(hService, record.u.call.dwCommand, hWndReplay, hWndReplay, reqId);
+		break;
+	case TRACE_CALL_DEREGISTER:
+		hr = lpfnDeregister(hService, record.u.call.dwCommand, hWndReplay, hWndReplay, reqId);
+		break;
+	case TRACE_CALL_GETINFO:
+		hr = lpfnGetInfo(hService, record.u.call.dwCommand, NULL, record.u.call.dwParam, hWndReplay, reqId);
+		break;
+	case TRACE_CALL_EXECUTE:
+		hr = lpfnExecute(hService, record.u.call.dwCommand, NULL, record.u.call.dwParam, hWndReplay, reqId);
+		break;
+	case TRACE_CALL_CANCEL:
+		hr = lpfnCancelAsyncRequest(hService, reqId);
+		break;
+	case TRACE_CALL_SETTRACELEVEL:
+		hr = lpfnSetTraceLevel(hService, record.u.call.dwParam);
+		break;
+	default:
+		break;
+	}
+
+	if (hr != WFS_SUCCESS)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stats[wCall].dwRejected++;
+		if (bAsync)
+			pending.erase(key);
+	}
+
+	return hr;
+}
+
+/**
+ * Complete Request
+ *
+ * Records the latency of a completion and compares its result with the trace.
+ *
+ * @param lpWFSResult - The result block of the completion.
+ */
+void TraceReplayer::Complete(LPWFSRESULT lpWFSResult)
+{
+	LONGLONG llNowUs = NowUs();
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::map<std::pair<DWORD, DWORD>, REPLAY_REQUEST>::iterator it =
+		pending.find(std::make_pair((DWORD)lpWFSResult->hService, (DWORD)lpWFSResult->RequestID));
+	if (it == pending.end())
+		return;
+
+	REPLAY_STATS& call = stats[it->second.wCall];
+	call.latencies.push_back(llNowUs - it->second.llIssuedUs);
+	if (it->second.bExpected && it->second.lExpected != lpWFSResult->hResult)
+		call.dwMismatched++;
+	pending.erase(it);
+}
+
+/**
+ * Drain Requests
+ *
+ * Waits until every replayed request completed.
+ *
+ * @param dwTimeOut - Number of milliseconds to wait.
+ * @return BOOL - TRUE if no request is outstanding.
+ */
+BOOL TraceReplayer::Drain(DWORD dwTimeOut)
+{
+	LONGLONG llDeadlineUs = NowUs() + (LONGLONG)dwTimeOut * 1000;
+	while (NowUs() < llDeadlineUs)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (pending.empty())
+				return TRUE;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return pending.empty();
+}
+
+/**
+ * Print Report
+ *
+ * Prints the throughput of the replay and the latency distribution of every call.
+ */
+void TraceReplayer::Report()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	DWORD dwCompleted = 0;
+	for (int i = 0; i < TRACE_CALLS; i++)
+		dwCompleted += (DWORD)stats[i].latencies.size();
+
+	double dSeconds = llElapsedUs / 1000000.0;
+	std::cout << "Elapsed: " << std::fixed << std::setprecision(3) << dSeconds << " s" << std::endl;
+	std::cout << "Completions: " << dwCompleted << " (" << std::setprecision(1)
+		<< (dSeconds > 0 ? dwCompleted / dSeconds : 0.0) << " /s)" << std::endl;
+	std::cout << "Events: " << dwReceivedEvents << " received, " << dwRecordedEvents << " recorded" << std::endl;
+	for (std::map<std::string, DWORD>::const_iterator it = deviceEvents.begin(); it != deviceEvents.end(); ++it)
+		std::cout << "  " << it->first << ": " << it->second << " recorded" << std::endl;
+	std::cout << "Outstanding: " << pending.size() << std::endl << std::endl;
+
+	std::cout << std::left << std::setw(14) << "call" << std::right
+		<< std::setw(9) << "issued" << std::setw(9) << "rejected" << std::setw(9) << "mismatch"
+		<< std::setw(10) << "p50 us" << std::setw(10) << "p90 us" << std::setw(10) << "p99 us"
+		<< std::setw(10) << "max us" << std::endl;
+
+	for (int i = 1; i < TRACE_CALLS; i++)
+	{
+		REPLAY_STATS& call = stats[i];
+		if (call.dwIssued == 0)
+			continue;
+
+		std::vector<LONGLONG>& latencies = call.latencies;
+		std::sort(latencies.begin(), latencies.end());
+		size_t n = latencies.size();
+
+		std::cout << std::left << std::setw(14) << g_call_names[i] << std::right
+			<< std::setw(9) << call.dwIssued << std::setw(9) << call.dwRejected << std::setw(9) << call.dwMismatched;
+		if (n == 0)
+		{
+			std::cout << std::setw(10) << "-" << std::setw(10) << "-" << std::setw(10) << "-" << std::setw(10) << "-" << std::endl;
+			continue;
+		}
+		std::cout << std::setw(10) << latencies[n * 50 / 100]
+			<< std::setw(10) << latencies[n * 90 / 100]
+			<< std::setw(10) << latencies[n * 99 / 100]
+			<< std::setw(10) << latencies[n - 1] << std::endl;
+	}
+}
+
+/**
+ * Microseconds Clock
+ *
+ * @return LONGLONG - Microseconds from an arbitrary origin.
+ */
+LONGLONG TraceReplayer::NowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Initialize Message Window
+ *
+ * Starts the thread that owns the replay window and waits until the window exists.
+ *
+ * @return HRESULT - S_OK on success, an error code on failure.
+ */
+HRESULT TraceReplayer::InitMessageWindow()
+{
+#ifdef _WIN32
+	hWindowCreatedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (hWindowCreatedEvent == NULL)
+		return E_FAIL;
+
+	hWindowThread = CreateThread(NULL, 0, WindowThreadFunction, this, 0, &dwWindowThreadId);
+	if (hWindowThread == NULL)
+		return E_FAIL;
+
+	WaitForSingleObject(hWindowCreatedEvent, INFINITE);
+	return hWndReplay ? S_OK : E_FAIL;
+#else
+	hWndReplay = g_xfs_manager.CreateWindowObject(WndProc, this);
+	return hWndReplay ? S_OK : E_FAIL;
+#endif
+}
+
+/**
+ * End Message Window
+ *
+ * Stops the window thread.
+ */
+void TraceReplayer::EndMessageWindow()
+{
+#ifdef _WIN32
+	if (hWindowThread)
+	{
+		PostThreadMessage(dwWindowThreadId, WM_QUIT, 0, 0);
+		WaitForSingleObject(hWindowThread, INFINITE);
+		CloseHandle(hWindowThread);
+		hWindowThread = NULL;
+	}
+	if (hWindowCreatedEvent)
+	{
+		CloseHandle(hWindowCreatedEvent);
+		hWindowCreatedEvent = NULL;
+	}
+#else
+	if (hWndReplay)
+	{
+		g_xfs_manager.DestroyWindowObject(hWndReplay);
+		hWndReplay = NULL;
+	}
+#endif
+}
+
+/**
+ * Window Procedure
+ *
+ * Accounts for completion messages and events, then frees their result blocks as the
+ * XFS manager would.
+ *
+ * @param hWnd - The window handle.
+ * @param Msg - The message identifier.
+ * @param wParam - Additional message information.
+ * @param lParam - Additional message information.
+ * @return LRESULT - The result of the message processing.
+ */
+LRESULT CALLBACK TraceReplayer::WndProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam)
+{
+#ifdef _WIN32
+	TraceReplayer* obj = (TraceReplayer*)GetWindowLongPtr(hWnd, GWLP_USERDATA);
+	if (obj == NULL)
+		return DefWindowProc(hWnd, Msg, wParam, lParam);
+#else
+	UNREFERENCED_PARAMETER(wParam);
+	TraceReplayer* obj = (TraceReplayer*)g_xfs_manager.GetWindowData(hWnd);
+	if (obj == NULL)
+		return 0;
+#endif
+
+	LPWFSRESULT lpWFSResult = (LPWFSRESULT)lParam;
+	switch (Msg)
+	{
+	case WFS_OPEN_COMPLETE:
+	case WFS_CLOSE_COMPLETE:
+	case WFS_LOCK_COMPLETE:
+	case WFS_UNLOCK_COMPLETE:
+	case WFS_REGISTER_COMPLETE:
+	case WFS_DEREGISTER_COMPLETE:
+	case WFS_GETINFO_COMPLETE:
+	case WFS_EXECUTE_COMPLETE:
+		if (lpWFSResult)
+		{
+			obj->Complete(lpWFSResult);
+			WFMFreeBuffer(lpWFSResult);
+		}
+		return 0;
+	case WFS_EXECUTE_EVENT:
+	case WFS_SERVICE_EVENT:
+	case WFS_USER_EVENT:
+	case WFS_SYSTEM_EVENT:
+		if (lpWFSResult)
+		{
+			{
+				std::lock_guard<std::mutex> lock(obj->mutex);
+				obj->dwReceivedEvents++;
+			}
+			WFMFreeBuffer(lpWFSResult);
+		}
+		return 0;
+	default:
+#ifdef _WIN32
+		return DefWindowProc(hWnd, Msg, wParam, lParam);
+#else
+		return 0;
+#endif
+	}
+}
+
+#ifdef _WIN32
+
+/**
+ * Window Thread Function
+ *
+ * Creates the replay message window and runs its message loop.
+ *
+ * @param param - The TraceReplayer.
+ * @return DWORD - The thread exit code.
+ */
+DWORD WINAPI TraceReplayer::WindowThreadFunction(LPVOID param)
+{
+	TraceReplayer* obj = (TraceReplayer*)param;
+
+	WNDCLASSA wc = { 0 };
+	wc.hInstance = GetModuleHandle(0);
+	wc.lpfnWndProc = WndProc;
+	wc.lpszClassName = REPLAY_WINDOW_CLASS;
+	RegisterClassA(&wc);
+
+	HWND hWnd = CreateWindowA(REPLAY_WINDOW_CLASS, "WINDOW.XFSSPREPLAY", 0, 0, 0, 0, 0,
+		HWND_MESSAGE, NULL, wc.hInstance, NULL);
+	if (hWnd)
+		SetWindowLongPtr(hWnd, GWLP_USERDATA, (LONG_PTR)obj);
+	obj->hWndReplay = hWnd;
+	SetEvent(obj->hWindowCreatedEvent);
+
+	if (hWnd == NULL)
+		return 1;
+
+	MSG msg;
+	while (GetMessage(&msg, NULL, 0, 0))
+	{
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
+	}
+
+	DestroyWindow(hWnd);
+	return 0;
+}
+#endif
@@ -0,0 +1,146 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include<windows.h>
+#include<iostream>
+#include<string>
+#include<vector>
+#include<map>
+#include<mutex>
+
+#include "xfsadmin.h"
+#include "xfsapi.h"
+#include "xfsspi.h"
+#include "xfsalm.h"
+#include "../lib/traceformat.h"
+#ifndef _WIN32
+#include "../standin/xfsmgr.h"
+#endif
+
+#define REPLAY_DRAIN_TIMEOUT 30000 // Default wait for outstanding completions, in milliseconds
+
+typedef HRESULT(WINAPI* LPFNWFPOPEN)(HSERVICE, LPSTR, HAPP, LPSTR, DWORD, DWORD, HWND, REQUESTID, HPROVIDER, DWORD, LPWFSVERSION, DWORD, LPWFSVERSION);
+typedef HRESULT(WINAPI* LPFNWFPCLOSE)(HSERVICE, HWND, REQUESTID);
+typedef HRESULT(WINAPI* LPFNWFPLOCK)(HSERVICE, DWORD, HWND, REQUESTID);
+typedef HRESULT(WINAPI* LPFNWFPUNLOCK)(HSERVICE, HWND, REQUESTID);
+typedef HRESULT(WINAPI* LPFNWFPREGISTER)(HSERVICE, DWORD, HWND, HWND, REQUESTID);
+typedef HRESULT(WINAPI* LPFNWFPGETINFO)(HSERVICE, DWORD, LPVOID, DWORD, HWND, REQUESTID);
+typedef HRESULT(WINAPI* LPFNWFPEXECUTE)(HSERVICE, DWORD, LPVOID, DWORD, HWND, REQUESTID);
+typedef HRESULT(WINAPI* LPFNWFPCANCELASYNCREQUEST)(HSERVICE, REQUESTID);
+typedef HRESULT(WINAPI* LPFNWFPSETTRACELEVEL)(HSERVICE, DWORD);
+typedef HRESULT(WINAPI* LPFNWFPUNLOADSERVICE)();
+
+/**
+ * Outstanding Request
+ *
+ * A replayed request waiting for its completion message.
+ */
+struct REPLAY_REQUEST {
+	WORD wCall; // TRACE_CALL_* value of the request
+	LONGLONG llIssuedUs; // Time the request was issued
+	LONG lExpected; // hResult of the recorded completion
+	BOOL bExpected; // TRUE when the trace holds the completion
+};
+
+/**
+ * Call Statistics
+ *
+ * Replay results of one kind of WFP* call.
+ */
+struct REPLAY_STATS {
+	DWORD dwIssued; // Calls issued
+	DWORD dwRejected; // Calls that failed synchronously
+	DWORD dwMismatched; // Completions whose hResult differs from the trace
+	std::vector<LONGLONG> latencies; // Completion latencies in microseconds
+};
+
+ /**
+  * TraceReplayer Class
+  *
+  * Feeds a trace written by the SP trace recorder back through a service provider DLL,
+  * standing in for the XFS manager: it loads the SP, issues the recorded WFP* calls with
+  * the recorded pacing, scaled by a speed factor, receives the completion messages and
+  * events on its own message window and frees the result blocks.
+  *
+  * @remarks
+  * - Session handles and request identifiers are replayed as recorded; every request
+  *   completes on the replayer window.
+  * - A speed of 0 issues the calls back to back, as fast as the SP accepts them.
+  * - The recorded WFPUnloadService is not replayed; the SP is unloaded once every
+  *   outstanding request completed.
+  * - Outside Windows the SP core is linked into the replayer and the window is one of
+  *   the XFS manager stand-in; the DLL path is ignored.
+  */
+class TraceReplayer
+{
+private:
+	HMODULE				hProvider = NULL; // Service provider DLL
+	HWND				hWndReplay = NULL; // Window receiving completions and events
+#ifdef _WIN32
+	HANDLE				hWindowThread = NULL; // Thread running the window
+	HANDLE				hWindowCreatedEvent = NULL; // Signaled once the window exists
+	DWORD				dwWindowThreadId = 0; // Thread ID of the window
+#endif
+
+	LPFNWFPOPEN			lpfnOpen = NULL;
+	LPFNWFPCLOSE		lpfnClose = NULL;
+	LPFNWFPLOCK			lpfnLock = NULL;
+	LPFNWFPUNLOCK		lpfnUnlock = NULL;
+	LPFNWFPREGISTER		lpfnRegister = NULL;
+	LPFNWFPREGISTER		lpfnDeregister = NULL;
+	LPFNWFPGETINFO		lpfnGetInfo = NULL;
+	LPFNWFPEXECUTE		lpfnExecute = NULL;
+	LPFNWFPCANCELASYNCREQUEST lpfnCancelAsyncRequest = NULL;
+	LPFNWFPSETTRACELEVEL lpfnSetTraceLevel = NULL;
+	LPFNWFPUNLOADSERVICE lpfnUnloadService = NULL;
+
+	std::vector<TRACE_RECORD> records; // Records of the loaded trace
+	std::map<std::pair<DWORD, DWORD>, LONG> expected; // Recorded hResult per session and request
+	DWORD dwRecordedEvents = 0; // Events in the trace
+	std::map<std::string, DWORD> deviceEvents; // Events in the trace per logical name
+
+	std::mutex mutex; // Guards the members below, shared with the window thread
+	std::map<std::pair<DWORD, DWORD>, REPLAY_REQUEST> pending; // Requests waiting for completion
+	REPLAY_STATS stats[TRACE_CALLS]; // Results per call
+	DWORD dwReceivedEvents = 0; // Events received
+	LONGLONG llElapsedUs = 0; // Duration of the last replay
+
+public:
+	TraceReplayer(); // Constructor
+	~TraceReplayer(); // Destructor
+
+	HRESULT Load(const std::string&); // Read a trace file
+	HRESULT Attach(const std::string&); // Load the service provider DLL
+	HRESULT Run(double, DWORD); // Replay the trace at a speed factor
+	void Report(); // Print throughput and latency distribution
+
+private:
+	HRESULT Issue(const TRACE_RECORD&, const TRACE_RECORD*); // Issue one recorded call
+	void Complete(LPWFSRESULT); // Account for a completion message
+	BOOL Drain(DWORD); // Wait for the outstanding requests
+	LONGLONG NowUs(); // Microseconds clock
+	HRESULT InitMessageWindow(); // Create the replay window
+	void EndMessageWindow(); // Destroy the replay window
+
+public:
+	static LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM); // Window procedure
+#ifdef _WIN32
+	static DWORD WINAPI WindowThreadFunction(LPVOID); // Window thread entry function
+#endif
+};
@@ -0,0 +1,81 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+/*
+ * Alarm device class definitions of XFS 3.x used by the SP, for builds against the
+ * in-process XFS manager stand-in.
+ */
+
+#include <xfsapi.h>
+
+#pragma pack(push, 1)
+
+#define WFS_SERVICE_CLASS_ALM (11)
+#define WFS_SERVICE_CLASS_NAME_ALM "ALM"
+#define WFS_SERVICE_CLASS_VERSION_ALM (0x1E03)
+
+#define ALM_SERVICE_OFFSET (WFS_SERVICE_CLASS_ALM * 100)
+
+#define WFS_INF_ALM_STATUS (ALM_SERVICE_OFFSET + 1)
+#define WFS_INF_ALM_CAPABILITIES (ALM_SERVICE_OFFSET + 2)
+
+#define WFS_CMD_ALM_SET_ALARM (ALM_SERVICE_OFFSET + 1)
+#define WFS_CMD_ALM_RESET_ALARM (ALM_SERVICE_OFFSET + 2)
+#define WFS_CMD_ALM_RESET (ALM_SERVICE_OFFSET + 3)
+#define WFS_CMD_ALM_SYNCHRONIZE_COMMAND (ALM_SERVICE_OFFSET + 4)
+
+#define WFS_SRVE_ALM_DEVICE_SET (ALM_SERVICE_OFFSET + 1)
+#define WFS_SRVE_ALM_DEVICE_RESET (ALM_SERVICE_OFFSET + 2)
+
+#define WFS_ALM_DEVONLINE WFS_STAT_DEVONLINE
+#define WFS_ALM_DEVOFFLINE WFS_STAT_DEVOFFLINE
+#define WFS_ALM_DEVPOWEROFF WFS_STAT_DEVPOWEROFF
+#define WFS_ALM_DEVNODEVICE WFS_STAT_DEVNODEVICE
+#define WFS_ALM_DEVHWERROR WFS_STAT_DEVHWERROR
+#define WFS_ALM_DEVUSERERROR WFS_STAT_DEVUSERERROR
+#define WFS_ALM_DEVBUSY WFS_STAT_DEVBUSY
+#define WFS_ALM_DEVFRAUDATTEMPT WFS_STAT_DEVFRAUDATTEMPT
+#define WFS_ALM_DEVPOTENTIALFRAUD WFS_STAT_DEVPOTENTIALFRAUD
+
+#define WFS_ALM_GUIDLIGHTS_SIZE (32)
+
+#define WFS_ALM_AFMNOTSUPP (0)
+#define WFS_ALM_AFMOK (1)
+#define WFS_ALM_AFMINOP (2)
+#define WFS_ALM_AFMDEVICEDETECTED (3)
+#define WFS_ALM_AFMUNKNOWN (4)
+
+typedef struct _wfs_alm_status {
+	WORD fwDevice;
+	BOOL bAlarmSet;
+	LPSTR lpszExtra;
+	DWORD dwGuidLights[WFS_ALM_GUIDLIGHTS_SIZE];
+	WORD wAntiFraudModule;
+} WFSALMSTATUS, *LPWFSALMSTATUS;
+
+typedef struct _wfs_alm_caps {
+	WORD wClass;
+	BOOL bProgrammaticallyDeactivate;
+	LPSTR lpszExtra;
+	DWORD dwGuidLights[WFS_ALM_GUIDLIGHTS_SIZE];
+	BOOL bAntiFraudModule;
+	LPDWORD lpdwSynchronizableCommands;
+} WFSALMCAPS, *LPWFSALMCAPS;
+
+#pragma pack(pop)
@@ -0,0 +1,81 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "pch.h"
+#include "platform.h"
+#include "xfsmgr.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+BOOL PlatformIsWindow(HWND hWnd)
+{
+	return g_xfs_manager.IsWindowObject(hWnd);
+}
+
+void PlatformSendMessage(HWND hWnd, UINT uMessage, LPWFSRESULT lpWFSResult)
+{
+	g_xfs_manager.Send(hWnd, uMessage, 0, (LPARAM)lpWFSResult);
+}
+
+BOOL PlatformSendMessageTimeout(HWND hWnd, UINT uMessage, LPWFSRESULT lpWFSResult, DWORD dwTimeOut)
+{
+	return g_xfs_manager.SendTimeout(hWnd, uMessage, 0, (LPARAM)lpWFSResult, dwTimeOut);
+}
+
+BOOL PlatformPostMessage(HWND hWnd, UINT uMessage, LPWFSRESULT lpWFSResult)
+{
+	return g_xfs_manager.Post(hWnd, uMessage, 0, (LPARAM)lpWFSResult);
+}
+
+ULONGLONG PlatformTickCount(void)
+{
+	return (ULONGLONG)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PlatformDebugOutput(LPCSTR lpszText)
+{
+	fputs(lpszText, stderr);
+}
+
+BOOL PlatformConfigGetDword(LPCSTR lpszValueName, LPDWORD lpdwValue)
+{
+	std::string value;
+	if (!g_xfs_manager.GetConfig(lpszValueName, &value) || value.empty())
+		return FALSE;
+
+	char* lpszEnd;
+	unsigned long ulValue = strtoul(value.c_str(), &lpszEnd, 0);
+	if (*lpszEnd != '\0' || ulValue > 0xFFFFFFFFUL)
+		return FALSE;
+
+	*lpdwValue = (DWORD)ulValue;
+	return TRUE;
+}
+
+BOOL PlatformConfigGetString(LPCSTR lpszValueName, LPSTR lpszBuffer, DWORD dwSize)
+{
+	std::string value;
+	if (!g_xfs_manager.GetConfig(lpszValueName, &value) || value.size() >= dwSize)
+		return FALSE;
+
+	memcpy(lpszBuffer, value.c_str(), value.size() + 1);
+	return TRUE;
+}
@@ -0,0 +1,446 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "xfsmgr.h"
+#include <xfsadmin.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <new>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+
+XfsManager g_xfs_manager;
+
+// Completion of a message sent with a timeout, signalled by the delivery thread.
+struct STANDIN_SEND {
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool bDone;
+};
+
+struct STANDIN_MESSAGE {
+	UINT uMessage;
+	WPARAM wParam;
+	LPARAM lParam;
+	std::shared_ptr<STANDIN_SEND> send;
+};
+
+struct STANDIN_WINDOW {
+	WNDPROC lpfnWndProc;
+	LPVOID lpUserData;
+
+	// Held while the procedure runs. Recursive so that a procedure can send to its own
+	// window.
+	std::recursive_mutex procMutex;
+
+	// Messages waiting for the delivery thread. Sent messages go before posted ones.
+	std::mutex queueMutex;
+	std::condition_variable queueCond;
+	std::deque<STANDIN_MESSAGE> sent;
+	std::deque<STANDIN_MESSAGE> queue;
+	bool bDestroyed;
+	std::thread thread;
+};
+
+XfsManager::XfsManager()
+{
+}
+
+XfsManager::~XfsManager()
+{
+	while (true)
+	{
+		HWND hWnd;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_windows.empty())
+				break;
+			hWnd = m_windows.begin()->first;
+		}
+		DestroyWindowObject(hWnd);
+	}
+}
+
+/*
+ * @brief 
+ * Creates a window and starts its delivery thread.
+ * @param lpfnWndProc - Procedure receiving the messages of the window.
+ * @param lpUserData - Value returned by GetWindowData.
+ * @return HWND the window, NULL on failure.
+ */
+HWND XfsManager::CreateWindowObject(WNDPROC lpfnWndProc, LPVOID lpUserData)
+{
+	if (lpfnWndProc == NULL)
+		return NULL;
+
+	std::shared_ptr<STANDIN_WINDOW> window(new (std::nothrow) STANDIN_WINDOW());
+	if (!window)
+		return NULL;
+	window->lpfnWndProc = lpfnWndProc;
+	window->lpUserData = lpUserData;
+	window->bDestroyed = false;
+
+	try
+	{
+		window->thread = std::thread(DeliverLoop, window);
+	}
+	catch (...)
+	{
+		return NULL;
+	}
+
+	HWND hWnd = (HWND)window.get();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_windows[hWnd] = window;
+	return hWnd;
+}
+
+/*
+ * @brief 
+ * Destroys a window. Messages still posted to it are dropped, and a message being
+ * delivered is allowed to finish first unless the window is destroyed from its own
+ * delivery thread.
+ * @param hWnd - The window.
+ */
+void XfsManager::DestroyWindowObject(HWND hWnd)
+{
+	std::shared_ptr<STANDIN_WINDOW> window;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::map<HWND, std::shared_ptr<STANDIN_WINDOW> >::iterator it = m_windows.find(hWnd);
+		if (it == m_windows.end())
+			return;
+		window = it->second;
+		m_windows.erase(it);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(window->queueMutex);
+		window->bDestroyed = true;
+		window->sent.clear();
+		window->queue.clear();
+	}
+	window->queueCond.notify_one();
+
+	if (window->thread.get_id() == std::this_thread::get_id())
+		window->thread.detach();
+	else
+		window->thread.join();
+}
+
+/*
+ * @brief 
+ * Tells whether a handle names a window that was not destroyed.
+ * @param hWnd - The handle.
+ * @return BOOL TRUE if it is a window.
+ */
+BOOL XfsManager::IsWindowObject(HWND hWnd)
+{
+	return Find(hWnd) ? TRUE : FALSE;
+}
+
+/*
+ * @brief 
+ * Returns the user data the window was created with.
+ * @param hWnd - The window.
+ * @return LPVOID the user data, NULL if hWnd is not a window.
+ */
+LPVOID XfsManager::GetWindowData(HWND hWnd)
+{
+	std::shared_ptr<STANDIN_WINDOW> window = Find(hWnd);
+	return window ? window->lpUserData : NULL;
+}
+
+/*
+ * @brief 
+ * Runs the window procedure for a message on the calling thread and returns its result.
+ * @param hWnd - The window.
+ * @param uMessage - The message.
+ * @param wParam - Additional message information.
+ * @param lParam - Additional message information.
+ * @return LRESULT the result of the procedure, 0 if hWnd is not a window.
+ */
+LRESULT XfsManager::Send(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+{
+	std::shared_ptr<STANDIN_WINDOW> window = Find(hWnd);
+	if (!window)
+		return 0;
+
+	std::lock_guard<std::recursive_mutex> lock(window->procMutex);
+	return window->lpfnWndProc(hWnd, uMessage, wParam, lParam);
+}
+
+/*
+ * @brief 
+ * Hands a message to the delivery thread of a window and waits until the procedure has
+ * run or the timeout has passed. A message that timed out stays queued and is still
+ * delivered. Sent from the delivery thread itself, the procedure runs at once.
+ * @param hWnd - The window.
+ * @param uMessage - The message.
+ * @param wParam - Additional message information.
+ * @param lParam - Additional message information.
+ * @param dwTimeOut - Milliseconds to wait for the procedure.
+ * @return BOOL TRUE if the procedure ran in time, FALSE on timeout or if hWnd is not a
+ *	window.
+ */
+BOOL XfsManager::SendTimeout(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam, DWORD dwTimeOut)
+{
+	std::shared_ptr<STANDIN_WINDOW> window = Find(hWnd);
+	if (!window)
+		return FALSE;
+
+	if (window->thread.get_id() == std::this_thread::get_id())
+	{
+		std::lock_guard<std::recursive_mutex> lock(window->procMutex);
+		window->lpfnWndProc(hWnd, uMessage, wParam, lParam);
+		return TRUE;
+	}
+
+	std::shared_ptr<STANDIN_SEND> send(new (std::nothrow) STANDIN_SEND());
+	if (!send)
+		return FALSE;
+	send->bDone = false;
+
+	STANDIN_MESSAGE msg;
+	msg.uMessage = uMessage;
+	msg.wParam = wParam;
+	msg.lParam = lParam;
+	msg.send = send;
+	{
+		std::lock_guard<std::mutex> lock(window->queueMutex);
+		if (window->bDestroyed)
+			return FALSE;
+		window->sent.push_back(msg);
+	}
+	window->queueCond.notify_one();
+
+	std::unique_lock<std::mutex> lock(send->mutex);
+	return send->cond.wait_for(lock, std::chrono::milliseconds(dwTimeOut), [&send] { return send->bDone; }) ? TRUE : FALSE;
+}
+
+/*
+ * @brief 
+ * Queues a message for the delivery thread of a window.
+ * @param hWnd - The window.
+ * @param uMessage - The message.
+ * @param wParam - Additional message information.
+ * @param lParam - Additional message information.
+ * @return BOOL TRUE if the message was queued, FALSE if hWnd is not a window.
+ */
+BOOL XfsManager::Post(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+{
+	std::shared_ptr<STANDIN_WINDOW> window = Find(hWnd);
+	if (!window)
+		return FALSE;
+
+	STANDIN_MESSAGE msg;
+	msg.uMessage = uMessage;
+	msg.wParam = wParam;
+	msg.lParam = lParam;
+	{
+		std::lock_guard<std::mutex> lock(window->queueMutex);
+		if (window->bDestroyed)
+			return FALSE;
+		window->queue.push_back(msg);
+	}
+	window->queueCond.notify_one();
+	return TRUE;
+}
+
+/*
+ * @brief 
+ * Sets a configuration value of the SP, replacing the one from the environment.
+ * @param lpszValueName - Name of the setting.
+ * @param lpszValue - The value; DWORD settings are written in decimal or 0x hex.
+ */
+void XfsManager::SetConfig(LPCSTR lpszValueName, LPCSTR lpszValue)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_config[lpszValueName] = lpszValue;
+}
+
+/*
+ * @brief 
+ * Reads a configuration value of the SP. Values not set with SetConfig are taken from
+ * the environment variable XFS_MANAGER_ENV_PREFIX followed by the name.
+ * @param lpszValueName - Name of the setting.
+ * @param value - Receives the value.
+ * @return BOOL TRUE if the setting exists.
+ */
+BOOL XfsManager::GetConfig(LPCSTR lpszValueName, std::string* value)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::map<std::string, std::string>::iterator it = m_config.find(lpszValueName);
+		if (it != m_config.end())
+		{
+			*value = it->second;
+			return TRUE;
+		}
+	}
+
+	std::string variable = std::string(XFS_MANAGER_ENV_PREFIX) + lpszValueName;
+	LPCSTR lpszValue = getenv(variable.c_str());
+	if (lpszValue == NULL)
+		return FALSE;
+
+	*value = lpszValue;
+	return TRUE;
+}
+
+std::shared_ptr<STANDIN_WINDOW> XfsManager::Find(HWND hWnd)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::map<HWND, std::shared_ptr<STANDIN_WINDOW> >::iterator it = m_windows.find(hWnd);
+	if (it == m_windows.end())
+		return std::shared_ptr<STANDIN_WINDOW>();
+	return it->second;
+}
+
+/*
+ * @brief 
+ * Delivery thread of a window: runs the procedure for each sent, then each posted
+ * message in order.
+ * @param window - The window to serve.
+ */
+void XfsManager::DeliverLoop(std::shared_ptr<STANDIN_WINDOW> window)
+{
+	std::unique_lock<std::mutex> lock(window->queueMutex);
+	while (true)
+	{
+		window->queueCond.wait(lock, [&window] {
+			return window->bDestroyed || !window->sent.empty() || !window->queue.empty();
+		});
+		if (window->bDestroyed)
+			break;
+
+		std::deque<STANDIN_MESSAGE>& queue = window->sent.empty() ? window->queue : window->sent;
+		STANDIN_MESSAGE msg = queue.front();
+		queue.pop_front();
+		lock.unlock();
+
+		{
+			std::lock_guard<std::recursive_mutex> proc(window->procMutex);
+			window->lpfnWndProc((HWND)window.get(), msg.uMessage, msg.wParam, msg.lParam);
+		}
+
+		if (msg.send)
+		{
+			std::lock_guard<std::mutex> done(msg.send->mutex);
+			msg.send->bDone = true;
+			msg.send->cond.notify_all();
+		}
+
+		lock.lock();
+	}
+}
+
+/*
+ * Header in front of every WFM buffer. Buffers allocated with WFMAllocateMore are
+ * chained to the buffer they extend and freed with it.
+ */
+struct alignas(16) WFM_BUFFER {
+	std::atomic<WFM_BUFFER*> lpMore;
+	ULONG ulFlags;
+};
+
+static WFM_BUFFER* WFMHeader(LPVOID lpvData)
+{
+	return (WFM_BUFFER*)((char*)lpvData - sizeof(WFM_BUFFER));
+}
+
+static WFM_BUFFER* WFMAllocate(ULONG ulSize, ULONG ulFlags)
+{
+	void* lpMemory = malloc(sizeof(WFM_BUFFER) + (ulSize ? ulSize : 1));
+	if (lpMemory == NULL)
+		return NULL;
+
+	WFM_BUFFER* lpBuffer = new (lpMemory) WFM_BUFFER();
+	lpBuffer->lpMore.store(NULL, std::memory_order_relaxed);
+	lpBuffer->ulFlags = ulFlags;
+	if (ulFlags & WFS_MEM_ZEROINIT)
+		memset((char*)(lpBuffer + 1), 0, ulSize);
+	return lpBuffer;
+}
+
+HRESULT WINAPI WFMAllocateBuffer(ULONG ulSize, ULONG ulFlags, LPVOID* lppvData)
+{
+	if (lppvData == NULL)
+		return WFS_ERR_INVALID_POINTER;
+
+	WFM_BUFFER* lpBuffer = WFMAllocate(ulSize, ulFlags);
+	if (lpBuffer == NULL)
+	{
+		*lppvData = NULL;
+		return WFS_ERR_OUT_OF_MEMORY;
+	}
+
+	*lppvData = lpBuffer + 1;
+	return WFS_SUCCESS;
+}
+
+HRESULT WINAPI WFMAllocateMore(ULONG ulSize, LPVOID lpvOriginal, LPVOID* lppvData)
+{
+	if (lppvData == NULL)
+		return WFS_ERR_INVALID_POINTER;
+	if (lpvOriginal == NULL)
+		return WFS_ERR_INVALID_ADDRESS;
+
+	WFM_BUFFER* lpOriginal = WFMHeader(lpvOriginal);
+	WFM_BUFFER* lpBuffer = WFMAllocate(ulSize, lpOriginal->ulFlags);
+	if (lpBuffer == NULL)
+	{
+		*lppvData = NULL;
+		return WFS_ERR_OUT_OF_MEMORY;
+	}
+
+	// Chained right behind the original so that concurrent extensions of one buffer
+	// need no lock.
+	WFM_BUFFER* lpNext = lpOriginal->lpMore.load(std::memory_order_relaxed);
+	do
+	{
+		lpBuffer->lpMore.store(lpNext, std::memory_order_relaxed);
+	} while (!lpOriginal->lpMore.compare_exchange_weak(lpNext, lpBuffer, std::memory_order_release, std::memory_order_relaxed));
+
+	*lppvData = lpBuffer + 1;
+	return WFS_SUCCESS;
+}
+
+HRESULT WINAPI WFMFreeBuffer(LPVOID lpvData)
+{
+	if (lpvData == NULL)
+		return WFS_ERR_INVALID_POINTER;
+
+	WFM_BUFFER* lpBuffer = WFMHeader(lpvData);
+	while (lpBuffer != NULL)
+	{
+		WFM_BUFFER* lpNext = lpBuffer->lpMore.load(std::memory_order_acquire);
+		lpBuffer->~WFM_BUFFER();
+		free(lpBuffer);
+		lpBuffer = lpNext;
+	}
+	return WFS_SUCCESS;
+}
+
+HRESULT WINAPI WFMReleaseDLL(HPROVIDER hProvider)
+{
+	UNREFERENCED_PARAMETER(hProvider);
+	return WFS_SUCCESS;
+}
@@ -0,0 +1,72 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#include <windows.h>
+#include <xfsapi.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+typedef LRESULT (CALLBACK* WNDPROC)(HWND, UINT, WPARAM, LPARAM);
+
+#define XFS_MANAGER_ENV_PREFIX "XFSSP_"
+
+struct STANDIN_WINDOW;
+
+/*
+ * @brief 
+ * In-process stand-in for the parts of the XFS manager and of Win32 the SP core relies
+ * on: the windows completions and events are delivered to, and the SP configuration.
+ * The WFM* memory functions of xfsadmin.h are implemented next to it.
+ *
+ * A window is a procedure with user data. Sent messages run the procedure on the
+ * calling thread, posted messages and messages sent with a timeout run it on a delivery
+ * thread owned by the window; the procedure never runs twice at the same time for one
+ * window, as on a window thread.
+ */
+class XfsManager
+{
+public:
+	XfsManager();
+	~XfsManager();
+
+	HWND CreateWindowObject(WNDPROC lpfnWndProc, LPVOID lpUserData);
+	void DestroyWindowObject(HWND hWnd);
+	BOOL IsWindowObject(HWND hWnd);
+	LPVOID GetWindowData(HWND hWnd);
+	LRESULT Send(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam);
+	BOOL SendTimeout(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam, DWORD dwTimeOut);
+	BOOL Post(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam);
+
+	void SetConfig(LPCSTR lpszValueName, LPCSTR lpszValue);
+	BOOL GetConfig(LPCSTR lpszValueName, std::string* value);
+
+private:
+	XfsManager(const XfsManager&);
+	XfsManager& operator=(const XfsManager&);
+
+	std::shared_ptr<STANDIN_WINDOW> Find(HWND hWnd);
+	static void DeliverLoop(std::shared_ptr<STANDIN_WINDOW> window);
+
+	std::mutex m_mutex;
+	std::map<HWND, std::shared_ptr<STANDIN_WINDOW> > m_windows;
+	std::map<std::string, std::string> m_config;
+};
+
+extern XfsManager g_xfs_manager;
@@ -0,0 +1,211 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <condition_variable>
+#include "eventdispatcher.h"
+#include "testutil.h"
+
+/*
+ * Tests of the event dispatcher: per-window ordering, removal, the overflow policies
+ * applied while a window is stuck in its message procedure, and the disconnection of a
+ * window that stays stuck past the send timeout.
+ */
+
+/*
+ * @brief 
+ * Window whose procedure blocks on the first event until Release() is called, so the
+ * following events pile up in its dispatcher queue.
+ */
+class GatedWindow
+{
+public:
+	GatedWindow() : m_bEntered(false), m_bReleased(false)
+	{
+		m_hWnd = g_xfs_manager.CreateWindowObject(WndProc, this);
+	}
+
+	~GatedWindow()
+	{
+		Release();
+		g_xfs_manager.DestroyWindowObject(m_hWnd);
+	}
+
+	HWND Handle()
+	{
+		return m_hWnd;
+	}
+
+	void WaitEntered()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cond.wait(lock, [this]() { return m_bEntered; });
+	}
+
+	void Release()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bReleased = true;
+		m_cond.notify_all();
+	}
+
+	std::vector<std::pair<DWORD, WORD> > Events()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_events;
+	}
+
+private:
+	static LRESULT CALLBACK WndProc(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+	{
+		(void)uMessage;
+		(void)wParam;
+		GatedWindow* window = (GatedWindow*)g_xfs_manager.GetWindowData(hWnd);
+		LPWFSRESULT lpWFSResult = (LPWFSRESULT)lParam;
+		std::pair<DWORD, WORD> event(lpWFSResult->u.dwEventID, *(LPWORD)lpWFSResult->lpBuffer);
+		WFMFreeBuffer(lpWFSResult);
+
+		std::unique_lock<std::mutex> lock(window->m_mutex);
+		window->m_events.push_back(event);
+		window->m_bEntered = true;
+		window->m_cond.notify_all();
+		window->m_cond.wait(lock, [window]() { return window->m_bReleased; });
+		return 0;
+	}
+
+	HWND m_hWnd;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	bool m_bEntered;
+	bool m_bReleased;
+	std::vector<std::pair<DWORD, WORD> > m_events;
+};
+
+static void TestOrder()
+{
+	CHECK_EQ(0, g_event_dispatcher.Start(2, 1024, EVENT_POLICY_DROP_OLDEST));
+
+	TestWindow first, second, unknown;
+	g_event_dispatcher.Add(first.Handle());
+	g_event_dispatcher.Add(second.Handle());
+
+	for (DWORD i = 0; i < 500; i++)
+	{
+		g_event_dispatcher.Publish(first.Handle(), 1, WFS_SERVICE_EVENT, 1, i);
+		g_event_dispatcher.Publish(second.Handle(), 2, WFS_SERVICE_EVENT, 2, i);
+		g_event_dispatcher.Publish(unknown.Handle(), 3, WFS_SERVICE_EVENT, 3, i);
+	}
+	CHECK(first.Wait(WFS_SERVICE_EVENT, 500, 5000));
+	CHECK(second.Wait(WFS_SERVICE_EVENT, 500, 5000));
+
+	std::vector<TEST_MESSAGE> messages = first.Messages();
+	for (size_t i = 0; i < messages.size(); i++)
+	{
+		CHECK_EQ(1, messages[i].hService);
+		CHECK_EQ(i, (WORD)messages[i].dwData);
+	}
+
+	// A removed window gets nothing more.
+	g_event_dispatcher.Remove(second.Handle());
+	g_event_dispatcher.Publish(second.Handle(), 2, WFS_SERVICE_EVENT, 2, 0);
+	g_event_dispatcher.Publish(first.Handle(), 1, WFS_SERVICE_EVENT, 1, 500);
+	CHECK(first.Wait(WFS_SERVICE_EVENT, 501, 5000));
+	g_event_dispatcher.Stop();
+	CHECK_EQ(500, second.Count(WFS_SERVICE_EVENT));
+	CHECK_EQ(0, unknown.Count(WFS_SERVICE_EVENT));
+}
+
+static std::vector<std::pair<DWORD, WORD> > TestOverflow(DWORD dwPolicy)
+{
+	CHECK_EQ(0, g_event_dispatcher.Start(1, 2, dwPolicy));
+
+	GatedWindow window;
+	g_event_dispatcher.Add(window.Handle());
+	g_event_dispatcher.Publish(window.Handle(), 1, WFS_SERVICE_EVENT, 1, 0);
+	window.WaitEntered();
+
+	// The queue holds two events while the first one is being delivered.
+	g_event_dispatcher.Publish(window.Handle(), 1, WFS_SERVICE_EVENT, 2, 1);
+	g_event_dispatcher.Publish(window.Handle(), 1, WFS_SERVICE_EVENT, 3, 2);
+	g_event_dispatcher.Publish(window.Handle(), 1, WFS_SERVICE_EVENT, 2, 3);
+	g_event_dispatcher.Publish(window.Handle(), 1, WFS_SERVICE_EVENT, 4, 4);
+
+	window.Release();
+	g_event_dispatcher.Stop();
+	return window.Events();
+}
+
+static void TestPolicies()
+{
+	std::vector<std::pair<DWORD, WORD> > events = TestOverflow(EVENT_POLICY_DROP_OLDEST);
+	CHECK_EQ(3, events.size());
+	CHECK_EQ(0, events[0].second);
+	CHECK_EQ(3, events[1].second);
+	CHECK_EQ(4, events[2].second);
+
+	// Event 2 takes the place of its older instance, then event 4 drops the oldest.
+	events = TestOverflow(EVENT_POLICY_COALESCE);
+	CHECK_EQ(3, events.size());
+	CHECK_EQ(0, events[0].second);
+	CHECK_EQ(2, events[1].second);
+	CHECK_EQ(4, events[2].second);
+
+	events = TestOverflow(EVENT_POLICY_DISCONNECT);
+	CHECK_EQ(1, events.size());
+	CHECK_EQ(0, events[0].second);
+}
+
+static void TestStalledWindow()
+{
+	// One delivery thread: a stalled window must not keep it from the others.
+	CHECK_EQ(0, g_event_dispatcher.Start(1, 64, EVENT_POLICY_DROP_OLDEST, 50));
+
+	GatedWindow stalled;
+	TestWindow healthy;
+	g_event_dispatcher.Add(stalled.Handle());
+	g_event_dispatcher.Add(healthy.Handle());
+
+	g_event_dispatcher.Publish(stalled.Handle(), 1, WFS_SERVICE_EVENT, 1, 0);
+	stalled.WaitEntered();
+	g_event_dispatcher.Publish(stalled.Handle(), 1, WFS_SERVICE_EVENT, 1, 1);
+	g_event_dispatcher.Publish(healthy.Handle(), 2, WFS_SERVICE_EVENT, 2, 0);
+	CHECK(healthy.Wait(WFS_SERVICE_EVENT, 1, 5000));
+
+	// The stalled window was disconnected: it keeps the event it was sent, loses the
+	// one queued behind it and gets nothing more until it is added again.
+	g_event_dispatcher.Publish(stalled.Handle(), 1, WFS_SERVICE_EVENT, 1, 2);
+	stalled.Release();
+	g_event_dispatcher.Add(stalled.Handle());
+	g_event_dispatcher.Publish(stalled.Handle(), 1, WFS_SERVICE_EVENT, 1, 3);
+	CHECK(WaitUntil([&]() { return stalled.Events().size() == 2; }, 5000));
+	g_event_dispatcher.Stop();
+
+	std::vector<std::pair<DWORD, WORD> > events = stalled.Events();
+	CHECK_EQ(2, events.size());
+	CHECK_EQ(0, events[0].second);
+	CHECK_EQ(3, events[1].second);
+}
+
+int main()
+{
+	TestOrder();
+	TestPolicies();
+	TestStalledWindow();
+	printf("eventdispatcher_test: ok\n");
+	return 0;
+}
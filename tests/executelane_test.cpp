@@ -0,0 +1,271 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include "xfssp.h"
+#include "executelane.h"
+#include "testutil.h"
+
+/*
+ * Tests of the per-session execute lane: FIFO order per producer with many producers,
+ * a full lane refusing requests, and cancellation of queued requests.
+ */
+
+static LPWFSRESULT TestResult(REQUESTID reqId)
+{
+	LPWFSRESULT lpWFSResult;
+	CHECK_EQ(WFS_SUCCESS, WFMAllocateBuffer(sizeof(WFSRESULT), WFS_MEM_ZEROINIT, (LPVOID*)&lpWFSResult));
+	lpWFSResult->RequestID = reqId;
+	return lpWFSResult;
+}
+
+static std::vector<WFS_MSG*> g_cancelled;
+
+static void TestOnCancelled(WFS_MSG* msg)
+{
+	g_cancelled.push_back(msg);
+}
+
+static void TestFull()
+{
+	WFS_LANE* lane = LaneCreate(NULL, 4);
+	CHECK(lane != NULL);
+
+	for (REQUESTID reqId = 1; reqId <= 4; reqId++)
+		CHECK(LaneTryPush(lane, NULL, TestResult(reqId), 0, WFS_INDEFINITE_WAIT, NULL));
+
+	LPWFSRESULT lpWFSResult = TestResult(5);
+	CHECK(!LaneTryPush(lane, NULL, lpWFSResult, 0, WFS_INDEFINITE_WAIT, NULL));
+
+	// Popping one request frees exactly one slot.
+	WFS_MSG* msg = LanePeek(lane);
+	CHECK(msg != NULL);
+	CHECK_EQ(1, msg->RequestID);
+	CHECK(LaneBegin(lane, msg));
+	WFMFreeBuffer(msg->lpWFSResult);
+	LanePop(lane);
+	CHECK(LaneTryPush(lane, NULL, lpWFSResult, 0, WFS_INDEFINITE_WAIT, NULL));
+
+	for (REQUESTID reqId = 2; reqId <= 5; reqId++)
+	{
+		msg = LanePeek(lane);
+		CHECK(msg != NULL);
+		CHECK_EQ(reqId, msg->RequestID);
+		CHECK(LaneBegin(lane, msg));
+		WFMFreeBuffer(msg->lpWFSResult);
+		LanePop(lane);
+	}
+	CHECK(LanePeek(lane) == NULL);
+	LaneDestroy(lane);
+}
+
+static void TestProducers()
+{
+	const int producers = 4;
+	const REQUESTID perProducer = 20000;
+	WFS_LANE* lane = LaneCreate(NULL, 64);
+	CHECK(lane != NULL);
+
+	std::vector<std::thread> threads;
+	for (int p = 0; p < producers; p++)
+	{
+		threads.push_back(std::thread([lane, p, perProducer]() {
+			for (REQUESTID i = 0; i < perProducer; i++)
+			{
+				LPWFSRESULT lpWFSResult = TestResult((REQUESTID)p * perProducer + i + 1);
+				while (!LaneTryPush(lane, NULL, lpWFSResult, 0, WFS_INDEFINITE_WAIT, NULL))
+					std::this_thread::yield();
+			}
+		}));
+	}
+
+	// Requests of one producer come out in the order it pushed them.
+	REQUESTID next[producers] = { 0 };
+	REQUESTID received = 0;
+	while (received < producers * perProducer)
+	{
+		WFS_MSG* msg = LanePeek(lane);
+		if (msg == NULL)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		REQUESTID reqId = msg->RequestID - 1;
+		int p = (int)(reqId / perProducer);
+		CHECK_EQ(next[p], reqId % perProducer);
+		next[p]++;
+		received++;
+
+		CHECK(LaneBegin(lane, msg));
+		WFMFreeBuffer(msg->lpWFSResult);
+		LanePop(lane);
+	}
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	CHECK(LanePeek(lane) == NULL);
+	LaneDestroy(lane);
+}
+
+static void TestCancel()
+{
+	WFS_LANE* lane = LaneCreate(NULL, 8);
+	CHECK(lane != NULL);
+	for (REQUESTID reqId = 1; reqId <= 6; reqId++)
+		CHECK(LaneTryPush(lane, NULL, TestResult(reqId), 0, WFS_INDEFINITE_WAIT, NULL));
+
+	// The running request cannot be cancelled any more.
+	WFS_MSG* running = LanePeek(lane);
+	CHECK(LaneBegin(lane, running));
+
+	g_cancelled.clear();
+	CHECK_EQ(0, LaneCancel(lane, 1, TestOnCancelled));
+	CHECK_EQ(1, LaneCancel(lane, 3, TestOnCancelled));
+	CHECK_EQ(0, LaneCancel(lane, 3, TestOnCancelled));
+	CHECK_EQ(0, LaneCancel(lane, 42, TestOnCancelled));
+	CHECK_EQ(1, g_cancelled.size());
+	CHECK_EQ(3, g_cancelled[0]->RequestID);
+	CHECK_EQ(WFS_MSG_CANCELLED, g_cancelled[0]->lState.load());
+
+	CHECK_EQ(4, LaneCancel(lane, 0, TestOnCancelled));
+	CHECK_EQ(5, g_cancelled.size());
+
+	// Cancelled slots stay in the ring until the consumer skips them.
+	WFMFreeBuffer(running->lpWFSResult);
+	LanePop(lane);
+	for (REQUESTID reqId = 2; reqId <= 6; reqId++)
+	{
+		WFS_MSG* msg = LanePeek(lane);
+		CHECK(msg != NULL);
+		CHECK_EQ(reqId, msg->RequestID);
+		CHECK(!LaneBegin(lane, msg));
+		WFMFreeBuffer(msg->lpWFSResult);
+		LanePop(lane);
+	}
+	CHECK(LanePeek(lane) == NULL);
+	LaneDestroy(lane);
+}
+
+static void TestCancelCollision()
+{
+	// Identifiers that share a hint entry are still found, by the scan.
+	WFS_LANE* lane = LaneCreate(NULL, 8);
+	CHECK(lane != NULL);
+	const REQUESTID ids[] = { 1, 9, 17, 4 };
+	for (size_t i = 0; i < 4; i++)
+		CHECK(LaneTryPush(lane, NULL, TestResult(ids[i]), 0, WFS_INDEFINITE_WAIT, NULL));
+
+	g_cancelled.clear();
+	CHECK_EQ(1, LaneCancel(lane, 9, TestOnCancelled));
+	CHECK_EQ(1, LaneCancel(lane, 1, TestOnCancelled));
+	CHECK_EQ(0, LaneCancel(lane, 25, TestOnCancelled));
+	CHECK_EQ(2, g_cancelled.size());
+	CHECK_EQ(9, g_cancelled[0]->RequestID);
+	CHECK_EQ(1, g_cancelled[1]->RequestID);
+
+	for (size_t i = 0; i < 4; i++)
+	{
+		WFS_MSG* msg = LanePeek(lane);
+		CHECK(msg != NULL);
+		CHECK_EQ(ids[i], msg->RequestID);
+		CHECK_EQ(ids[i] == 17 || ids[i] == 4, LaneBegin(lane, msg));
+		WFMFreeBuffer(msg->lpWFSResult);
+		LanePop(lane);
+	}
+	LaneDestroy(lane);
+}
+
+static std::atomic<DWORD> g_dwRacingCancelled(0);
+
+static void TestOnRacingCancel(WFS_MSG* msg)
+{
+	(void)msg;
+	g_dwRacingCancelled++;
+}
+
+static void TestCancelRace()
+{
+	// Producers, the consumer and cancels run at once: every request ends exactly once,
+	// either executed by the consumer or cancelled.
+	const int producers = 3;
+	const DWORD perProducer = 20000;
+	WFS_LANE* lane = LaneCreate(NULL, 32);
+	CHECK(lane != NULL);
+
+	std::atomic<bool> bProducing(true);
+	std::vector<std::thread> threads;
+	for (int p = 0; p < producers; p++)
+	{
+		threads.push_back(std::thread([lane, p, perProducer]() {
+			for (DWORD i = 0; i < perProducer; i++)
+			{
+				LPWFSRESULT lpWFSResult = TestResult((REQUESTID)(p * perProducer + i + 1));
+				while (!LaneTryPush(lane, NULL, lpWFSResult, 0, WFS_INDEFINITE_WAIT, NULL))
+					std::this_thread::yield();
+			}
+		}));
+	}
+	std::thread canceller([&]() {
+		REQUESTID reqId = 1;
+		while (bProducing.load())
+		{
+			LaneCancel(lane, reqId, TestOnRacingCancel);
+			reqId = reqId % (producers * perProducer) + 7;
+			if (reqId % 64 == 0)
+				LaneCancel(lane, 0, TestOnRacingCancel);
+		}
+	});
+
+	DWORD dwExecuted = 0, dwSkipped = 0;
+	while (dwExecuted + dwSkipped < producers * perProducer)
+	{
+		WFS_MSG* msg = LanePeek(lane);
+		if (msg == NULL)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		if (LaneBegin(lane, msg))
+			dwExecuted++;
+		else
+			dwSkipped++;
+		WFMFreeBuffer(msg->lpWFSResult);
+		LanePop(lane);
+	}
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	bProducing.store(false);
+	canceller.join();
+
+	CHECK_EQ(g_dwRacingCancelled.load(), dwSkipped);
+	CHECK(LanePeek(lane) == NULL);
+	LaneDestroy(lane);
+}
+
+int main()
+{
+	TestFull();
+	TestProducers();
+	TestCancel();
+	TestCancelCollision();
+	TestCancelRace();
+	printf("executelane_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include "xfssp.h"
+#include "lockmanager.h"
+#include "testutil.h"
+
+/*
+ * Tests of the FIFO device lock: grants in arrival order, re-locks by the owner,
+ * admission checks, and waiters that time out or are cancelled while queued.
+ */
+
+static SESSION g_sessions[3];
+
+static WFS_MSG* TestRequest(SESSION* session, REQUESTID reqId)
+{
+	WFS_MSG* msg = new WFS_MSG();
+	msg->RequestID = reqId;
+	msg->lpSession = session;
+	msg->lState.store(WFS_MSG_QUEUED);
+	TimerNodeInit(&msg->timer);
+	return msg;
+}
+
+static void TestFifo()
+{
+	LockManager manager;
+	WFS_MSG* granted;
+
+	WFS_MSG* first = TestRequest(&g_sessions[0], 1);
+	CHECK_EQ(LOCK_GRANTED, manager.Acquire(&g_sessions[0], first, WFS_INDEFINITE_WAIT, NULL));
+	delete first;
+	CHECK(manager.IsAdmitted(&g_sessions[0]));
+	CHECK(!manager.IsAdmitted(&g_sessions[1]));
+
+	// The owner is granted again without queueing.
+	WFS_MSG* again = TestRequest(&g_sessions[0], 2);
+	CHECK_EQ(LOCK_GRANTED, manager.Acquire(&g_sessions[0], again, WFS_INDEFINITE_WAIT, NULL));
+	delete again;
+
+	WFS_MSG* second = TestRequest(&g_sessions[2], 3);
+	WFS_MSG* third = TestRequest(&g_sessions[1], 4);
+	CHECK_EQ(LOCK_QUEUED, manager.Acquire(&g_sessions[2], second, WFS_INDEFINITE_WAIT, NULL));
+	CHECK_EQ(LOCK_QUEUED, manager.Acquire(&g_sessions[1], third, WFS_INDEFINITE_WAIT, NULL));
+
+	CHECK(!manager.Release(&g_sessions[1], &granted));
+	CHECK(manager.Release(&g_sessions[0], &granted));
+	CHECK(granted == second);
+	CHECK(manager.IsAdmitted(&g_sessions[2]));
+	delete second;
+
+	CHECK(manager.Release(&g_sessions[2], &granted));
+	CHECK(granted == third);
+	delete third;
+
+	CHECK(manager.Release(&g_sessions[1], &granted));
+	CHECK(granted == NULL);
+	CHECK(manager.IsAdmitted(&g_sessions[0]));
+}
+
+static void TestTimedOutWaiter()
+{
+	LockManager manager;
+	WFS_MSG* granted;
+
+	WFS_MSG* owner = TestRequest(&g_sessions[0], 1);
+	CHECK_EQ(LOCK_GRANTED, manager.Acquire(&g_sessions[0], owner, WFS_INDEFINITE_WAIT, NULL));
+	delete owner;
+
+	// A waiter whose timer fired is skipped and freed by the manager.
+	WFS_MSG* expired = TestRequest(&g_sessions[1], 2);
+	WFS_MSG* waiting = TestRequest(&g_sessions[2], 3);
+	CHECK_EQ(LOCK_QUEUED, manager.Acquire(&g_sessions[1], expired, WFS_INDEFINITE_WAIT, NULL));
+	CHECK_EQ(LOCK_QUEUED, manager.Acquire(&g_sessions[2], waiting, WFS_INDEFINITE_WAIT, NULL));
+	expired->lState.store(WFS_MSG_TIMEDOUT);
+
+	CHECK(manager.Release(&g_sessions[0], &granted));
+	CHECK(granted == waiting);
+	delete waiting;
+	CHECK(manager.Release(&g_sessions[2], &granted));
+	CHECK(granted == NULL);
+}
+
+static void TestCancel()
+{
+	LockManager manager;
+	WFS_MSG* granted;
+	std::vector<WFS_MSG*> cancelled;
+
+	WFS_MSG* owner = TestRequest(&g_sessions[0], 1);
+	CHECK_EQ(LOCK_GRANTED, manager.Acquire(&g_sessions[0], owner, WFS_INDEFINITE_WAIT, NULL));
+	delete owner;
+
+	WFS_MSG* first = TestRequest(&g_sessions[1], 2);
+	WFS_MSG* second = TestRequest(&g_sessions[1], 3);
+	WFS_MSG* other = TestRequest(&g_sessions[2], 4);
+	CHECK_EQ(LOCK_QUEUED, manager.Acquire(&g_sessions[1], first, WFS_INDEFINITE_WAIT, NULL));
+	CHECK_EQ(LOCK_QUEUED, manager.Acquire(&g_sessions[1], second, WFS_INDEFINITE_WAIT, NULL));
+	CHECK_EQ(LOCK_QUEUED, manager.Acquire(&g_sessions[2], other, WFS_INDEFINITE_WAIT, NULL));
+
+	manager.Cancel(&g_sessions[1], 3, cancelled);
+	CHECK_EQ(1, cancelled.size());
+	CHECK(cancelled[0] == second);
+	CHECK_EQ(WFS_MSG_CANCELLED, second->lState.load());
+
+	manager.Cancel(&g_sessions[1], 0, cancelled);
+	CHECK_EQ(2, cancelled.size());
+	CHECK(cancelled[1] == first);
+	delete first;
+	delete second;
+
+	CHECK(manager.Release(&g_sessions[0], &granted));
+	CHECK(granted == other);
+	delete other;
+	CHECK(manager.Release(&g_sessions[2], &granted));
+}
+
+int main()
+{
+	TestFifo();
+	TestTimedOutWaiter();
+	TestCancel();
+	printf("lockmanager_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsalm.h>
+#include "mockdevice.h"
+#include "testutil.h"
+
+/*
+ * Tests of the mock device: start-up on the readiness signal, the event generator rate
+ * of the steady and flapping patterns, status snapshots read while they are rewritten,
+ * callbacks that call back into the device, and many devices sharing the scheduler
+ * thread.
+ */
+
+struct TEST_EVENTS {
+	std::atomic<DWORD> dwSet;
+	std::atomic<DWORD> dwReset;
+};
+
+static int TestOnEvent(LPVOID lpContext, int evt, int data)
+{
+	(void)data;
+	TEST_EVENTS* events = (TEST_EVENTS*)lpContext;
+	if (evt == WFS_SRVE_ALM_DEVICE_SET)
+		events->dwSet++;
+	else if (evt == WFS_SRVE_ALM_DEVICE_RESET)
+		events->dwReset++;
+	return 0;
+}
+
+static void TestReadiness()
+{
+	g_xfs_manager.SetConfig("EventRate", "0");
+	g_xfs_manager.SetConfig("DeviceReadyDelay", "30");
+
+	MockDevice device;
+	DEVICE_STATUS status;
+	CHECK(device.GetStatus(&status) != 0);
+	CHECK_EQ(WFS_ALM_DEVNODEVICE, status.fwDevice);
+
+	TEST_EVENTS events = {};
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	CHECK_EQ(0, device.Open(TestOnEvent, &events));
+	CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(25));
+	CHECK_EQ(0, device.GetStatus(&status));
+	CHECK_EQ(WFS_ALM_DEVONLINE, status.fwDevice);
+
+	// A second open finds the device up and returns at once.
+	start = std::chrono::steady_clock::now();
+	CHECK_EQ(0, device.Open(TestOnEvent, &events));
+	CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(25));
+
+	CHECK_EQ(0, device.Close());
+	CHECK(device.ReadStatus(&status) != 0);
+
+	// A device that does not come up in time fails the open and is left closed: it never
+	// comes up or raises events later, and opens again normally.
+	g_xfs_manager.SetConfig("EventRate", "1000");
+	g_xfs_manager.SetConfig("DeviceReadyDelay", "100");
+	g_xfs_manager.SetConfig("DeviceOpenTimeout", "20");
+	TEST_EVENTS late = {};
+	CHECK(device.Open(TestOnEvent, &late) != 0);
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	CHECK(device.GetStatus(&status) != 0);
+	CHECK_EQ(0, (int)(late.dwSet + late.dwReset));
+
+	g_xfs_manager.SetConfig("EventRate", "0");
+	g_xfs_manager.SetConfig("DeviceReadyDelay", "0");
+	g_xfs_manager.SetConfig("DeviceOpenTimeout", "10000");
+	CHECK_EQ(0, device.Open(TestOnEvent, &events));
+	CHECK_EQ(0, device.GetStatus(&status));
+	CHECK_EQ(0, device.Close());
+}
+
+static void TestSteadyRate()
+{
+	g_xfs_manager.SetConfig("EventRate", "1000");
+
+	MockDevice device;
+	TEST_EVENTS events = {};
+	CHECK_EQ(0, device.Open(TestOnEvent, &events));
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	CHECK_EQ(0, device.Close());
+
+	// The steady pattern alternates RESET and SET at the configured rate.
+	DWORD dwEvents = events.dwSet + events.dwReset;
+	CHECK(dwEvents >= 150 && dwEvents <= 450);
+	CHECK(events.dwReset >= events.dwSet && events.dwReset - events.dwSet <= 1);
+
+	// No callback runs once Close returned.
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	CHECK_EQ(dwEvents, events.dwSet + events.dwReset);
+
+	g_xfs_manager.SetConfig("EventRate", "0");
+}
+
+static void TestFlappingRate()
+{
+	g_xfs_manager.SetConfig("EventPattern", "3");
+	g_xfs_manager.SetConfig("EventRate", "1000");
+
+	MockDevice device;
+	TEST_EVENTS events = {};
+	CHECK_EQ(0, device.Open(TestOnEvent, &events));
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	CHECK_EQ(0, device.Close());
+
+	// SET and RESET each count as one event, so the total matches the steady pattern.
+	DWORD dwEvents = events.dwSet + events.dwReset;
+	CHECK(dwEvents >= 150 && dwEvents <= 450);
+	CHECK(events.dwSet >= events.dwReset && events.dwSet - events.dwReset <= 1);
+
+	g_xfs_manager.SetConfig("EventPattern", "0");
+	g_xfs_manager.SetConfig("EventRate", "0");
+}
+
+static void TestStatusSnapshotReaders()
+{
+	// The flapping generator rewrites the alarm state continually while another thread
+	// resets the device, which leaves the snapshot invalid for a moment each time.
+	g_xfs_manager.SetConfig("EventPattern", "3");
+	g_xfs_manager.SetConfig("EventRate", "20000");
+	g_xfs_manager.SetConfig("ResetDelay", "1");
+
+	MockDevice device;
+	TEST_EVENTS events = {};
+	CHECK_EQ(0, device.Open(TestOnEvent, &events));
+
+	std::atomic<bool> bStop(false);
+	std::atomic<DWORD> dwTorn(0), dwValid(0), dwInvalid(0);
+	std::vector<std::thread> readers;
+	for (int r = 0; r < 4; r++)
+	{
+		readers.push_back(std::thread([&]() {
+			while (!bStop.load())
+			{
+				// Every snapshot is one that a single Publish wrote: an online device with
+				// either alarm state, or a device busy resetting with the alarm clear.
+				DEVICE_STATUS status;
+				if (device.GetStatus(&status) == 0)
+				{
+					dwValid++;
+					if (status.fwDevice != WFS_ALM_DEVONLINE)
+						dwTorn++;
+				}
+				else
+				{
+					dwInvalid++;
+					if (status.fwDevice != WFS_ALM_DEVBUSY || status.bAlarmSet)
+						dwTorn++;
+				}
+			}
+		}));
+	}
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+	for (int i = 0; std::chrono::steady_clock::now() < end; i++)
+	{
+		CHECK_EQ(0, (i % 2) ? device.Reset() : device.ResetAlarm());
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	bStop = true;
+	for (size_t i = 0; i < readers.size(); i++)
+		readers[i].join();
+	CHECK_EQ(0, device.Close());
+
+	// The readers saw both kinds of snapshot while the generator kept publishing.
+	CHECK_EQ(0, dwTorn.load());
+	CHECK(dwValid > 0 && dwInvalid > 0);
+	CHECK(events.dwSet > 100 && events.dwReset > 100);
+
+	g_xfs_manager.SetConfig("EventPattern", "0");
+	g_xfs_manager.SetConfig("EventRate", "0");
+	g_xfs_manager.SetConfig("ResetDelay", "0");
+}
+
+static MockDevice* g_reentrant_device;
+
+static int TestOnEventReentrant(LPVOID lpContext, int evt, int data)
+{
+	// Device calls from the callback would deadlock if it ran under the device mutex.
+	DEVICE_STATUS status;
+	if (g_reentrant_device->ReadStatus(&status) == 0)
+		TestOnEvent(lpContext, evt, data);
+	return 0;
+}
+
+static void TestCallbackOutsideLock()
+{
+	g_xfs_manager.SetConfig("EventRate", "1000");
+
+	MockDevice device;
+	g_reentrant_device = &device;
+	TEST_EVENTS events = {};
+	CHECK_EQ(0, device.Open(TestOnEventReentrant, &events));
+	CHECK(WaitUntil([&]() { return events.dwSet + events.dwReset >= 10; }, 5000));
+	CHECK_EQ(0, device.Close());
+
+	g_xfs_manager.SetConfig("EventRate", "0");
+}
+
+static void TestManyDevices()
+{
+	const int count = 200;
+	g_xfs_manager.SetConfig("EventRate", "100");
+
+	std::vector<MockDevice*> devices;
+	std::vector<TEST_EVENTS> events(count);
+	for (int i = 0; i < count; i++)
+	{
+		devices.push_back(new MockDevice());
+		events[i].dwSet = 0;
+		events[i].dwReset = 0;
+		CHECK_EQ(0, devices[i]->Open(TestOnEvent, &events[i]));
+	}
+
+	CHECK(WaitUntil([&]() {
+		for (int i = 0; i < count; i++)
+			if (events[i].dwSet == 0)
+				return false;
+		return true;
+	}, 5000));
+
+	for (int i = 0; i < count; i++)
+	{
+		CHECK_EQ(0, devices[i]->Close());
+		delete devices[i];
+	}
+
+	g_xfs_manager.SetConfig("EventRate", "0");
+}
+
+int main()
+{
+	TestReadiness();
+	TestSteadyRate();
+	TestFlappingRate();
+	TestStatusSnapshotReaders();
+	TestCallbackOutsideLock();
+	TestManyDevices();
+	g_mock_scheduler.Stop();
+	printf("mockdevice_test: ok\n");
+	return 0;
+}
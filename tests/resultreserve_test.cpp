@@ -0,0 +1,111 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsalm.h>
+#include "resultreserve.h"
+#include "capabilities.h"
+#include "testutil.h"
+
+/*
+ * Tests of the result reserve: blocks sized per class, inline payloads, and the
+ * fallbacks once a stock or a block is too small.
+ */
+
+static BOOL IsInline(LPWFSRESULT lpResult, RESULT_CLASS eClass, LPVOID lpData)
+{
+	char* lpBegin = (char*)lpResult;
+	return (char*)lpData > lpBegin && (char*)lpData < lpBegin + ResultReserve::BlockSize(eClass);
+}
+
+static void TestBlockSizes()
+{
+	CHECK(ResultReserve::BlockSize(RESULT_CLASS_SMALL) < ResultReserve::BlockSize(RESULT_CLASS_STATUS));
+	CHECK(ResultReserve::BlockSize(RESULT_CLASS_STATUS) < ResultReserve::BlockSize(RESULT_CLASS_CAPS));
+	CHECK(ResultReserve::BlockSize(RESULT_CLASS_SMALL) < sizeof(WFSRESULT) + sizeof(CAPS_IMAGE));
+}
+
+static void TestPayloads()
+{
+	ResultReserve reserve;
+	CHECK_EQ(0, reserve.Start(4));
+
+	RESULT_RESERVE_COUNTERS counters;
+	reserve.GetCounters(&counters);
+	CHECK_EQ(4 * RESULT_CLASSES, (int)counters.dwReserved);
+
+	const ULONG sizes[RESULT_CLASSES] = { sizeof(DWORD), sizeof(WFSALMSTATUS), sizeof(CAPS_IMAGE) };
+	for (int i = 0; i < RESULT_CLASSES; i++)
+	{
+		LPWFSRESULT lpResult;
+		CHECK_EQ(WFS_SUCCESS, reserve.Allocate(&lpResult, (RESULT_CLASS)i));
+
+		LPVOID lpData;
+		CHECK_EQ(WFS_SUCCESS, reserve.AllocatePayload(lpResult, sizes[i], &lpData));
+		CHECK(IsInline(lpResult, (RESULT_CLASS)i, lpData));
+		WFMFreeBuffer(lpResult);
+	}
+
+	reserve.GetCounters(&counters);
+	CHECK_EQ(RESULT_CLASSES, (int)counters.dwHits);
+	CHECK_EQ(0, (int)counters.dwPayloadOverflows);
+
+	LPWFSRESULT lpResult;
+	LPVOID lpData;
+	CHECK_EQ(WFS_SUCCESS, reserve.Allocate(&lpResult, RESULT_CLASS_SMALL));
+	CHECK_EQ(WFS_SUCCESS, reserve.AllocatePayload(lpResult, sizeof(CAPS_IMAGE), &lpData));
+	CHECK(!IsInline(lpResult, RESULT_CLASS_SMALL, lpData));
+	WFMFreeBuffer(lpResult);
+
+	reserve.GetCounters(&counters);
+	CHECK_EQ(1, (int)counters.dwPayloadOverflows);
+
+	reserve.Stop();
+}
+
+static void TestEmptyStock()
+{
+	ResultReserve reserve;
+	CHECK_EQ(0, reserve.Start(2));
+
+	std::vector<LPWFSRESULT> results;
+	for (int i = 0; i < 8; i++)
+	{
+		LPWFSRESULT lpResult;
+		CHECK_EQ(WFS_SUCCESS, reserve.Allocate(&lpResult, RESULT_CLASS_STATUS));
+		CHECK(lpResult->RequestID == 0 && lpResult->lpBuffer == NULL);
+		results.push_back(lpResult);
+	}
+
+	RESULT_RESERVE_COUNTERS counters;
+	reserve.GetCounters(&counters);
+	CHECK_EQ(8, (int)(counters.dwHits + counters.dwMisses));
+	CHECK(counters.dwMisses > 0);
+
+	for (size_t i = 0; i < results.size(); i++)
+		WFMFreeBuffer(results[i]);
+	reserve.Stop();
+}
+
+int main()
+{
+	TestBlockSizes();
+	TestPayloads();
+	TestEmptyStock();
+	printf("resultreserve_test: ok\n");
+	return 0;
+}
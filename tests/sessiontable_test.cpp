@@ -0,0 +1,153 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsapi.h>
+#include <atomic>
+#include "sessiontable.h"
+#include "testutil.h"
+
+/*
+ * Tests of the session table: duplicate opens, generations of reused slots, two-step
+ * closes, a full table, and opens and closes racing from many threads.
+ */
+
+static SessionTable g_basic_table;
+static SessionTable g_full_table;
+static SessionTable g_race_table;
+
+static void TestOpenClose()
+{
+	SESSION* session;
+	DWORD dwGeneration;
+	CHECK_EQ(WFS_SUCCESS, g_basic_table.Insert(7, &session, &dwGeneration));
+	CHECK(g_basic_table.IsCurrent(session, dwGeneration));
+
+	// A handle that is already open is rejected and the session is left alone.
+	SESSION* duplicate = NULL;
+	CHECK_EQ(WFS_ERR_INVALID_HSERVICE, g_basic_table.Insert(7, &duplicate));
+	CHECK(duplicate == NULL);
+	CHECK(g_basic_table.IsCurrent(session, dwGeneration));
+
+	DWORD dwFound;
+	CHECK(g_basic_table.Find(7, &dwFound) == session);
+	CHECK_EQ(dwGeneration, dwFound);
+	CHECK(g_basic_table.Find(8) == NULL);
+	CHECK_EQ(WFS_ERR_INVALID_HSERVICE, g_basic_table.Insert(0, &session));
+
+	CHECK(g_basic_table.Remove(7));
+	CHECK(!g_basic_table.Remove(7));
+	CHECK(g_basic_table.Find(7) == NULL);
+	CHECK(!g_basic_table.IsCurrent(session, dwGeneration));
+
+	// The slot is reused, but the old generation stays stale.
+	SESSION* reopened;
+	DWORD dwReopened;
+	CHECK_EQ(WFS_SUCCESS, g_basic_table.Insert(7, &reopened, &dwReopened));
+	CHECK(reopened == session);
+	CHECK(dwReopened != dwGeneration);
+	CHECK(!g_basic_table.IsCurrent(session, dwGeneration));
+	CHECK(g_basic_table.IsCurrent(reopened, dwReopened));
+
+	// Only one closer detaches the session, and the slot is not reused before it is freed.
+	CHECK(g_basic_table.Detach(reopened, dwReopened));
+	CHECK(!g_basic_table.Detach(reopened, dwReopened));
+	CHECK(!g_basic_table.Remove(7));
+	CHECK(g_basic_table.Find(7) == NULL);
+	SESSION* other;
+	CHECK_EQ(WFS_SUCCESS, g_basic_table.Insert(7, &other));
+	CHECK(other != reopened);
+	CHECK(g_basic_table.Remove(7));
+	g_basic_table.Free(reopened);
+}
+
+static void TestFull()
+{
+	SESSION* session;
+	for (HSERVICE h = 1; h <= SESSION_TABLE_CAPACITY; h++)
+		CHECK_EQ(WFS_SUCCESS, g_full_table.Insert(h, &session));
+	CHECK_EQ(WFS_ERR_OUT_OF_MEMORY, g_full_table.Insert(SESSION_TABLE_CAPACITY + 1, &session));
+
+	for (HSERVICE h = 1; h <= SESSION_TABLE_CAPACITY; h++)
+		CHECK(g_full_table.Find(h) != NULL);
+
+	CHECK(g_full_table.Remove(3));
+	CHECK_EQ(WFS_SUCCESS, g_full_table.Insert(SESSION_TABLE_CAPACITY + 1, &session));
+	CHECK(g_full_table.Find(SESSION_TABLE_CAPACITY + 1) == session);
+}
+
+static void TestRace()
+{
+	// Every thread opens and closes the same few handles. A handle must never be open
+	// twice, and a lookup must only ever return the session of its own handle.
+	const int threads = 8;
+	const int rounds = 20000;
+	const HSERVICE handles = 4;
+	std::atomic<LONG> open[handles + 1];
+	for (HSERVICE h = 0; h <= handles; h++)
+		open[h] = 0;
+	std::atomic<bool> bFailed(false);
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++)
+	{
+		workers.push_back(std::thread([&, t]() {
+			for (int i = 0; i < rounds; i++)
+			{
+				HSERVICE h = (HSERVICE)((t + i) % handles + 1);
+				SESSION* session;
+				DWORD dwGeneration;
+				if (g_race_table.Insert(h, &session, &dwGeneration) == WFS_SUCCESS)
+				{
+					if (open[h].fetch_add(1) != 0)
+						bFailed = true;
+
+					DWORD dwFound;
+					if (g_race_table.Find(h, &dwFound) != session || dwFound != dwGeneration)
+						bFailed = true;
+
+					open[h].fetch_sub(1);
+					if (!g_race_table.Remove(h))
+						bFailed = true;
+					if (g_race_table.IsCurrent(session, dwGeneration))
+						bFailed = true;
+				}
+				else
+				{
+					SESSION* found = g_race_table.Find(h);
+					if (found != NULL && found->hService.load() != h)
+						bFailed = true;
+				}
+			}
+		}));
+	}
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	CHECK(!bFailed.load());
+	for (HSERVICE h = 1; h <= handles; h++)
+		CHECK(g_race_table.Find(h) == NULL);
+}
+
+int main()
+{
+	TestOpenClose();
+	TestFull();
+	TestRace();
+	printf("sessiontable_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,477 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <xfsspi.h>
+#include <xfsalm.h>
+#include "xfssp.h"
+#include "workerpool.h"
+#include "testutil.h"
+
+/*
+ * End-to-end test of the WFP* entry points against the XFS manager stand-in: open,
+ * GetInfo, Execute, Lock and Close complete on the application window with the right
+ * request identifiers.
+ */
+
+#define TEST_SPI_VERSIONS 0x00030203
+
+static HRESULT TestOpen(TestWindow& window, HSERVICE hService, REQUESTID reqId, LPCSTR lpszLogicalName = "ALM1")
+{
+	WFSVERSION spiVersion, srvcVersion;
+	HRESULT hResult = WFPOpen(hService, (LPSTR)lpszLogicalName, NULL, NULL, 0, 0, window.Handle(), reqId, NULL,
+		TEST_SPI_VERSIONS, &spiVersion, TEST_SPI_VERSIONS, &srvcVersion);
+	if (hResult != WFS_SUCCESS)
+		return hResult;
+
+	TEST_MESSAGE message;
+	if (!WaitUntil([&]() { return window.Find(WFS_OPEN_COMPLETE, reqId, &message); }, 5000))
+		return WFS_ERR_TIMEOUT;
+	return message.hResult;
+}
+
+static HRESULT TestClose(TestWindow& window, HSERVICE hService, REQUESTID reqId)
+{
+	HRESULT hResult = WFPClose(hService, window.Handle(), reqId);
+	if (hResult != WFS_SUCCESS)
+		return hResult;
+
+	TEST_MESSAGE message;
+	if (!WaitUntil([&]() { return window.Find(WFS_CLOSE_COMPLETE, reqId, &message); }, 5000))
+		return WFS_ERR_TIMEOUT;
+	return message.hResult;
+}
+
+static void TestOpenRejectsUnknownWindow()
+{
+	WFSVERSION spiVersion, srvcVersion;
+	CHECK(WFPOpen(1, (LPSTR)"ALM1", NULL, NULL, 0, 0, (HWND)0x1234, 1, NULL,
+		TEST_SPI_VERSIONS, &spiVersion, TEST_SPI_VERSIONS, &srvcVersion) != WFS_SUCCESS);
+}
+
+static void TestDuplicateOpen()
+{
+	TestWindow window;
+	CHECK_EQ(WFS_SUCCESS, TestOpen(window, 1, 1));
+	CHECK_EQ(WFS_ERR_INVALID_HSERVICE, TestOpen(window, 1, 2));
+	CHECK_EQ(WFS_SUCCESS, TestClose(window, 1, 3));
+	CHECK_EQ(WFS_ERR_INVALID_HSERVICE, WFPClose(1, window.Handle(), 4));
+}
+
+static void TestGetInfo()
+{
+	TestWindow window;
+	CHECK_EQ(WFS_SUCCESS, TestOpen(window, 1, 1));
+
+	CHECK_EQ(WFS_SUCCESS, WFPGetInfo(1, WFS_INF_ALM_STATUS, NULL, 0, window.Handle(), 2));
+	CHECK_EQ(WFS_SUCCESS, WFPGetInfo(1, WFS_INF_ALM_CAPABILITIES, NULL, 0, window.Handle(), 3));
+	CHECK(window.Wait(WFS_GETINFO_COMPLETE, 2, 5000));
+
+	TEST_MESSAGE message;
+	CHECK(window.Find(WFS_GETINFO_COMPLETE, 2, &message));
+	CHECK_EQ(WFS_SUCCESS, message.hResult);
+	CHECK_EQ(WFS_INF_ALM_STATUS, message.dwCode);
+	CHECK_EQ(WFS_ALM_DEVONLINE, (WORD)message.dwData);
+
+	CHECK(window.Find(WFS_GETINFO_COMPLETE, 3, &message));
+	CHECK_EQ(WFS_SUCCESS, message.hResult);
+	CHECK_EQ(WFS_INF_ALM_CAPABILITIES, message.dwCode);
+
+	CHECK_EQ(WFS_ERR_INVALID_HSERVICE, WFPGetInfo(99, WFS_INF_ALM_STATUS, NULL, 0, window.Handle(), 4));
+	CHECK_EQ(WFS_SUCCESS, TestClose(window, 1, 5));
+}
+
+static void TestStatusSnapshot()
+{
+	TestWindow window;
+	CHECK_EQ(WFS_SUCCESS, TestOpen(window, 1, 1));
+
+	WFS_STATUS_COUNTERS before, after;
+	CHECK(WFPQueryStatusCounters("ALM1", &before));
+
+	// An online device publishes a snapshot, so no request reads the device.
+	const REQUESTID requests = 64;
+	for (REQUESTID i = 0; i < requests; i++)
+		CHECK_EQ(WFS_SUCCESS, WFPGetInfo(1, WFS_INF_ALM_STATUS, NULL, 0, window.Handle(), i + 2));
+	CHECK(WaitUntil([&]() { return window.Count(WFS_GETINFO_COMPLETE) == requests; }, 5000));
+
+	for (REQUESTID i = 0; i < requests; i++)
+	{
+		TEST_MESSAGE message;
+		CHECK(window.Find(WFS_GETINFO_COMPLETE, i + 2, &message));
+		CHECK_EQ(WFS_SUCCESS, message.hResult);
+		CHECK_EQ(WFS_ALM_DEVONLINE, (WORD)message.dwData);
+	}
+
+	CHECK(WFPQueryStatusCounters("ALM1", &after));
+	CHECK_EQ(requests, after.dwSnapshot - before.dwSnapshot);
+	CHECK_EQ(0, after.dwIssued - before.dwIssued);
+	CHECK_EQ(0, after.dwCoalesced - before.dwCoalesced);
+	CHECK(!WFPQueryStatusCounters("NONE", &after));
+
+	CHECK_EQ(WFS_SUCCESS, TestClose(window, 1, requests + 2));
+}
+
+static void TestStatusCoalescing()
+{
+	// The device takes a while to come up and every read holds it for a while, so the
+	// status requests issued during the open find no snapshot and share reads.
+	g_xfs_manager.SetConfig("DeviceReadyDelay", "300");
+	g_xfs_manager.SetConfig("StatusReadDelay", "20");
+
+	TestWindow window;
+	WFSVERSION spiVersion, srvcVersion;
+	CHECK_EQ(WFS_SUCCESS, WFPOpen(1, (LPSTR)"ALM7", NULL, NULL, 0, 0, window.Handle(), 1, NULL,
+		TEST_SPI_VERSIONS, &spiVersion, TEST_SPI_VERSIONS, &srvcVersion));
+
+	const REQUESTID requests = 64;
+	for (REQUESTID i = 0; i < requests; i++)
+		CHECK_EQ(WFS_SUCCESS, WFPGetInfo(1, WFS_INF_ALM_STATUS, NULL, 0, window.Handle(), i + 2));
+	CHECK(WaitUntil([&]() { return window.Count(WFS_GETINFO_COMPLETE) == requests; }, 5000));
+
+	for (REQUESTID i = 0; i < requests; i++)
+	{
+		TEST_MESSAGE message;
+		CHECK(window.Find(WFS_GETINFO_COMPLETE, i + 2, &message));
+		CHECK_EQ(WFS_ERR_DEV_NOT_READY, message.hResult);
+	}
+
+	// Every request either issued a read or attached to one, and most attached.
+	WFS_STATUS_COUNTERS counters;
+	CHECK(WFPQueryStatusCounters("ALM7", &counters));
+	CHECK_EQ(0, counters.dwSnapshot);
+	CHECK_EQ(requests, counters.dwIssued + counters.dwCoalesced);
+	CHECK(counters.dwCoalesced > counters.dwIssued);
+
+	// Once the device is up, the snapshot answers again.
+	CHECK(window.Wait(WFS_OPEN_COMPLETE, 1, 5000));
+	TEST_MESSAGE message;
+	CHECK_EQ(WFS_SUCCESS, WFPGetInfo(1, WFS_INF_ALM_STATUS, NULL, 0, window.Handle(), requests + 2));
+	CHECK(WaitUntil([&]() { return window.Find(WFS_GETINFO_COMPLETE, requests + 2, &message); }, 5000));
+	CHECK_EQ(WFS_SUCCESS, message.hResult);
+	CHECK(WFPQueryStatusCounters("ALM7", &counters));
+	CHECK_EQ(1, counters.dwSnapshot);
+
+	CHECK_EQ(WFS_SUCCESS, TestClose(window, 1, requests + 3));
+	g_xfs_manager.SetConfig("DeviceReadyDelay", "0");
+	g_xfs_manager.SetConfig("StatusReadDelay", "0");
+}
+
+static void TestExecuteOrder()
+{
+	TestWindow window;
+	CHECK_EQ(WFS_SUCCESS, TestOpen(window, 1, 1));
+
+	const REQUESTID count = 200;
+	for (REQUESTID reqId = 10; reqId < 10 + count; reqId++)
+		CHECK_EQ(WFS_SUCCESS, WFPExecute(1, WFS_CMD_ALM_RESET, NULL, 0, window.Handle(), reqId));
+	CHECK_EQ(WFS_ERR_UNSUPP_COMMAND, WFPExecute(1, WFS_CMD_ALM_SET_ALARM, NULL, 0, window.Handle(), 9));
+	CHECK(window.Wait(WFS_EXECUTE_COMPLETE, count, 5000));
+
+	// Executes of one session complete in the order they were issued.
+	REQUESTID expected = 10;
+	std::vector<TEST_MESSAGE> messages = window.Messages();
+	for (size_t i = 0; i < messages.size(); i++)
+	{
+		if (messages[i].uMessage != WFS_EXECUTE_COMPLETE)
+			continue;
+		CHECK_EQ(expected, messages[i].RequestID);
+		CHECK_EQ(WFS_SUCCESS, messages[i].hResult);
+		expected++;
+	}
+
+	CHECK_EQ(WFS_SUCCESS, TestClose(window, 1, 2));
+}
+
+static void TestExecutePoolStopped()
+{
+	TestWindow window;
+	CHECK_EQ(WFS_SUCCESS, TestOpen(window, 1, 1));
+
+	// An execute the pool refuses fails synchronously and never completes as well.
+	g_execute_pool.Stop();
+	CHECK_EQ(WFS_ERR_INTERNAL_ERROR, WFPExecute(1, WFS_CMD_ALM_RESET, NULL, 1000, window.Handle(), 2));
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	TEST_MESSAGE message;
+	CHECK(!window.Find(WFS_EXECUTE_COMPLETE, 2, &message));
+
+	CHECK_EQ(0, g_execute_pool.Start(0));
+	CHECK_EQ(WFS_SUCCESS, WFPExecute(1, WFS_CMD_ALM_RESET, NULL, 0, window.Handle(), 3));
+	CHECK(WaitUntil([&]() { return window.Find(WFS_EXECUTE_COMPLETE, 3, &message); }, 5000));
+	CHECK_EQ(WFS_SUCCESS, message.hResult);
+	CHECK(!window.Find(WFS_EXECUTE_COMPLETE, 2, &message));
+
+	CHECK_EQ(WFS_SUCCESS, TestClose(window, 1, 4));
+}
+
+static void TestLockQueue()
+{
+	TestWindow first, second;
+	CHECK_EQ(WFS_SUCCESS, TestOpen(first, 1, 1));
+	CHECK_EQ(WFS_SUCCESS, TestOpen(second, 2, 1));
+
+	CHECK_EQ(WFS_SUCCESS, WFPLock(1, 0, first.Handle(), 2));
+	CHECK(first.Wait(WFS_LOCK_COMPLETE, 1, 5000));
+
+	// A lock held by another session rejects executes, queues a lock request and lets
+	// a request with a timeout expire.
+	CHECK_EQ(WFS_ERR_LOCKED, WFPExecute(2, WFS_CMD_ALM_RESET, NULL, 0, second.Handle(), 2));
+	CHECK_EQ(WFS_SUCCESS, WFPLock(2, 50, second.Handle(), 3));
+	CHECK(second.Wait(WFS_LOCK_COMPLETE, 1, 5000));
+	TEST_MESSAGE message;
+	CHECK(second.Find(WFS_LOCK_COMPLETE, 3, &message));
+	CHECK_EQ(WFS_ERR_TIMEOUT, message.hResult);
+
+	CHECK_EQ(WFS_SUCCESS, WFPLock(2, 0, second.Handle(), 4));
+	CHECK_EQ(WFS_SUCCESS, WFPUnlock(1, first.Handle(), 3));
+	CHECK(second.Wait(WFS_LOCK_COMPLETE, 2, 5000));
+	CHECK(second.Find(WFS_LOCK_COMPLETE, 4, &message));
+	CHECK_EQ(WFS_SUCCESS, message.hResult);
+
+	CHECK_EQ(WFS_SUCCESS, TestClose(second, 2, 5));
+	CHECK_EQ(WFS_SUCCESS, TestClose(first, 1, 4));
+}
+
+static void TestCloseCancels()
+{
+	// A slow reset keeps the device busy without a status snapshot while requests queue
+	// up behind it.
+	g_xfs_manager.SetConfig("ResetDelay", "300");
+
+	TestWindow window;
+	CHECK_EQ(WFS_SUCCESS, TestOpen(window, 1, 1, "ALM3"));
+
+	CHECK_EQ(WFS_SUCCESS, WFPExecute(1, WFS_CMD_ALM_RESET, NULL, 0, window.Handle(), 2));
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	for (REQUESTID i = 3; i <= 5; i++)
+		CHECK_EQ(WFS_SUCCESS, WFPGetInfo(1, WFS_INF_ALM_STATUS, NULL, 0, window.Handle(), i));
+	for (REQUESTID i = 6; i <= 8; i++)
+		CHECK_EQ(WFS_SUCCESS, WFPExecute(1, WFS_CMD_ALM_RESET, NULL, 0, window.Handle(), i));
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	CHECK_EQ(WFS_SUCCESS, WFPCancelAsyncRequest(1, 8));
+
+	WFS_SESSION_COUNTERS counters;
+	CHECK(WFPQuerySessionCounters(1, &counters));
+	CHECK_EQ(3, (int)counters.dwInfoRequests);
+	CHECK_EQ(4, (int)counters.dwExecuteRequests);
+	CHECK_EQ(1, (int)counters.dwCancelRequests);
+
+	// The close cancels what is still queued without waiting for the reset.
+	CHECK_EQ(WFS_SUCCESS, WFPClose(1, window.Handle(), 9));
+	CHECK(!WFPQuerySessionCounters(1, &counters));
+	CHECK(window.Wait(WFS_CLOSE_COMPLETE, 1, 5000));
+	CHECK(window.Wait(WFS_GETINFO_COMPLETE, 3, 5000));
+	CHECK(window.Wait(WFS_EXECUTE_COMPLETE, 4, 5000));
+
+	TEST_MESSAGE message;
+	for (REQUESTID i = 3; i <= 5; i++)
+	{
+		CHECK(window.Find(WFS_GETINFO_COMPLETE, i, &message));
+		CHECK_EQ(WFS_ERR_CANCELED, message.hResult);
+	}
+	// The first execute waits on the device; the later ones were still queued.
+	for (REQUESTID i = 6; i <= 8; i++)
+	{
+		CHECK(window.Find(WFS_EXECUTE_COMPLETE, i, &message));
+		CHECK_EQ(WFS_ERR_CANCELED, message.hResult);
+	}
+
+	g_xfs_manager.SetConfig("ResetDelay", "0");
+}
+
+static void TestDeviceOpenRaces()
+{
+	// A slow device start leaves the first open in progress long enough to race it.
+	g_xfs_manager.SetConfig("DeviceReadyDelay", "200");
+
+	TestWindow window;
+	WFSVERSION spiVersion, srvcVersion;
+	WFS_DEVICE_COUNTERS counters;
+
+	// The only session closes while it opens the device: the device is closed after.
+	CHECK_EQ(WFS_SUCCESS, WFPOpen(1, (LPSTR)"ALM4", NULL, NULL, 0, 0, window.Handle(), 1, NULL,
+		TEST_SPI_VERSIONS, &spiVersion, TEST_SPI_VERSIONS, &srvcVersion));
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	CHECK_EQ(WFS_SUCCESS, TestClose(window, 1, 2));
+	CHECK(window.Wait(WFS_OPEN_COMPLETE, 1, 5000));
+	CHECK(WaitUntil([&]() { return WFPQueryDeviceCounters("ALM4", &counters) && counters.dwCloses == 1; }, 5000));
+	CHECK_EQ(1, (int)counters.dwOpens);
+
+	// A second session arriving during the open waits for it instead of opening again.
+	CHECK_EQ(WFS_SUCCESS, WFPOpen(1, (LPSTR)"ALM5", NULL, NULL, 0, 0, window.Handle(), 3, NULL,
+		TEST_SPI_VERSIONS, &spiVersion, TEST_SPI_VERSIONS, &srvcVersion));
+	CHECK_EQ(WFS_SUCCESS, TestOpen(window, 2, 4, "ALM5"));
+	TEST_MESSAGE message;
+	CHECK(WaitUntil([&]() { return window.Find(WFS_OPEN_COMPLETE, 3, &message); }, 5000));
+	CHECK_EQ(WFS_SUCCESS, message.hResult);
+	CHECK(WFPQueryDeviceCounters("ALM5", &counters));
+	CHECK_EQ(1, (int)counters.dwOpens);
+
+	CHECK_EQ(WFS_SUCCESS, TestClose(window, 1, 5));
+	CHECK_EQ(WFS_SUCCESS, TestClose(window, 2, 6));
+	CHECK(WaitUntil([&]() { return WFPQueryDeviceCounters("ALM5", &counters) && counters.dwCloses == 1; }, 5000));
+	CHECK_EQ(1, (int)counters.dwOpens);
+
+	g_xfs_manager.SetConfig("DeviceReadyDelay", "0");
+}
+
+static void TestConcurrentClose()
+{
+	TestWindow window;
+	WFS_DEVICE_COUNTERS counters;
+	CHECK_EQ(WFS_SUCCESS, TestOpen(window, 2, 1, "ALM6"));
+
+	// Two closes race on one handle: one of them closes it, and the device that session 2
+	// still holds is released once.
+	REQUESTID reqId = 2;
+	for (int round = 0; round < 100; round++)
+	{
+		CHECK_EQ(WFS_SUCCESS, TestOpen(window, 1, reqId++, "ALM6"));
+
+		HRESULT hResults[2];
+		REQUESTID closeIds[2] = { reqId, reqId + 1 };
+		reqId += 2;
+		std::atomic<int> ready(0);
+		std::vector<std::thread> closers;
+		for (int i = 0; i < 2; i++)
+		{
+			closers.push_back(std::thread([&, i]() {
+				ready++;
+				while (ready.load() < 2)
+					std::this_thread::yield();
+				hResults[i] = WFPClose(1, window.Handle(), closeIds[i]);
+			}));
+		}
+		for (size_t i = 0; i < closers.size(); i++)
+			closers[i].join();
+
+		CHECK((hResults[0] == WFS_SUCCESS) != (hResults[1] == WFS_SUCCESS));
+		CHECK(hResults[0] == WFS_ERR_INVALID_HSERVICE || hResults[1] == WFS_ERR_INVALID_HSERVICE);
+		TEST_MESSAGE message;
+		REQUESTID closed = closeIds[hResults[0] == WFS_SUCCESS ? 0 : 1];
+		CHECK(WaitUntil([&]() { return window.Find(WFS_CLOSE_COMPLETE, closed, &message); }, 5000));
+	}
+
+	CHECK(WFPQueryDeviceCounters("ALM6", &counters));
+	CHECK_EQ(1, (int)counters.dwOpens);
+	CHECK_EQ(0, (int)counters.dwCloses);
+	CHECK_EQ(WFS_SUCCESS, TestClose(window, 2, reqId));
+}
+
+static void TestRequestsDuringOpenClose()
+{
+	// Every handle is opened and closed over and over while other threads send requests
+	// on the same handles. A request is either refused with INVALID_HSERVICE or
+	// accepted, and every accepted one completes exactly once.
+	const HSERVICE handles = 3;
+	const int rounds = 30;
+	std::atomic<bool> bCycling(true);
+	std::atomic<int> cycled(0);
+
+	std::vector<std::thread> cyclers;
+	for (HSERVICE h = 1; h <= handles; h++)
+	{
+		cyclers.push_back(std::thread([&, h]() {
+			TestWindow window;
+			REQUESTID reqId = 1;
+			for (int round = 0; round < rounds; round++)
+			{
+				CHECK_EQ(WFS_SUCCESS, TestOpen(window, h, reqId++, "ALM8"));
+				CHECK_EQ(WFS_SUCCESS, TestClose(window, h, reqId++));
+			}
+			cycled++;
+		}));
+	}
+
+	TestWindow windows[2];
+	size_t accepted[2] = { 0, 0 };
+	std::vector<std::thread> requesters;
+	for (int t = 0; t < 2; t++)
+	{
+		requesters.push_back(std::thread([&, t]() {
+			for (REQUESTID i = 1; bCycling.load(); i++)
+			{
+				HSERVICE h = (HSERVICE)(i % handles) + 1;
+				HRESULT hResult;
+				if (i % 3 == 0)
+					hResult = WFPExecute(h, WFS_CMD_ALM_RESET, NULL, 0, windows[t].Handle(), i);
+				else
+					hResult = WFPGetInfo(h, i % 3 == 1 ? WFS_INF_ALM_STATUS : WFS_INF_ALM_CAPABILITIES,
+						NULL, 0, windows[t].Handle(), i);
+				CHECK(hResult == WFS_SUCCESS || hResult == WFS_ERR_INVALID_HSERVICE);
+				if (hResult == WFS_SUCCESS)
+					accepted[t]++;
+				std::this_thread::yield();
+			}
+		}));
+	}
+
+	for (size_t i = 0; i < cyclers.size(); i++)
+		cyclers[i].join();
+	bCycling = false;
+	for (size_t i = 0; i < requesters.size(); i++)
+		requesters[i].join();
+	CHECK_EQ((int)handles, cycled.load());
+
+	for (int t = 0; t < 2; t++)
+	{
+		CHECK(WaitUntil([&]() {
+			return windows[t].Count(WFS_EXECUTE_COMPLETE) + windows[t].Count(WFS_GETINFO_COMPLETE) >= accepted[t];
+		}, 5000));
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	for (int t = 0; t < 2; t++)
+		CHECK_EQ(accepted[t], windows[t].Count(WFS_EXECUTE_COMPLETE) + windows[t].Count(WFS_GETINFO_COMPLETE));
+
+	WFS_SESSION_COUNTERS counters;
+	for (HSERVICE h = 1; h <= handles; h++)
+		CHECK(!WFPQuerySessionCounters(h, &counters));
+}
+
+static void TestEvents()
+{
+	// The generator settings are read when a device opens, so use a device of its own.
+	g_xfs_manager.SetConfig("EventRate", "1000");
+
+	TestWindow window;
+	CHECK_EQ(WFS_SUCCESS, TestOpen(window, 1, 1, "ALM2"));
+	CHECK_EQ(WFS_SUCCESS, WFPRegister(1, SERVICE_EVENTS, window.Handle(), window.Handle(), 2));
+	CHECK(window.Wait(WFS_SERVICE_EVENT, 10, 5000));
+	CHECK_EQ(WFS_SUCCESS, TestClose(window, 1, 3));
+
+	g_xfs_manager.SetConfig("EventRate", "0");
+}
+
+int main()
+{
+	TestOpenRejectsUnknownWindow();
+	TestDuplicateOpen();
+	TestGetInfo();
+	TestStatusSnapshot();
+	TestStatusCoalescing();
+	TestExecuteOrder();
+	TestExecutePoolStopped();
+	TestLockQueue();
+	TestCloseCancels();
+	TestDeviceOpenRaces();
+	TestConcurrentClose();
+	TestRequestsDuringOpenClose();
+	TestEvents();
+	CHECK_EQ(WFS_SUCCESS, WFPUnloadService());
+	printf("sp_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <string.h>
+#include "sync.h"
+#include "testutil.h"
+
+/*
+ * Tests of the user-mode sync layer: mutual exclusion, event semantics and the
+ * per-name lock statistics.
+ */
+
+static void TestMutex()
+{
+	SpMutex mutex("sync_test.mutex");
+	long counter = 0;
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.push_back(std::thread([&]() {
+			for (int i = 0; i < 100000; i++)
+			{
+				std::lock_guard<SpMutex> lock(mutex);
+				counter++;
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	CHECK_EQ(400000, counter);
+	CHECK(mutex.try_lock());
+	mutex.unlock();
+}
+
+static void TestEvent()
+{
+	SpEvent automatic(FALSE, FALSE);
+	CHECK(!automatic.Wait(10));
+	automatic.Set();
+	CHECK(automatic.Wait(0));
+	CHECK(!automatic.Wait(0));
+
+	SpEvent manual(TRUE, TRUE);
+	CHECK(manual.Wait(0));
+	CHECK(manual.Wait(0));
+	manual.Reset();
+	CHECK(!manual.Wait(0));
+
+	// Every waiter of a manual-reset event is released by one Set().
+	std::atomic<int> released(0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 3; t++)
+	{
+		threads.push_back(std::thread([&]() {
+			if (manual.Wait(5000))
+				released++;
+		}));
+	}
+	manual.Set();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	CHECK_EQ(3, released.load());
+}
+
+static const SP_LOCK_STATS* TestFindStats(const std::vector<SP_LOCK_STATS>& stats, LPCSTR lpszName)
+{
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		if (strcmp(stats[i].szName, lpszName) == 0)
+			return &stats[i];
+	}
+	return NULL;
+}
+
+static void TestStats()
+{
+	SpMutex first("sync_test.stats");
+	SpMutex second("sync_test.stats");
+
+	// Acquires are only counted while statistics are enabled.
+	first.lock();
+	first.unlock();
+
+	SpLockStatsEnable(TRUE);
+	for (int i = 0; i < 10; i++)
+	{
+		first.lock();
+		first.unlock();
+		second.lock();
+		second.unlock();
+	}
+
+	first.lock();
+	std::thread waiter([&]() {
+		first.lock();
+		first.unlock();
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	first.unlock();
+	waiter.join();
+	SpLockStatsEnable(FALSE);
+
+	std::vector<SP_LOCK_STATS> stats;
+	SpLockStatsQuery(stats);
+	const SP_LOCK_STATS* lpStats = TestFindStats(stats, "sync_test.stats");
+	CHECK(lpStats != NULL);
+	CHECK_EQ(22, lpStats->ullAcquires);
+	CHECK_EQ(1, lpStats->ullContended);
+	CHECK(lpStats->ullTotalWaitUs >= 10000);
+	CHECK(lpStats->ullMaxHoldUs >= 10000);
+
+	ULONGLONG ullBuckets = 0;
+	for (int i = 0; i < SP_LOCK_HISTOGRAM_BUCKETS; i++)
+		ullBuckets += lpStats->ullWaitHistogram[i];
+	CHECK_EQ(1, ullBuckets);
+}
+
+int main()
+{
+	TestMutex();
+	TestEvent();
+	TestStats();
+	printf("sync_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#include <windows.h>
+#include <xfsapi.h>
+#include <xfsadmin.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "xfsmgr.h"
+
+/*
+ * Helpers shared by the tests. A failed check prints where it failed and ends the test
+ * with a non-zero exit code, whether or not NDEBUG is defined.
+ */
+
+#define CHECK(expr) \
+	do { \
+		if (!(expr)) { \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+			exit(1); \
+		} \
+	} while (0)
+
+#define CHECK_EQ(expected, actual) \
+	do { \
+		long long llExpected = (long long)(expected); \
+		long long llActual = (long long)(actual); \
+		if (llExpected != llActual) { \
+			fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, \
+				#expected, #actual, llExpected, llActual); \
+			exit(1); \
+		} \
+	} while (0)
+
+/*
+ * @brief 
+ * Polls a condition until it holds or the timeout expires.
+ * @param pred - The condition.
+ * @param dwTimeOut - Timeout in milliseconds.
+ * @return BOOL TRUE if the condition held in time.
+ */
+template <class Pred>
+BOOL WaitUntil(Pred pred, DWORD dwTimeOut)
+{
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(dwTimeOut);
+	while (!pred())
+	{
+		if (std::chrono::steady_clock::now() > deadline)
+			return FALSE;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return TRUE;
+}
+
+/*
+ * @brief 
+ * One message received by a TestWindow, with the fields of its result block.
+ */
+struct TEST_MESSAGE {
+	UINT uMessage;
+	HSERVICE hService;
+	REQUESTID RequestID;
+	HRESULT hResult;
+	DWORD dwCode;
+	DWORD dwData;
+};
+
+/*
+ * @brief 
+ * Stand-in window that records every completion and event it receives and frees the
+ * result blocks as an application would. dwData holds the first DWORD of the reply
+ * buffer of GetInfo completions and events.
+ */
+class TestWindow
+{
+public:
+	TestWindow()
+	{
+		m_hWnd = g_xfs_manager.CreateWindowObject(WndProc, this);
+	}
+
+	~TestWindow()
+	{
+		g_xfs_manager.DestroyWindowObject(m_hWnd);
+	}
+
+	HWND Handle()
+	{
+		return m_hWnd;
+	}
+
+	size_t Count(UINT uMessage)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		size_t count = 0;
+		for (size_t i = 0; i < m_messages.size(); i++)
+			if (m_messages[i].uMessage == uMessage)
+				count++;
+		return count;
+	}
+
+	BOOL Wait(UINT uMessage, size_t count, DWORD dwTimeOut)
+	{
+		return WaitUntil([&]() { return Count(uMessage) >= count; }, dwTimeOut);
+	}
+
+	BOOL Find(UINT uMessage, REQUESTID reqId, TEST_MESSAGE* lpMessage)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (size_t i = 0; i < m_messages.size(); i++)
+		{
+			if (m_messages[i].uMessage == uMessage && m_messages[i].RequestID == reqId)
+			{
+				*lpMessage = m_messages[i];
+				return TRUE;
+			}
+		}
+		return FALSE;
+	}
+
+	std::vector<TEST_MESSAGE> Messages()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_messages;
+	}
+
+private:
+	static LRESULT CALLBACK WndProc(HWND hWnd, UINT uMessage, WPARAM wParam, LPARAM lParam)
+	{
+		(void)wParam;
+		TestWindow* window = (TestWindow*)g_xfs_manager.GetWindowData(hWnd);
+		LPWFSRESULT lpWFSResult = (LPWFSRESULT)lParam;
+
+		TEST_MESSAGE message;
+		message.uMessage = uMessage;
+		message.hService = lpWFSResult->hService;
+		message.RequestID = lpWFSResult->RequestID;
+		message.hResult = lpWFSResult->hResult;
+		message.dwCode = lpWFSResult->u.dwCommandCode;
+		message.dwData = 0;
+		if ((uMessage == WFS_GETINFO_COMPLETE || uMessage >= WFS_EXECUTE_EVENT) && lpWFSResult->lpBuffer != NULL)
+			message.dwData = *(LPDWORD)lpWFSResult->lpBuffer;
+		WFMFreeBuffer(lpWFSResult);
+
+		std::lock_guard<std::mutex> lock(window->m_mutex);
+		window->m_messages.push_back(message);
+		return 0;
+	}
+
+	HWND m_hWnd;
+	std::mutex m_mutex;
+	std::vector<TEST_MESSAGE> m_messages;
+};
@@ -0,0 +1,229 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <windows.h>
+#include <random>
+#include "timerwheel.h"
+#include "testutil.h"
+
+/*
+ * Tests of the hierarchical timer wheel driven by a fake clock: every timer fires on
+ * the first Advance() at or after its deadline and never before, across cascades from
+ * the upper levels and slot wrap-around.
+ */
+
+static ULONGLONG g_ullFakeNow;
+
+static ULONGLONG TestClock(void)
+{
+	return g_ullFakeNow;
+}
+
+struct TEST_TIMER {
+	TIMER_NODE node;
+	ULONGLONG ullDeadline;
+	ULONGLONG ullFiredAt;
+	DWORD dwFired;
+};
+
+static void TestOnExpired(LPVOID lpParam)
+{
+	TEST_TIMER* timer = (TEST_TIMER*)lpParam;
+	timer->ullFiredAt = g_ullFakeNow;
+	timer->dwFired++;
+}
+
+static void TestArm(TimerWheel& wheel, TEST_TIMER* timer, DWORD dwTimeOut)
+{
+	TimerNodeInit(&timer->node);
+	timer->ullDeadline = g_ullFakeNow + dwTimeOut;
+	timer->ullFiredAt = 0;
+	timer->dwFired = 0;
+	wheel.Schedule(&timer->node, dwTimeOut, TestOnExpired, timer);
+}
+
+/*
+ * @brief 
+ * Moves the fake clock one tick at a time and advances the wheel after each step.
+ */
+static void TestStep(TimerWheel& wheel, ULONGLONG ullUntil, DWORD dwTickMs)
+{
+	while (g_ullFakeNow < ullUntil)
+	{
+		g_ullFakeNow += dwTickMs;
+		wheel.Advance();
+	}
+}
+
+static void TestDeadline()
+{
+	g_ullFakeNow = 1000;
+	TimerWheel wheel(TestClock, 10);
+
+	TEST_TIMER exact, rounded, immediate;
+	TestArm(wheel, &exact, 100);
+	TestArm(wheel, &rounded, 15);
+	TestArm(wheel, &immediate, 0);
+
+	wheel.Advance();
+	CHECK_EQ(1, immediate.dwFired);
+	CHECK_EQ(1000, immediate.ullFiredAt);
+
+	// A deadline between two ticks is rounded up, never down.
+	g_ullFakeNow = 1010;
+	wheel.Advance();
+	CHECK_EQ(0, rounded.dwFired);
+	g_ullFakeNow = 1020;
+	wheel.Advance();
+	CHECK_EQ(1, rounded.dwFired);
+
+	g_ullFakeNow = 1099;
+	wheel.Advance();
+	CHECK_EQ(0, exact.dwFired);
+	g_ullFakeNow = 1100;
+	wheel.Advance();
+	CHECK_EQ(1, exact.dwFired);
+
+	// A late Advance fires the timers of every tick it skipped, once.
+	TEST_TIMER late;
+	TestArm(wheel, &late, 50);
+	g_ullFakeNow = 5000;
+	wheel.Advance();
+	wheel.Advance();
+	CHECK_EQ(1, late.dwFired);
+	CHECK_EQ(1, exact.dwFired);
+}
+
+static void TestCancel()
+{
+	g_ullFakeNow = 0;
+	TimerWheel wheel(TestClock, 10);
+
+	TEST_TIMER cancelled, kept;
+	TestArm(wheel, &cancelled, 200);
+	TestArm(wheel, &kept, 200);
+	CHECK(wheel.Cancel(&cancelled.node));
+	CHECK(!wheel.Cancel(&cancelled.node));
+
+	TestStep(wheel, 1000, 10);
+	CHECK_EQ(0, cancelled.dwFired);
+	CHECK_EQ(1, kept.dwFired);
+	CHECK(!wheel.Cancel(&kept.node));
+
+	// A cancelled node can be scheduled again.
+	TestArm(wheel, &cancelled, 30);
+	TestStep(wheel, 1030, 10);
+	CHECK_EQ(1, cancelled.dwFired);
+	CHECK_EQ(1030, cancelled.ullFiredAt);
+}
+
+static void TestCascade()
+{
+	const DWORD dwTickMs = 10;
+	g_ullFakeNow = 0;
+	TimerWheel wheel(TestClock, dwTickMs);
+
+	// One timer on each level: 64, 64^2 and 64^3 ticks are the level boundaries.
+	const DWORD timeouts[] = {
+		630,
+		(64 * 3 + 5) * dwTickMs,
+		(64 * 64 * 2 + 64 * 7 + 3) * dwTickMs,
+		(64 * 64 * 64 * 3 + 64 * 64 * 5 + 11) * dwTickMs,
+	};
+	const int count = sizeof(timeouts) / sizeof(timeouts[0]);
+	TEST_TIMER timers[count];
+	for (int i = 0; i < count; i++)
+		TestArm(wheel, &timers[i], timeouts[i]);
+
+	// Cancelling a timer that already cascaded down unlinks it from its new slot.
+	TEST_TIMER cascaded;
+	TestArm(wheel, &cascaded, (64 * 64 + 100) * dwTickMs);
+	TestStep(wheel, 64 * 64 * dwTickMs, dwTickMs);
+	CHECK(wheel.Cancel(&cascaded.node));
+
+	TestStep(wheel, timers[count - 1].ullDeadline + 100 * dwTickMs, dwTickMs);
+	for (int i = 0; i < count; i++)
+	{
+		CHECK_EQ(1, timers[i].dwFired);
+		CHECK_EQ(timers[i].ullDeadline, timers[i].ullFiredAt);
+	}
+	CHECK_EQ(0, cascaded.dwFired);
+}
+
+static void TestWrapAround()
+{
+	const DWORD dwTickMs = 10;
+	std::minstd_rand rng(7);
+
+	// Start a few ticks before each level rolls over, so deadlines wrap the slot index
+	// of their level and carry into the next one.
+	const ULONGLONG starts[] = { 61, 64 * 64 - 3, 64 * 64 * 64 - 2 };
+	for (size_t s = 0; s < sizeof(starts) / sizeof(starts[0]); s++)
+	{
+		g_ullFakeNow = starts[s] * dwTickMs;
+		TimerWheel wheel(TestClock, dwTickMs);
+
+		const int count = 500;
+		std::vector<TEST_TIMER> timers(count);
+		ULONGLONG ullLast = 0;
+		for (int i = 0; i < count; i++)
+		{
+			DWORD dwTimeOut = (DWORD)(rng() % (64 * 64 * 2)) * dwTickMs;
+			TestArm(wheel, &timers[i], dwTimeOut);
+			if (timers[i].ullDeadline > ullLast)
+				ullLast = timers[i].ullDeadline;
+		}
+
+		TestStep(wheel, ullLast + dwTickMs, dwTickMs);
+		for (int i = 0; i < count; i++)
+		{
+			CHECK_EQ(1, timers[i].dwFired);
+			CHECK_EQ(timers[i].ullDeadline, timers[i].ullFiredAt);
+		}
+	}
+}
+
+static void TestBeyondRange()
+{
+	// Deadlines past the 2^24 ticks of the wheel are parked and placed again as the
+	// top level turns; they still fire on time.
+	const DWORD dwTickMs = 100;
+	g_ullFakeNow = 0;
+	TimerWheel wheel(TestClock, dwTickMs);
+
+	TEST_TIMER far;
+	TestArm(wheel, &far, 4000000000U);
+	CHECK(far.ullDeadline / dwTickMs > (1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)));
+
+	g_ullFakeNow = far.ullDeadline - dwTickMs;
+	wheel.Advance();
+	CHECK_EQ(0, far.dwFired);
+	g_ullFakeNow = far.ullDeadline;
+	wheel.Advance();
+	CHECK_EQ(1, far.dwFired);
+}
+
+int main()
+{
+	TestDeadline();
+	TestCancel();
+	TestCascade();
+	TestWrapAround();
+	TestBeyondRange();
+	printf("timerwheel_test: ok\n");
+	return 0;
+}
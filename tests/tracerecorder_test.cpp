@@ -0,0 +1,165 @@
+/*
+ *   Copyright (c) 2023 thearistotlemethod@gmail.com
+ *   All rights reserved.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <windows.h>
+#include <xfsapi.h>
+#include <xfsspi.h>
+#include <fstream>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "tracerecorder.h"
+#include "testutil.h"
+
+/*
+ * Tests of the trace recorder: device names on event records, and traces that are
+ * appended to across runs or rotated when the file holds something else.
+ */
+
+#define TEST_TRACE "tracerecorder_test.trace"
+
+/*
+ * @brief 
+ * Reads a trace file.
+ * @param lpszPath - Path of the trace file.
+ * @param lpHeader - Receives the header.
+ * @param records - Receives the records.
+ * @return BOOL TRUE if the file starts with a header and ends at a record boundary.
+ */
+static BOOL ReadTrace(LPCSTR lpszPath, TRACE_FILE_HEADER* lpHeader, std::vector<TRACE_RECORD>& records)
+{
+	records.clear();
+	std::ifstream file(lpszPath, std::ios::binary);
+	if (!file.read((char*)lpHeader, sizeof(*lpHeader)))
+		return FALSE;
+
+	TRACE_RECORD record;
+	while (file.read((char*)&record, sizeof(record)))
+		records.push_back(record);
+	return file.gcount() == 0;
+}
+
+static BOOL IsName(const TRACE_RECORD& record, LPCSTR lpszName)
+{
+	CHAR szName[TRACE_NAME_LENGTH + 1] = { 0 };
+	memcpy(szName, record.u.szName, TRACE_NAME_LENGTH);
+	return record.wType == TRACE_RECORD_NAME && strcmp(szName, lpszName) == 0;
+}
+
+static void TestEventDevice()
+{
+	remove(TEST_TRACE);
+
+	TraceRecorder recorder;
+	CHECK_EQ(0, recorder.Start(TEST_TRACE));
+	recorder.Event("ALM1", 1, 10);
+	recorder.Event("ALM2", 2, 20);
+	recorder.Stop();
+
+	TRACE_FILE_HEADER header;
+	std::vector<TRACE_RECORD> records;
+	CHECK(ReadTrace(TEST_TRACE, &header, records));
+	CHECK_EQ(TRACE_FILE_VERSION, header.dwVersion);
+	CHECK_EQ(4, records.size());
+	CHECK_EQ(TRACE_RECORD_EVENT, records[0].wType);
+	CHECK_EQ(1, records[0].u.call.dwCommand);
+	CHECK_EQ(10, records[0].u.call.dwParam);
+	CHECK(IsName(records[1], "ALM1"));
+	CHECK_EQ(0, records[1].wCall);
+	CHECK_EQ(2, records[2].u.call.dwCommand);
+	CHECK(IsName(records[3], "ALM2"));
+}
+
+static void TestAppend()
+{
+	remove(TEST_TRACE);
+
+	TraceRecorder recorder;
+	CHECK_EQ(0, recorder.Start(TEST_TRACE));
+	recorder.Call(TRACE_CALL_LOCK, 1, 1, 0, 0);
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	recorder.Call(TRACE_CALL_UNLOCK, 1, 2, 0, 0);
+	recorder.Stop();
+
+	CHECK_EQ(0, recorder.Start(TEST_TRACE));
+	recorder.Call(TRACE_CALL_CLOSE, 1, 3, 0, 0);
+	recorder.Stop();
+
+	TRACE_FILE_HEADER header;
+	std::vector<TRACE_RECORD> records;
+	CHECK(ReadTrace(TEST_TRACE, &header, records));
+	CHECK_EQ(TRACE_FILE_MAGIC, header.dwMagic);
+	CHECK_EQ(3, records.size());
+	CHECK_EQ(TRACE_CALL_LOCK, records[0].wCall);
+	CHECK_EQ(TRACE_CALL_UNLOCK, records[1].wCall);
+	CHECK_EQ(TRACE_CALL_CLOSE, records[2].wCall);
+	CHECK(records[1].ullTimeUs >= 5000);
+	CHECK(records[2].ullTimeUs >= records[1].ullTimeUs);
+}
+
+static void TestRotate()
+{
+	remove(TEST_TRACE);
+	remove(TEST_TRACE ".1");
+
+	TRACE_FILE_HEADER old;
+	old.dwMagic = TRACE_FILE_MAGIC;
+	old.dwVersion = TRACE_FILE_VERSION - 1;
+	old.dwRecordSize = sizeof(TRACE_RECORD);
+	old.dwReserved = 0;
+	{
+		std::ofstream file(TEST_TRACE, std::ios::binary);
+		file.write((const char*)&old, sizeof(old));
+	}
+
+	TraceRecorder recorder;
+	CHECK_EQ(0, recorder.Start(TEST_TRACE));
+	recorder.Call(TRACE_CALL_CLOSE, 1, 1, 0, 0);
+	recorder.Stop();
+
+	TRACE_FILE_HEADER header;
+	std::vector<TRACE_RECORD> records;
+	CHECK(ReadTrace(TEST_TRACE, &header, records));
+	CHECK_EQ(TRACE_FILE_VERSION, header.dwVersion);
+	CHECK_EQ(1, records.size());
+	CHECK(ReadTrace(TEST_TRACE ".1", &header, records));
+	CHECK_EQ(TRACE_FILE_VERSION - 1, header.dwVersion);
+	CHECK_EQ(0, records.size());
+
+	// A trace cut within a record is rotated as well, not appended out of step.
+	{
+		std::ofstream file(TEST_TRACE, std::ios::binary | std::ios::app);
+		file.write("x", 1);
+	}
+	CHECK_EQ(0, recorder.Start(TEST_TRACE));
+	recorder.Stop();
+	CHECK(ReadTrace(TEST_TRACE, &header, records));
+	CHECK_EQ(0, records.size());
+	CHECK(!ReadTrace(TEST_TRACE ".1", &header, records));
+	CHECK_EQ(1, records.size());
+
+	remove(TEST_TRACE);
+	remove(TEST_TRACE ".1");
+}
+
+int main()
+{
+	TestEventDevice();
+	TestAppend();
+	TestRotate();
+	printf("tracerecorder_test: ok\n");
+	return 0;
+}